@@ -5,9 +5,9 @@
 
 	Parameters
 
-	Todo: Num Harmonics
+	DONE Num Harmonics (runtime sized, up to MAX_PARTIALS)
 
-	Todo: Num Voices
+	DONE Num Voices (up to MAX_VOICES)
 
 	DSP:
 	DONE Master volume
@@ -16,8 +16,9 @@
 	DONE Bypass Partials
 	Done? Envelope
 	Done Filter
+	DONE Filter per voice, with its own envelope
 	DONE Add/Subtract Partials
-	Add/subtract voices
+	DONE Add/subtract voices
 
 	GUI:
 	DONE Master volume
@@ -30,13 +31,13 @@
 
 	TODOS:
 		Fix artifacting/transiants
-			Juce::ADSR pops when going to release early. Need a custom ADSR with better ramping?
-		Gain ramping on the partial volumes.
-			juce::dsp::Gain for each or custom ramp solution? Which is less process intensive
-				Custom: Have a target Volume value, and a current value that is additively added to each cycle until it reaches the target
+			DONE Juce::ADSR pops when going to release early. Need a custom ADSR with better ramping?
+				Envelope: exponential segments that always start from the current level
+		DONE Gain ramping on the partial volumes.
+			Custom ramp in PartialBank: a step per partial added to the gain every sample until it reaches the target
 		Filter Type switching
 
-		Add an envelope to the filter
+		DONE Add an envelope to the filter
 
   ==============================================================================
 */
@@ -47,15 +48,31 @@
 
 using APVTS = juce::AudioProcessorValueTreeState;
 
-#define TWOPI 6.283185
+//Real-time safety checker (see debug/RealtimeChecker.h). On by default in debug builds
+#ifndef ADDSYNTH_REALTIME_CHECKS
+ #define ADDSYNTH_REALTIME_CHECKS JUCE_DEBUG
+#endif
 
-#define TABLE_SIZE 65536
+//1 = jassert on a violation, 0 = only log it
+#ifndef ADDSYNTH_REALTIME_CHECKS_ASSERT
+ #define ADDSYNTH_REALTIME_CHECKS_ASSERT 1
+#endif
+
+#define TWOPI 6.283185307179586
+
+//Sine table length, a power of two. 2048-4096 keeps it in L1, Hermite interpolation keeps the SNR of a much longer linear table
+#define TABLE_SIZE 4096
 
 #define NUM_PARTIALS 4
-#define MAX_PARTIALS 8
+#define MAX_PARTIALS 256
+
+//What MAX_PARTIALS was before the engine was sized at runtime. getLayout keeps these partials' parameters
+//at their old indices. "Number of Partials" also ran 0 to 8 then, so host automation saved as a normalised
+//value plays back 32 times the count. Saved state keeps the real count and loads as it was
+#define LEGACY_MAX_PARTIALS 8
 
 #define NUM_VOICES 8
-#define MAX_VOICES 8
+#define MAX_VOICES 128
 
 #define MASTER_GAIN_DEF 0.8f
 #define MASTER_GAIN_MAX 1.0f
@@ -74,6 +91,58 @@ using APVTS = juce::AudioProcessorValueTreeState;
 
 #define PARTIAL_BYPASS_DEF false
 
+#define PARTIAL_WAVEFORM_DEF 0
+
+//Band-limited wavetable levels (see dsp/Wavetables.h), level n holds 2^n harmonics
+#define WAVETABLE_LEVELS 11
+
+//apvts.state property holding the "User" waveform, as raw floats
+#define USER_WAVEFORM_PROPERTY "UserWaveform"
+//Longest cycle the editor loads from a file, longer files are cut to their start
+#define USER_WAVEFORM_MAX_SAMPLES 8192
+
+//Ramp lengths for parameter changes, so they don't zipper
+#define PARTIAL_GAIN_RAMP_SECONDS 0.005
+#define MASTER_GAIN_RAMP_SECONDS 0.005
+#define FILTER_CUTOFF_RAMP_SECONDS 0.02
+
+//A voice whose release has finished keeps going until its filter has rung down below this, about -100 dB
+#define FILTER_TAIL_THRESHOLD 1.0e-5f
+
+//While automation is moving, blocks are rendered in steps this long, the parameters moved along at each (see dsp/ParameterSnapshot.h)
+#define AUTOMATION_STEP_SAMPLES 64
+
+#define SYNTHESIS_MODE_DEF 0
+
+//Harmonic Table mode (see dsp/SynthSound.h). Ratios count as harmonic if, times a denominator up to
+//HARMONIC_MAX_DENOMINATOR, they land this close to whole numbers. Tables are cached by parameter hash
+#define HARMONIC_MAX_DENOMINATOR 4
+#define HARMONIC_RATIO_TOLERANCE 1.0e-4f
+#define HARMONIC_TABLE_CACHE 4
+
+//Partials above this fraction of Nyquist are dropped
+#define CULL_NYQUIST_DEF 0.95f
+#define CULL_NYQUIST_MAX 1.0f
+#define CULL_NYQUIST_MIN 0.5f
+#define CULL_NYQUIST_STEP 0.01f
+
+//Partials quieter than this (dB) are dropped
+#define CULL_FLOOR_DEF -96.0f
+#define CULL_FLOOR_MAX -40.0f
+#define CULL_FLOOR_MIN -144.0f
+#define CULL_FLOOR_STEP 1.0f
+
+//Multicore voice rendering (see dsp/VoiceRenderPool.h). Fewer active voices than this render on the audio thread alone
+#define MULTICORE_DEF false
+#define MULTICORE_MIN_VOICES 4
+#define MAX_RENDER_WORKERS 7
+//Share of the block period a render worker spins for after a batch, before it sleeps until the next block
+#define RENDER_WORKER_SPIN_FRACTION 0.25
+#define RENDER_WORKER_SPIN_MAX_MS 1.0
+
+//Voices render their partials together, several voices per register, only while none has more audible partials than this (see dsp/PartialBank.h)
+#define INTERLEAVE_MAX_PARTIALS 32
+
 #define ATTACK_DEF 0.5f
 #define ATTACK_MAX 5.0f
 #define ATTACK_MIN 0.005f
@@ -94,6 +163,9 @@ using APVTS = juce::AudioProcessorValueTreeState;
 #define RELEASE_MIN 0.005f
 #define RELEASE_STEP 0.001f
 
+//Added to the attack, decay and release parameters before they reach the envelope, so none is ever instant
+#define ENVELOPE_TIME_OFFSET 0.005f
+
 #define FILTER_CUTOFF_DEF 2000.0f
 #define FILTER_CUTOFF_MAX 20000.0f
 #define FILTER_CUTOFF_MIN 20.0f
@@ -104,6 +176,42 @@ using APVTS = juce::AudioProcessorValueTreeState;
 #define FILTER_RESONANCE_MIN 0.0f
 #define FILTER_RESONANCE_STEP 0.001f
 
+//Filter envelope, the amount is in octaves of cutoff at full envelope
+#define FILTER_ENV_AMOUNT_DEF 0.0f
+#define FILTER_ENV_AMOUNT_MAX 8.0f
+#define FILTER_ENV_AMOUNT_MIN -8.0f
+#define FILTER_ENV_AMOUNT_STEP 0.01f
+
+#define FILTER_ATTACK_DEF 0.01f
+#define FILTER_DECAY_DEF 0.5f
+#define FILTER_SUSTAIN_DEF 0.5f
+#define FILTER_RELEASE_DEF 0.5f
+
+//Control rate: the modulation matrix and the per voice filter coefficients are worked out once every this many samples
+#define CONTROL_SAMPLES 32
+
+//Modulation matrix (see dsp/ModMatrix.h). Amounts are -1 to 1 of each destination's range
+#define MOD_SLOTS 4
+#define MOD_AMOUNT_DEF 0.0f
+#define MOD_AMOUNT_MAX 1.0f
+#define MOD_AMOUNT_MIN -1.0f
+#define MOD_AMOUNT_STEP 0.01f
+
+//Full amount on the cutoff, in octaves, and on pitch, in semitones
+#define MOD_CUTOFF_OCTAVES 4.0f
+#define MOD_PITCH_SEMITONES 2.0f
+
+//LFOs restart with each note. Spread staggers their phase across the partials, 1 is one whole cycle
+#define NUM_LFOS 2
+#define LFO_RATE_DEF 1.0f
+#define LFO_RATE_MAX 20.0f
+#define LFO_RATE_MIN 0.01f
+#define LFO_RATE_STEP 0.01f
+
+#define LFO_SPREAD_DEF 0.0f
+#define LFO_SPREAD_MAX 1.0f
+#define LFO_SPREAD_MIN 0.0f
+#define LFO_SPREAD_STEP 0.01f
 
 namespace Params {
 	enum Names {
@@ -112,6 +220,7 @@ namespace Params {
 		Partial_Distance,
 		Partial_Volume,
 		Partial_Bypass,
+		Partial_Waveform,
 
 		Envelope_Attack,
 		Envelope_Decay,
@@ -122,8 +231,28 @@ namespace Params {
 		Filter_Resonance,
 		Filter_Bypass,
 		Filter_Type,
+		Filter_Env_Amount,
+		Filter_Env_Attack,
+		Filter_Env_Decay,
+		Filter_Env_Sustain,
+		Filter_Env_Release,
+
+		Num_Partials,
+		Num_Voices,
+
+		Synthesis_Mode,
+		Cull_Nyquist,
+		Cull_Floor,
+
+		Multicore_Rendering,
+
+		Mod_Source,
+		Mod_Destination,
+		Mod_Amount,
 
-		Num_Partials
+		Lfo_Rate,
+		Lfo_Shape,
+		Lfo_Spread
 
 	};
 
@@ -133,6 +262,7 @@ namespace Params {
 			{Partial_Distance, "Partial Distance "},
 			{Partial_Volume, "Partial Volume "},
 			{Partial_Bypass, "Mute Partial "},
+			{Partial_Waveform, "Partial Waveform "},
 
 			{Envelope_Attack, "Envelope Attack"},
 			{Envelope_Decay, "Envelope Decay"},
@@ -143,10 +273,129 @@ namespace Params {
 			{Filter_Resonance, "Filter Resonance"},
 			{Filter_Bypass, "Filter Bypass"},
 			{Filter_Type, "FilterType"},
+			{Filter_Env_Amount, "Filter Envelope Amount"},
+			{Filter_Env_Attack, "Filter Envelope Attack"},
+			{Filter_Env_Decay, "Filter Envelope Decay"},
+			{Filter_Env_Sustain, "Filter Envelope Sustain"},
+			{Filter_Env_Release, "Filter Envelope Release"},
 
-			{Num_Partials, "Number of Partials"}
+			{Num_Partials, "Number of Partials"},
+			{Num_Voices, "Number of Voices"},
+
+			{Synthesis_Mode, "Synthesis Mode"},
+			{Cull_Nyquist, "Cull Above Nyquist"},
+			{Cull_Floor, "Cull Below Floor"},
+
+			{Multicore_Rendering, "Multicore Rendering"},
+
+			{Mod_Source, "Mod Source "},
+			{Mod_Destination, "Mod Destination "},
+			{Mod_Amount, "Mod Amount "},
+
+			{Lfo_Rate, "LFO Rate "},
+			{Lfo_Shape, "LFO Shape "},
+			{Lfo_Spread, "LFO Spread "}
 		};
 
 		return params;
 	}
+}
+
+namespace SynthesisMode {
+	enum Modes {
+		Oscillator_Bank,
+		Inverse_FFT,
+		//Oscillator bank, but harmonic partial sets are baked into one table per voice
+		Harmonic_Table
+	};
+
+	inline const juce::StringArray& getNames() {
+		static juce::StringArray names = { "Oscillator Bank", "Inverse FFT", "Harmonic Table" };
+		return names;
+	}
+}
+
+namespace Waveform {
+	enum Shapes {
+		Sine,
+		Saw,
+		Square,
+		User,
+
+		Num_Shapes
+	};
+
+	inline const juce::StringArray& getNames() {
+		static juce::StringArray names = { "Sine", "Saw", "Square", "User" };
+		return names;
+	}
+}
+
+namespace ModSource {
+	enum Sources {
+		None,
+		Lfo_1,
+		Lfo_2,
+		Filter_Envelope,
+		Velocity,
+		Pitch_Wheel,
+		Mod_Wheel,
+		Breath,
+		Expression,
+
+		Num_Sources
+	};
+
+	inline const juce::StringArray& getNames() {
+		static juce::StringArray names = { "None", "LFO 1", "LFO 2", "Filter Envelope", "Velocity", "Pitch Wheel", "Mod Wheel", "Breath", "Expression" };
+		return names;
+	}
+}
+
+namespace ModDestination {
+	enum Destinations {
+		None,
+		//Every partial's volume, and distance from the fundamental. LFOs can move each partial differently
+		Partial_Volume,
+		Partial_Distance,
+		Filter_Cutoff,
+		Pitch,
+
+		Num_Destinations
+	};
+
+	inline const juce::StringArray& getNames() {
+		static juce::StringArray names = { "None", "Partial Volume", "Partial Distance", "Filter Cutoff", "Pitch" };
+		return names;
+	}
+}
+
+namespace LfoShape {
+	enum Shapes {
+		Sine,
+		Triangle,
+		Saw,
+		Square
+	};
+
+	inline const juce::StringArray& getNames() {
+		static juce::StringArray names = { "Sine", "Triangle", "Saw", "Square" };
+		return names;
+	}
+}
+
+//Builds of the partial bank's render loop, see OscillatorKernels
+namespace KernelVariant {
+	enum Variants {
+		Generic,
+		Avx2,
+		Avx512,
+
+		Num_Variants
+	};
+
+	inline const juce::StringArray& getNames() {
+		static juce::StringArray names = { "generic", "avx2", "avx512" };
+		return names;
+	}
 }
\ No newline at end of file
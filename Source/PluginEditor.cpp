@@ -17,13 +17,12 @@ AdditiveSynth1AudioProcessorEditor::AdditiveSynth1AudioProcessorEditor (Additive
 {
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
-    setSize (600, 300);
+    setSize (800, 400);
 
 	using namespace Params;
 	auto params = getParams();
 
 	APVTS& apvts = p.apvts;
-	//numberOfPartials = dynamic_cast<juce::AudioParameterInt*>(apvts.getParameter(params.at(Names::Num_Partials)));
 
 	//Attach controller
 	masterGainSliderAttachment = std::make_unique<APVTS::SliderAttachment>(apvts, params.at(Names::Master_Gain), masterGainSlider);
@@ -37,11 +36,25 @@ AdditiveSynth1AudioProcessorEditor::AdditiveSynth1AudioProcessorEditor (Additive
 	resonanceSliderAttach = std::make_unique<APVTS::SliderAttachment>(apvts, params.at(Names::Filter_Resonance), resonanceSlider);
 	filterBypassButtonAttach = std::make_unique<APVTS::ButtonAttachment>(apvts, params.at(Names::Filter_Bypass), filterBypassButton);
 
+	filterAmountSliderAttach = std::make_unique<APVTS::SliderAttachment>(apvts, params.at(Names::Filter_Env_Amount), filterAmountSlider);
+	filterAttackSliderAttach = std::make_unique<APVTS::SliderAttachment>(apvts, params.at(Names::Filter_Env_Attack), filterAttackSlider);
+	filterDecaySliderAttach = std::make_unique<APVTS::SliderAttachment>(apvts, params.at(Names::Filter_Env_Decay), filterDecaySlider);
+	filterSustainSliderAttach = std::make_unique<APVTS::SliderAttachment>(apvts, params.at(Names::Filter_Env_Sustain), filterSustainSlider);
+	filterReleaseSliderAttach = std::make_unique<APVTS::SliderAttachment>(apvts, params.at(Names::Filter_Env_Release), filterReleaseSlider);
+
+	//Items have to be in before the attachment syncs the selection
+	synthesisModeBox.addItemList(SynthesisMode::getNames(), 1);
+	synthesisModeBoxAttach = std::make_unique<APVTS::ComboBoxAttachment>(apvts, params.at(Names::Synthesis_Mode), synthesisModeBox);
+	voicesSliderAttach = std::make_unique<APVTS::SliderAttachment>(apvts, params.at(Names::Num_Voices), voicesSlider);
+	multicoreButtonAttach = std::make_unique<APVTS::ButtonAttachment>(apvts, params.at(Names::Multicore_Rendering), multicoreButton);
+
 	//Button listeners
 	addPartial.addListener(this);
-	addPartial.setTooltip("Add Partial");
+	addPartial.setTooltip("Add Partial (shift: add 8)");
 	subtractPartial.addListener(this);
-	subtractPartial.setTooltip("Remove Partial");
+	subtractPartial.setTooltip("Remove Partial (shift: remove 8)");
+	loadCycleButton.addListener(this);
+	loadCycleButton.setTooltip("Load a single-cycle WAV or AIFF as the User partial waveform");
 
 	//Customise controls
 	masterGainSlider.setSliderStyle(juce::Slider::LinearHorizontal);
@@ -63,12 +76,39 @@ AdditiveSynth1AudioProcessorEditor::AdditiveSynth1AudioProcessorEditor (Additive
 	resonanceSlider.setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
 	resonanceSlider.setTooltip(params.at(Names::Filter_Resonance));
 	filterBypassButton.setTooltip(params.at(Names::Filter_Bypass));
+	filterAmountSlider.setSliderStyle(juce::Slider::RotaryHorizontalVerticalDrag);
+	filterAmountSlider.setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+	filterAmountSlider.setTooltip(params.at(Names::Filter_Env_Amount));
+	filterAttackSlider.setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+	filterAttackSlider.setTooltip(params.at(Names::Filter_Env_Attack));
+	filterDecaySlider.setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+	filterDecaySlider.setTooltip(params.at(Names::Filter_Env_Decay));
+	filterSustainSlider.setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+	filterSustainSlider.setTooltip(params.at(Names::Filter_Env_Sustain));
+	filterReleaseSlider.setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+	filterReleaseSlider.setTooltip(params.at(Names::Filter_Env_Release));
+	synthesisModeBox.setTooltip(params.at(Names::Synthesis_Mode));
+	voicesSlider.setSliderStyle(juce::Slider::IncDecButtons);
+	voicesSlider.setTextBoxStyle(juce::Slider::TextBoxLeft, false, 40, 20);
+	voicesSlider.setTooltip(params.at(Names::Num_Voices));
+	multicoreButton.setTooltip(params.at(Names::Multicore_Rendering));
+	cullingLabel.setTooltip("Partials rendered / culled above Nyquist / culled below the floor, over all voices");
+	cullingLabel.setJustificationType(juce::Justification::centred);
+	cpuLabel.setTooltip("DSP load / longest block / average render time per voice per block, over the last 100 ms");
+	cpuLabel.setJustificationType(juce::Justification::centred);
+	cpuLabel.setMinimumHorizontalScale(0.7f);
 
 	//Add and make visible
 	addAndMakeVisible(masterGainSlider);
+	addAndMakeVisible(synthesisModeBox);
+	addAndMakeVisible(voicesSlider);
+	addAndMakeVisible(multicoreButton);
+	addAndMakeVisible(cullingLabel);
+	addAndMakeVisible(cpuLabel);
 
 	addAndMakeVisible(addPartial);
 	addAndMakeVisible(subtractPartial);
+	addAndMakeVisible(loadCycleButton);
 
 	addAndMakeVisible(attackSlider);
 	addAndMakeVisible(decaySlider);
@@ -79,45 +119,122 @@ AdditiveSynth1AudioProcessorEditor::AdditiveSynth1AudioProcessorEditor (Additive
 	addAndMakeVisible(resonanceSlider);
 	addAndMakeVisible(filterBypassButton);
 
+	addAndMakeVisible(filterAmountSlider);
+	addAndMakeVisible(filterAttackSlider);
+	addAndMakeVisible(filterDecaySlider);
+	addAndMakeVisible(filterSustainSlider);
+	addAndMakeVisible(filterReleaseSlider);
+
 	//Partials controls
+	partialsViewport.setViewedComponent(&partialsStrip, false);
+	partialsViewport.setScrollBarsShown(false, true);
+	addAndMakeVisible(partialsViewport);
+
 	for (int i = 0; i < MAX_PARTIALS; i++) {
+		auto* spaceSlider = partialSpacesSliders.add(new juce::Slider());
+		auto* volumeSlider = partialVolumesSliders.add(new juce::Slider());
+		auto* bypassButton = partialBypassButtons.add(new juce::ToggleButton());
+		auto* waveformBox = partialWaveformBoxes.add(new juce::ComboBox());
+
+		//Items before the attachment, it selects the current one
+		waveformBox->addItemList(Waveform::getNames(), 1);
+
 		//Attachments
-		partialSpacesSliderAttaches[i] = std::make_unique<APVTS::SliderAttachment>(apvts,
-																					   params.at(Names::Partial_Distance) + juce::String(i+1),
-																					   partialSpacesSliders[i]);
-		partialVolumesSliderAttaches[i] = std::make_unique<APVTS::SliderAttachment>(apvts,
-																					  params.at(Names::Partial_Volume) + juce::String(i+1),
-																					  partialVolumesSliders[i]);
-		partialBypassButtonAttaches[i] = std::make_unique<APVTS::ButtonAttachment>(apvts,
-																					 params.at(Names::Partial_Bypass) + juce::String(i+1),
-																					 partialBypassButtons[i]);
+		partialSpacesSliderAttaches.add(new APVTS::SliderAttachment(apvts,
+																	params.at(Names::Partial_Distance) + juce::String(i+1),
+																	*spaceSlider));
+		partialVolumesSliderAttaches.add(new APVTS::SliderAttachment(apvts,
+																	 params.at(Names::Partial_Volume) + juce::String(i+1),
+																	 *volumeSlider));
+		partialBypassButtonAttaches.add(new APVTS::ButtonAttachment(apvts,
+																	params.at(Names::Partial_Bypass) + juce::String(i+1),
+																	*bypassButton));
+		partialWaveformBoxAttaches.add(new APVTS::ComboBoxAttachment(apvts,
+																	 params.at(Names::Partial_Waveform) + juce::String(i+1),
+																	 *waveformBox));
 
 		//Designs
-		partialSpacesSliders[i].setSliderStyle(juce::Slider::LinearHorizontal);
-		partialSpacesSliders[i].setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
-		partialSpacesSliders[i].setTooltip("Distance from Fundamental");
-		partialVolumesSliders[i].setSliderStyle(juce::Slider::RotaryHorizontalVerticalDrag);
-		partialVolumesSliders[i].setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
-		partialVolumesSliders[i].setTooltip("Partial Volume");
-		partialBypassButtons[i].setTooltip("Mute Partial");
-		
-		//Disable unused partials
-		if (i >= NUM_PARTIALS) {
-			partialSpacesSliders[i].setEnabled(false);
-			partialVolumesSliders[i].setEnabled(false);
-			partialBypassButtons[i].setEnabled(false);
-		}
+		spaceSlider->setSliderStyle(juce::Slider::LinearHorizontal);
+		spaceSlider->setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+		spaceSlider->setTooltip("Distance from Fundamental");
+		volumeSlider->setSliderStyle(juce::Slider::RotaryHorizontalVerticalDrag);
+		volumeSlider->setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+		volumeSlider->setTooltip("Partial Volume");
+		bypassButton->setTooltip("Mute Partial");
+		waveformBox->setTooltip("Partial Waveform");
+
+		partialsStrip.addChildComponent(spaceSlider);
+		partialsStrip.addChildComponent(volumeSlider);
+		partialsStrip.addChildComponent(bypassButton);
+		partialsStrip.addChildComponent(waveformBox);
+	}
+
+	//Modulation matrix
+	for (int i = 0; i < MOD_SLOTS; i++) {
+		auto* sourceBox = modSourceBoxes.add(new juce::ComboBox());
+		auto* destinationBox = modDestinationBoxes.add(new juce::ComboBox());
+		auto* amountSlider = modAmountSliders.add(new juce::Slider());
+
+		sourceBox->addItemList(ModSource::getNames(), 1);
+		destinationBox->addItemList(ModDestination::getNames(), 1);
 
-		//Add, make visible? 
-		addAndMakeVisible(partialSpacesSliders[i]);
-		addAndMakeVisible(partialVolumesSliders[i]);
-		addAndMakeVisible(partialBypassButtons[i]);
+		modSourceBoxAttaches.add(new APVTS::ComboBoxAttachment(apvts, params.at(Names::Mod_Source) + juce::String(i+1), *sourceBox));
+		modDestinationBoxAttaches.add(new APVTS::ComboBoxAttachment(apvts, params.at(Names::Mod_Destination) + juce::String(i+1), *destinationBox));
+		modAmountSliderAttaches.add(new APVTS::SliderAttachment(apvts, params.at(Names::Mod_Amount) + juce::String(i+1), *amountSlider));
+
+		sourceBox->setTooltip(params.at(Names::Mod_Source) + juce::String(i+1));
+		destinationBox->setTooltip(params.at(Names::Mod_Destination) + juce::String(i+1));
+		amountSlider->setSliderStyle(juce::Slider::LinearHorizontal);
+		amountSlider->setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+		amountSlider->setTooltip(params.at(Names::Mod_Amount) + juce::String(i+1));
+
+		addAndMakeVisible(sourceBox);
+		addAndMakeVisible(destinationBox);
+		addAndMakeVisible(amountSlider);
 	}
+
+	for (int i = 0; i < NUM_LFOS; i++) {
+		auto* rateSlider = lfoRateSliders.add(new juce::Slider());
+		auto* shapeBox = lfoShapeBoxes.add(new juce::ComboBox());
+		auto* spreadSlider = lfoSpreadSliders.add(new juce::Slider());
+
+		shapeBox->addItemList(LfoShape::getNames(), 1);
+
+		lfoRateSliderAttaches.add(new APVTS::SliderAttachment(apvts, params.at(Names::Lfo_Rate) + juce::String(i+1), *rateSlider));
+		lfoShapeBoxAttaches.add(new APVTS::ComboBoxAttachment(apvts, params.at(Names::Lfo_Shape) + juce::String(i+1), *shapeBox));
+		lfoSpreadSliderAttaches.add(new APVTS::SliderAttachment(apvts, params.at(Names::Lfo_Spread) + juce::String(i+1), *spreadSlider));
+
+		rateSlider->setSliderStyle(juce::Slider::RotaryHorizontalVerticalDrag);
+		rateSlider->setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+		rateSlider->setTooltip(params.at(Names::Lfo_Rate) + juce::String(i+1));
+		shapeBox->setTooltip(params.at(Names::Lfo_Shape) + juce::String(i+1));
+		spreadSlider->setSliderStyle(juce::Slider::RotaryHorizontalVerticalDrag);
+		spreadSlider->setTextBoxStyle(juce::Slider::NoTextBox, true, 0, 0);
+		spreadSlider->setTooltip(params.at(Names::Lfo_Spread) + juce::String(i+1) + " (phase offset across the partials)");
+
+		addAndMakeVisible(rateSlider);
+		addAndMakeVisible(shapeBox);
+		addAndMakeVisible(spreadSlider);
+	}
+
+	//Disable unused partials, show as many columns as are in use, whatever changes the count. Called on the message thread
+	numPartialsAttach = std::make_unique<juce::ParameterAttachment>(*apvts.getParameter(params.at(Names::Num_Partials)), [this](float value) {
+		currentNumPartials = juce::roundToInt(value);
+		updatePartialControls();
+	});
+	numPartialsAttach->sendInitialUpdate();
+
+	//Whatever queued up while the editor was closed is stale
+	BlockTiming staleTiming;
+	while (p.popBlockTiming(staleTiming)) {}
+
+	startTimerHz(10);
 }
 
 AdditiveSynth1AudioProcessorEditor::~AdditiveSynth1AudioProcessorEditor()
 {
-	numberOfPartials = nullptr;
+	stopTimer();
+	numPartialsAttach.reset();
 }
 
 //==============================================================================
@@ -135,6 +252,7 @@ void AdditiveSynth1AudioProcessorEditor::paint (juce::Graphics& g)
 	auto bounds = getLocalBounds();
 	auto top = bounds.removeFromTop(50);
 	auto middle = bounds.removeFromTop(150);
+	auto modulation = bounds.removeFromBottom(100);
 	auto bottom = bounds;
 
 	auto envelopeBounds = bottom.removeFromLeft(300);
@@ -144,6 +262,7 @@ void AdditiveSynth1AudioProcessorEditor::paint (juce::Graphics& g)
 	g.drawRect(middle, 2);
 	g.drawRect(envelopeBounds, 2);
 	g.drawRect(filterBounds, 2);
+	g.drawRect(modulation, 2);
 
 	auto labelBounds = top.removeFromLeft(200).reduced(10,0);
 	g.drawFittedText("AddiSynth1", labelBounds, juce::Justification::centred, 1);
@@ -158,36 +277,44 @@ void AdditiveSynth1AudioProcessorEditor::resized()
 	auto bounds = getLocalBounds();
 	auto top = bounds.removeFromTop(50);
 	auto middle = bounds.removeFromTop(150);
+	auto modulation = bounds.removeFromBottom(100);
 	auto bottom = bounds;
 
 	//Top: Master gain on right side
 	auto masterGainBounds = top.removeFromRight(100).reduced(2,2);
 	masterGainSlider.setBounds(masterGainBounds);
 
+	//Top: Synthesis mode next to it
+	auto synthesisModeBounds = top.removeFromRight(130).reduced(5, 12);
+	synthesisModeBox.setBounds(synthesisModeBounds);
+
+	//Top: Multicore toggle next to that
+	auto multicoreBounds = top.removeFromRight(90).reduced(5, 12);
+	multicoreButton.setBounds(multicoreBounds);
+
+	//Top: Number of voices
+	auto voicesBounds = top.removeFromRight(100).reduced(5, 12);
+	voicesSlider.setBounds(voicesBounds);
+
+	//Top: CPU meter over the culling stats, in the space left after the title
+	auto statsBounds = top.withTrimmedLeft(200).reduced(5, 2);
+	cpuLabel.setBounds(statsBounds.removeFromTop(statsBounds.getHeight() / 2));
+	cullingLabel.setBounds(statsBounds);
+
 	//Middle: Partials controls - Spacing, Volume, bypass, add/subtract partial
-	//Buttons to add and subtract partials on the right, 
+	//Buttons to add and subtract partials on the right, the user waveform between them
 	auto partialButtonsBounds = middle.removeFromRight(50);
 	auto addPartialBounds = partialButtonsBounds.removeFromTop(50).reduced(10);
 	auto subtractPartialBounds = partialButtonsBounds.removeFromBottom(50).reduced(10);
+	auto loadCycleBounds = partialButtonsBounds.reduced(4, 12);
 
 	addPartial.setBounds(addPartialBounds);
 	subtractPartial.setBounds(subtractPartialBounds);
+	loadCycleButton.setBounds(loadCycleBounds);
 
 	
-	auto partialWidth = middle.getWidth() / (float)MAX_PARTIALS;
-
-
-	for (int i = 0; i < MAX_PARTIALS; i++) {
-		auto partialBounds = middle.removeFromLeft(partialWidth);
-
-		auto partialVolumeBounds = partialBounds.removeFromTop(80);
-		auto patialSpaceBounds = partialBounds.removeFromTop(40);
-		auto partialBypassBounds = partialBounds;
-
-		partialVolumesSliders[i].setBounds(partialVolumeBounds);
-		partialSpacesSliders[i].setBounds(patialSpaceBounds);
-		partialBypassButtons[i].setBounds(partialBypassBounds);
-	}
+	partialsViewport.setBounds(middle);
+	layoutPartialControls();
 
 	//Bottom: Envelop and filter
 	//Envelop controls on left, filter on right
@@ -206,50 +333,184 @@ void AdditiveSynth1AudioProcessorEditor::resized()
 	sustainSlider.setBounds(sustainBounds);
 	releaseSlider.setBounds(releaseBounds);
 
-	auto filterControlsWidth = filterBounds.getWidth() / 3.0f;
+	//Cutoff, resonance, envelope amount and ADSR, bypass
+	auto filterControlsWidth = filterBounds.getWidth() / 8.0f;
 	auto filterCutoffBounds = filterBounds.removeFromLeft(filterControlsWidth);
 	auto filterResonanceBounds = filterBounds.removeFromLeft(filterControlsWidth);
+	auto filterAmountBounds = filterBounds.removeFromLeft(filterControlsWidth);
+	auto filterAttackBounds = filterBounds.removeFromLeft(filterControlsWidth);
+	auto filterDecayBounds = filterBounds.removeFromLeft(filterControlsWidth);
+	auto filterSustainBounds = filterBounds.removeFromLeft(filterControlsWidth);
+	auto filterReleaseBounds = filterBounds.removeFromLeft(filterControlsWidth);
 	auto filterBypassBounds = filterBounds;
 
 	cutoffSlider.setBounds(filterCutoffBounds);
 	resonanceSlider.setBounds(filterResonanceBounds);
+	filterAmountSlider.setBounds(filterAmountBounds);
+	filterAttackSlider.setBounds(filterAttackBounds);
+	filterDecaySlider.setBounds(filterDecayBounds);
+	filterSustainSlider.setBounds(filterSustainBounds);
+	filterReleaseSlider.setBounds(filterReleaseBounds);
 	filterBypassButton.setBounds(filterBypassBounds);
+
+	//Modulation: a column per matrix slot, source over destination over amount, then a column per LFO
+	//setSize in the constructor gets here before the controls exist
+	if (modSourceBoxes.isEmpty() || lfoRateSliders.isEmpty()) return;
+
+	auto modColumnWidth = modulation.getWidth() / (float)(MOD_SLOTS + NUM_LFOS);
+
+	for (int i = 0; i < MOD_SLOTS; i++) {
+		auto slotBounds = modulation.removeFromLeft(modColumnWidth).reduced(4);
+		modSourceBoxes[i]->setBounds(slotBounds.removeFromTop(24).reduced(0, 2));
+		modDestinationBoxes[i]->setBounds(slotBounds.removeFromTop(24).reduced(0, 2));
+		modAmountSliders[i]->setBounds(slotBounds);
+	}
+
+	for (int i = 0; i < NUM_LFOS; i++) {
+		auto lfoBounds = modulation.removeFromLeft(modColumnWidth).reduced(4);
+		lfoShapeBoxes[i]->setBounds(lfoBounds.removeFromTop(24).reduced(0, 2));
+		lfoRateSliders[i]->setBounds(lfoBounds.removeFromLeft(lfoBounds.getWidth() / 2));
+		lfoSpreadSliders[i]->setBounds(lfoBounds);
+	}
 }
 
 void AdditiveSynth1AudioProcessorEditor::buttonClicked(juce::Button* button)
 {
-	using namespace Params;
-	auto params = getParams();
+	const int numPartials = currentNumPartials;
 
-	numberOfPartials = dynamic_cast<juce::AudioParameterInt*>(audioProcessor.apvts.getParameter(params.at(Names::Num_Partials)));
-	int numPartials = numberOfPartials->get();
+	//Shift steps by a whole row of columns, there can be hundreds of partials
+	int step = juce::ModifierKeys::getCurrentModifiers().isShiftDown() ? minPartialColumns : 1;
 
+	//The attachment calls back with the new count, which updates the controls
 	if (button == &addPartial) {
 		if (numPartials < MAX_PARTIALS) {
 			DBG("Add Partial");
-			auto newVal = (float)(++currentNumPartials) / MAX_PARTIALS;
-			DBG(newVal);
-			numberOfPartials->setValueNotifyingHost( newVal);
+			numPartialsAttach->setValueAsCompleteGesture((float)juce::jmin(numPartials + step, MAX_PARTIALS));
 		}
 	}
 	else if (button == &subtractPartial) {
 		if (numPartials > 0) {
 			DBG("Remove Partial");
-			auto newVal = (float)(--currentNumPartials) / MAX_PARTIALS;
-			DBG(newVal);
-			numberOfPartials->setValueNotifyingHost( newVal);
+			numPartialsAttach->setValueAsCompleteGesture((float)juce::jmax(numPartials - step, 0));
 		}
 	}
+	else if (button == &loadCycleButton) {
+		chooseUserWaveform();
+	}
+}
+
+void AdditiveSynth1AudioProcessorEditor::chooseUserWaveform() {
+	juce::AudioFormatManager formats;
+	formats.registerBasicFormats();
 
-	numberOfPartials = nullptr;
+	cycleChooser = std::make_unique<juce::FileChooser>("Load a single cycle for the User waveform", juce::File(), formats.getWildcardForAllFormats());
 
-	updatePartialControls();
+	//Called back on the message thread, not at all if the editor has gone, the chooser goes with it
+	cycleChooser->launchAsync(juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles, [this](const juce::FileChooser& chooser) {
+		auto file = chooser.getResult();
+		if (file.existsAsFile())
+			loadUserWaveform(file);
+	});
+}
+
+void AdditiveSynth1AudioProcessorEditor::loadUserWaveform(const juce::File& file) {
+	juce::AudioFormatManager formats;
+	formats.registerBasicFormats();
+
+	std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+	if (reader == nullptr || reader->lengthInSamples <= 0) {
+		DBG("Not an audio file the User waveform can load: " << file.getFullPathName());
+		return;
+	}
+
+	//The first channel, the processor stretches it to a table whatever its length
+	const int length = (int)juce::jmin(reader->lengthInSamples, (juce::int64)USER_WAVEFORM_MAX_SAMPLES);
+	juce::AudioBuffer<float> buffer(1, length);
+	reader->read(&buffer, 0, length, 0, true, false);
+
+	audioProcessor.setUserWaveform(juce::Array<float>(buffer.getReadPointer(0), length));
 }
 
 void AdditiveSynth1AudioProcessorEditor::updatePartialControls() {
+	int numColumns = juce::jmax(currentNumPartials, minPartialColumns);
+
 	for (int i = 0; i < MAX_PARTIALS; i++) {
-		partialSpacesSliders[i].setEnabled(i>=currentNumPartials ? false : true);
-		partialVolumesSliders[i].setEnabled(i >= currentNumPartials ? false : true);
-		partialBypassButtons[i].setEnabled(i >= currentNumPartials ? false : true);
+		bool inUse = i < currentNumPartials;
+		bool shown = i < numColumns;
+
+		partialSpacesSliders[i]->setEnabled(inUse);
+		partialVolumesSliders[i]->setEnabled(inUse);
+		partialBypassButtons[i]->setEnabled(inUse);
+		partialWaveformBoxes[i]->setEnabled(inUse);
+
+		partialSpacesSliders[i]->setVisible(shown);
+		partialVolumesSliders[i]->setVisible(shown);
+		partialBypassButtons[i]->setVisible(shown);
+		partialWaveformBoxes[i]->setVisible(shown);
 	}
+
+	layoutPartialControls();
+}
+
+void AdditiveSynth1AudioProcessorEditor::layoutPartialControls() {
+	//setSize in the constructor gets here before the controls exist
+	if (partialSpacesSliders.isEmpty()) return;
+
+	int numColumns = juce::jmax(currentNumPartials, minPartialColumns);
+
+	//Fill the view when everything fits, scroll sideways when it doesn't
+	int viewWidth = partialsViewport.getWidth();
+	int columnWidth = juce::jmax(partialColumnWidth, viewWidth / numColumns);
+	int stripHeight = partialsViewport.getHeight() - partialsViewport.getScrollBarThickness();
+
+	partialsStrip.setSize(columnWidth * numColumns, juce::jmax(stripHeight, 0));
+
+	auto strip = partialsStrip.getLocalBounds();
+
+	for (int i = 0; i < numColumns; i++) {
+		auto partialBounds = strip.removeFromLeft(columnWidth);
+
+		auto partialVolumeBounds = partialBounds.removeFromTop(80);
+		auto patialSpaceBounds = partialBounds.removeFromTop(40);
+		auto partialWaveformBounds = partialBounds.removeFromTop(24).reduced(2);
+		auto partialBypassBounds = partialBounds;
+
+		partialVolumesSliders[i]->setBounds(partialVolumeBounds);
+		partialSpacesSliders[i]->setBounds(patialSpaceBounds);
+		partialWaveformBoxes[i]->setBounds(partialWaveformBounds);
+		partialBypassButtons[i]->setBounds(partialBypassBounds);
+	}
+}
+
+void AdditiveSynth1AudioProcessorEditor::timerCallback() {
+	auto stats = audioProcessor.getCullingStats();
+	cullingLabel.setText(juce::String(stats.rendered) + " / " + juce::String(stats.culledAboveNyquist) + " / " + juce::String(stats.culledBelowFloor),
+						 juce::dontSendNotification);
+
+	updateCpuMeter();
+}
+
+void AdditiveSynth1AudioProcessorEditor::updateCpuMeter() {
+	double processSeconds = 0.0, audioSeconds = 0.0, peakSeconds = 0.0, voiceSeconds = 0.0;
+	int voiceBlocks = 0;
+
+	//Everything since the last tick, the processor keeps queueing while nobody reads
+	BlockTiming timing;
+	while (audioProcessor.popBlockTiming(timing)) {
+		processSeconds += timing.blockSeconds;
+		if (timing.sampleRate > 0.0)
+			audioSeconds += timing.numSamples / timing.sampleRate;
+		peakSeconds = juce::jmax(peakSeconds, timing.blockSeconds);
+		voiceSeconds += timing.voiceSeconds;
+		voiceBlocks += timing.activeVoices;
+	}
+
+	//No audio since the last tick, keep showing the last figures
+	if (audioSeconds <= 0.0) return;
+
+	auto load = juce::String(100.0 * processSeconds / audioSeconds, 1) + "%";
+	auto peak = juce::String(1000.0 * peakSeconds, 2) + " ms";
+	auto perVoice = voiceBlocks > 0 ? juce::String(1.0e6 * voiceSeconds / voiceBlocks, 0) + " us" : juce::String("-");
+
+	cpuLabel.setText(load + " / " + peak + " / " + perVoice, juce::dontSendNotification);
 }
@@ -11,12 +11,10 @@
 #include <JuceHeader.h>
 #include "PluginProcessor.h"
 
-#include <array>
-
 //==============================================================================
 /**
 */
-class AdditiveSynth1AudioProcessorEditor  : public juce::AudioProcessorEditor, juce::Button::Listener
+class AdditiveSynth1AudioProcessorEditor  : public juce::AudioProcessorEditor, juce::Button::Listener, juce::Timer
 {
 public:
     AdditiveSynth1AudioProcessorEditor (AdditiveSynth1AudioProcessor&);
@@ -31,21 +29,41 @@ private:
     // access the processor object that created it.
     AdditiveSynth1AudioProcessor& audioProcessor;
 
-	juce::AudioParameterInt* numberOfPartials{ nullptr };
+	//Keeps currentNumPartials on "Number of Partials", including host automation and state loads
+	std::unique_ptr<juce::ParameterAttachment> numPartialsAttach;
 	int currentNumPartials = NUM_PARTIALS;
 
 	//Master gain
 	juce::Slider masterGainSlider;
 	std::unique_ptr<APVTS::SliderAttachment> masterGainSliderAttachment;
 
-	//Partial controls
-	std::array<juce::Slider, MAX_PARTIALS> partialSpacesSliders;
-	std::array<juce::Slider, MAX_PARTIALS> partialVolumesSliders;
-	std::array<juce::ToggleButton, MAX_PARTIALS> partialBypassButtons;
+	//Synthesis engine
+	juce::ComboBox synthesisModeBox;
+	std::unique_ptr<APVTS::ComboBoxAttachment> synthesisModeBoxAttach;
+
+	//Polyphony
+	juce::Slider voicesSlider;
+	std::unique_ptr<APVTS::SliderAttachment> voicesSliderAttach;
+
+	juce::ToggleButton multicoreButton{ "Multicore" };
+	std::unique_ptr<APVTS::ButtonAttachment> multicoreButtonAttach;
+
+	//Partial controls, one column per partial in a horizontally scrolling strip
+	static constexpr int partialColumnWidth = 68;
+	static constexpr int minPartialColumns = 8;
 
-	std::array<std::unique_ptr<APVTS::SliderAttachment>, MAX_PARTIALS> partialSpacesSliderAttaches;
-	std::array<std::unique_ptr<APVTS::SliderAttachment>, MAX_PARTIALS> partialVolumesSliderAttaches;
-	std::array<std::unique_ptr<APVTS::ButtonAttachment>, MAX_PARTIALS> partialBypassButtonAttaches;
+	juce::Viewport partialsViewport;
+	juce::Component partialsStrip;
+
+	juce::OwnedArray<juce::Slider> partialSpacesSliders;
+	juce::OwnedArray<juce::Slider> partialVolumesSliders;
+	juce::OwnedArray<juce::ToggleButton> partialBypassButtons;
+	juce::OwnedArray<juce::ComboBox> partialWaveformBoxes;
+
+	juce::OwnedArray<APVTS::SliderAttachment> partialSpacesSliderAttaches;
+	juce::OwnedArray<APVTS::SliderAttachment> partialVolumesSliderAttaches;
+	juce::OwnedArray<APVTS::ButtonAttachment> partialBypassButtonAttaches;
+	juce::OwnedArray<APVTS::ComboBoxAttachment> partialWaveformBoxAttaches;
 
 	//Envelope Sliders
 	juce::Slider attackSlider;
@@ -67,14 +85,59 @@ private:
 	std::unique_ptr<APVTS::SliderAttachment> resonanceSliderAttach;
 	std::unique_ptr<APVTS::ButtonAttachment> filterBypassButtonAttach;
 
+	//Filter envelope, per voice
+	juce::Slider filterAmountSlider;
+	juce::Slider filterAttackSlider;
+	juce::Slider filterDecaySlider;
+	juce::Slider filterSustainSlider;
+	juce::Slider filterReleaseSlider;
+
+	std::unique_ptr<APVTS::SliderAttachment> filterAmountSliderAttach;
+	std::unique_ptr<APVTS::SliderAttachment> filterAttackSliderAttach;
+	std::unique_ptr<APVTS::SliderAttachment> filterDecaySliderAttach;
+	std::unique_ptr<APVTS::SliderAttachment> filterSustainSliderAttach;
+	std::unique_ptr<APVTS::SliderAttachment> filterReleaseSliderAttach;
+
+	//Modulation matrix slots, and the LFOs they can read
+	juce::OwnedArray<juce::ComboBox> modSourceBoxes;
+	juce::OwnedArray<juce::ComboBox> modDestinationBoxes;
+	juce::OwnedArray<juce::Slider> modAmountSliders;
+
+	juce::OwnedArray<APVTS::ComboBoxAttachment> modSourceBoxAttaches;
+	juce::OwnedArray<APVTS::ComboBoxAttachment> modDestinationBoxAttaches;
+	juce::OwnedArray<APVTS::SliderAttachment> modAmountSliderAttaches;
+
+	juce::OwnedArray<juce::Slider> lfoRateSliders;
+	juce::OwnedArray<juce::ComboBox> lfoShapeBoxes;
+	juce::OwnedArray<juce::Slider> lfoSpreadSliders;
+
+	juce::OwnedArray<APVTS::SliderAttachment> lfoRateSliderAttaches;
+	juce::OwnedArray<APVTS::ComboBoxAttachment> lfoShapeBoxAttaches;
+	juce::OwnedArray<APVTS::SliderAttachment> lfoSpreadSliderAttaches;
+
 	//Partial buttons
 	juce::ArrowButton addPartial;
 	juce::ArrowButton subtractPartial;
 
+	//Loads a single-cycle audio file as the "User" partial waveform. The chooser is kept while it's open
+	juce::TextButton loadCycleButton{ "User" };
+	std::unique_ptr<juce::FileChooser> cycleChooser;
+	void chooseUserWaveform();
+	void loadUserWaveform(const juce::File& file);
+
+	//Partial culling statistics
+	juce::Label cullingLabel;
+
+	//DSP load, peak block time and cost per voice, from the processor's block timings
+	juce::Label cpuLabel;
+	void updateCpuMeter();
+
 	juce::TooltipWindow tooltip{ this };
 
 	void buttonClicked(juce::Button*) override;
+	void timerCallback() override;
 	void updatePartialControls();
+	void layoutPartialControls();
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (AdditiveSynth1AudioProcessorEditor)
 
@@ -11,6 +11,7 @@
 
 #include "dsp/SynthSound.h"
 #include "dsp/SynthVoice.h"
+#include "debug/RealtimeChecker.h"
 
 //==============================================================================
 AdditiveSynth1AudioProcessor::AdditiveSynth1AudioProcessor()
@@ -26,34 +27,33 @@ AdditiveSynth1AudioProcessor::AdditiveSynth1AudioProcessor()
 #endif
 	, apvts(*this, nullptr, "PARAMETERS", getLayout())
 {
-	synth.clearSounds();
-	synth.addSound(new SynthSound());
+	synthSound = new SynthSound();
+	synth.setSound(synthSound);
+	doubleSynth.setSound(synthSound);
 
-	synth.clearVoices();
-	for (int i = 0; i < NUM_VOICES; i++)
-		synth.addVoice(new SynthVoice());
+	//Connect param references, the voices only ever see the snapshot
+	parameters.initialise(apvts);
+	addVoices(synth);
 
-	for (int i = 0; i < synth.getNumVoices(); i++)
-		dynamic_cast<SynthVoice*>(synth.getVoice(i))->initialise(apvts);
+	apvts.addParameterListener(Params::getParams().at(Params::Names::Multicore_Rendering), this);
 
-	using namespace Params;
-	auto params = getParams();
-	using APFloat = juce::AudioParameterFloat;
-	using APBool = juce::AudioParameterBool;
-
-	//Connect param references
-	masterGain = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Master_Gain)));
-	filterCutoff = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Filter_Cutoff)));
-	filterResonance = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Filter_Resonance)));
-	filterBypass = dynamic_cast<APBool*>(apvts.getParameter(params.at(Names::Filter_Bypass)));
+	DBG("Audio Processor Constructed");
+}
 
-	filter.setType(juce::dsp::StateVariableTPTFilterType::lowpass);
+template <typename SampleType>
+void AdditiveSynth1AudioProcessor::addVoices(AdditiveSynthesiser<SampleType>& target)
+{
+	//Every voice is made up front, "Number of Voices" only limits how many get notes
+	for (int i = 0; i < MAX_VOICES; i++)
+		target.addSynthVoice(new SynthVoice<SampleType>());
 
-	DBG("Audio Processor Constructed");
+	target.initialise(parameters);
 }
 
 AdditiveSynth1AudioProcessor::~AdditiveSynth1AudioProcessor()
 {
+	apvts.removeParameterListener(Params::getParams().at(Params::Names::Multicore_Rendering), this);
+	cancelPendingUpdate();
 }
 
 //==============================================================================
@@ -91,7 +91,26 @@ bool AdditiveSynth1AudioProcessor::isMidiEffect() const
 
 double AdditiveSynth1AudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+	using namespace Params;
+	const auto& params = getParams();
+
+	//A voice lasts for its release, as the envelope gets it from ParameterSnapshot, then until its
+	//filter has rung down to FILTER_TAIL_THRESHOLD
+	double tail = apvts.getRawParameterValue(params.at(Names::Envelope_Release))->load() + ENVELOPE_TIME_OFFSET;
+
+	if (apvts.getRawParameterValue(params.at(Names::Filter_Bypass))->load() < 0.5f) {
+		//Decays at pi * fc / Q per second. Modulation can take the cutoff right down, so take the lowest
+		const double q = juce::jmax(apvts.getRawParameterValue(params.at(Names::Filter_Resonance))->load(), 0.001f);
+		const double decayRate = juce::MathConstants<double>::pi * FILTER_CUTOFF_MIN / q;
+		tail += -std::log(FILTER_TAIL_THRESHOLD) / decayRate;
+	}
+
+	//The inverse FFT's output comes out late
+	const double sampleRate = getSampleRate();
+	if (sampleRate > 0.0 && juce::roundToInt(apvts.getRawParameterValue(params.at(Names::Synthesis_Mode))->load()) == SynthesisMode::Inverse_FFT)
+		tail += SpectralSynth::hopSize / sampleRate;
+
+	return tail;
 }
 
 int AdditiveSynth1AudioProcessor::getNumPrograms()
@@ -123,23 +142,33 @@ void AdditiveSynth1AudioProcessor::prepareToPlay (double sampleRate, int samples
 {
     // Use this method as the place to do any pre-playback
     // initialisation that you need..
-	synth.setCurrentPlaybackSampleRate(sampleRate);
-
 	juce::dsp::ProcessSpec spec;
 	spec.sampleRate = sampleRate;
 	spec.maximumBlockSize = samplesPerBlock;
 	spec.numChannels = getNumOutputChannels();
 
-	//Prepare the gain
+	//Prepare the gain, the host may switch precision before the next prepareToPlay
 	gain.prepare(spec);
-	gain.setRampDurationSeconds(0.005);
-
-	//Prepare the filter
-	filter.prepare(spec);
+	gain.setRampDurationSeconds(MASTER_GAIN_RAMP_SECONDS);
+	doubleGain.prepare(spec);
+	doubleGain.setRampDurationSeconds(MASTER_GAIN_RAMP_SECONDS);
+
+	//Prepare all the voices and their filters in the host's precision, and start the render threads if
+	//multicore is already on. The other synth's threads aren't needed
+	doublePrecision.store(isUsingDoublePrecision());
+	if (doublePrecision.load()) {
+		if (doubleSynth.getSynthVoices().isEmpty())
+			addVoices(doubleSynth);
+
+		synth.releaseResources();
+		doubleSynth.prepareToPlay(spec);
+	}
+	else {
+		doubleSynth.releaseResources();
+		synth.prepareToPlay(spec);
+	}
 
-	//Prepare all the voices
-	for (int i = 0; i < synth.getNumVoices(); i++)
-		dynamic_cast<SynthVoice*>(synth.getVoice(i))->prepareToPlay(spec);
+	updateRenderPool();
 
 	DBG("Audio Processor is prepared to play");
 }
@@ -148,6 +177,8 @@ void AdditiveSynth1AudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+	synth.releaseResources();
+	doubleSynth.releaseResources();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -178,6 +209,24 @@ bool AdditiveSynth1AudioProcessor::isBusesLayoutSupported (const BusesLayout& la
 
 void AdditiveSynth1AudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+	processSamples(buffer, midiMessages);
+}
+
+void AdditiveSynth1AudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+	processSamples(buffer, midiMessages);
+}
+
+bool AdditiveSynth1AudioProcessor::supportsDoublePrecisionProcessing() const
+{
+	return true;
+}
+
+template <typename SampleType>
+void AdditiveSynth1AudioProcessor::processSamples (juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages)
+{
+    REALTIME_SECTION
+    auto startTicks = juce::Time::getHighResolutionTicks();
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -197,17 +246,108 @@ void AdditiveSynth1AudioProcessor::processBlock (juce::AudioBuffer<float>& buffe
     // the samples and the outer loop is handling the channels.
     // Alternatively, you can process the samples with the channels
     // interleaved by keeping the same state.
-	gain.setGainLinear(masterGain->get());
-	filter.setCutoffFrequency(filterCutoff->get());
-	filter.setResonance(filterResonance->get());
+	//Every parameter read for this block, voices only look at what changed
+	parameters.update();
+
+	//Wavetables finished since the last block become visible to the voices, and new partials get baked
+	synthSound->beginBlock(parameters);
+
+	const int numSamples = buffer.getNumSamples();
+	auto& outputGain = getGain<SampleType>();
+	auto& synth = getSynth<SampleType>();
+
+	//No voice sounding, no filter ringing and no note coming in, so the block is silence. Parameters still
+	//land where they were going and the gain stops ramping, so nothing jumps when a note does come
+	if (midiMessages.isEmpty() && synth.isIdle()) {
+		buffer.clear();
+		parameters.setBlockPosition(1.0f);
+		outputGain.setGainLinear(parameters.getMasterGain());
+		outputGain.reset();
+		synth.skipIdleBlock(numSamples);
+
+		updateCullingStats<SampleType>();
+		pushBlockTiming<SampleType>(startTicks, numSamples);
+		return;
+	}
+
+	//Automation moved since the last block, so render in steps along the way. Otherwise the whole block in one go
+	const int stepSamples = parameters.isInterpolating() ? AUTOMATION_STEP_SAMPLES : numSamples;
+
+	for (int start = 0; start < numSamples; start += stepSamples) {
+		const int length = juce::jmin(stepSamples, numSamples - start);
+		parameters.setBlockPosition((float)(start + length) / (float)numSamples);
+
+		//Ramps from where it was. The filter is per voice, the synth picks up its parameters
+		outputGain.setGainLinear(parameters.getMasterGain());
 
-	synth.renderNextBlock(buffer, midiMessages, 0, buffer.getNumSamples());
+		//Plays the step's own events, on their sample
+		synth.renderNextBlock(buffer, midiMessages, start, length);
 
-	juce::dsp::AudioBlock<float> block{ buffer };
-	auto ctx = juce::dsp::ProcessContextReplacing{ block };
+		auto block = juce::dsp::AudioBlock<SampleType>{ buffer }.getSubBlock((size_t)start, (size_t)length);
+		auto ctx = juce::dsp::ProcessContextReplacing{ block };
 
-	gain.process(ctx);
-	if(!filterBypass->get()) filter.process(ctx);
+		outputGain.process(ctx);
+	}
+
+	updateCullingStats<SampleType>();
+	pushBlockTiming<SampleType>(startTicks, buffer.getNumSamples());
+}
+
+template <typename SampleType>
+void AdditiveSynth1AudioProcessor::pushBlockTiming(juce::int64 startTicks, int numSamples) {
+	auto& synth = getSynth<SampleType>();
+
+	BlockTiming timing;
+	timing.blockSeconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+	timing.voiceSeconds = juce::Time::highResolutionTicksToSeconds(synth.takeVoiceRenderTicks());
+	timing.sampleRate = getSampleRate();
+	timing.numSamples = numSamples;
+	timing.activeVoices = synth.getActiveVoices().size();
+	timing.renderedPartials = partialsRendered.load(std::memory_order_relaxed);
+
+	blockTimings.push(timing);
+}
+
+template <typename SampleType>
+void AdditiveSynth1AudioProcessor::updateCullingStats() {
+	CullingStats total;
+	for (auto* voice : getSynth<SampleType>().getActiveVoices()) {
+		auto stats = voice->getCullingStats();
+		total.rendered += stats.rendered;
+		total.culledAboveNyquist += stats.culledAboveNyquist;
+		total.culledBelowFloor += stats.culledBelowFloor;
+	}
+
+	partialsRendered.store(total.rendered, std::memory_order_relaxed);
+	partialsCulledAboveNyquist.store(total.culledAboveNyquist, std::memory_order_relaxed);
+	partialsCulledBelowFloor.store(total.culledBelowFloor, std::memory_order_relaxed);
+}
+
+void AdditiveSynth1AudioProcessor::parameterChanged(const juce::String& parameterID, float newValue) {
+	//Turning it off leaves the threads asleep until releaseResources, the audio thread may be using them
+	if (newValue >= 0.5f)
+		triggerAsyncUpdate();
+}
+
+void AdditiveSynth1AudioProcessor::handleAsyncUpdate() {
+	updateRenderPool();
+}
+
+void AdditiveSynth1AudioProcessor::updateRenderPool() {
+	if (apvts.getRawParameterValue(Params::getParams().at(Params::Names::Multicore_Rendering))->load() < 0.5f) return;
+
+	if (doublePrecision.load())
+		doubleSynth.startRenderPool();
+	else
+		synth.startRenderPool();
+}
+
+CullingStats AdditiveSynth1AudioProcessor::getCullingStats() const {
+	CullingStats stats;
+	stats.rendered = partialsRendered.load(std::memory_order_relaxed);
+	stats.culledAboveNyquist = partialsCulledAboveNyquist.load(std::memory_order_relaxed);
+	stats.culledBelowFloor = partialsCulledBelowFloor.load(std::memory_order_relaxed);
+	return stats;
 }
 
 //==============================================================================
@@ -242,9 +382,24 @@ void AdditiveSynth1AudioProcessor::setStateInformation (const void* data, int si
 	auto tree = juce::ValueTree::readFromData(data, sizeInBytes);
 	if (tree.isValid()) {
 		apvts.replaceState(tree);
+		rebuildUserWaveform();
 	}
 }
 
+void AdditiveSynth1AudioProcessor::setUserWaveform(const juce::Array<float>& cycle) {
+	//Kept in the state so it is saved with the session
+	apvts.state.setProperty(USER_WAVEFORM_PROPERTY, juce::var(cycle.begin(), sizeof(float) * (size_t)cycle.size()), nullptr);
+	rebuildUserWaveform();
+}
+
+void AdditiveSynth1AudioProcessor::rebuildUserWaveform() {
+	//User partials read the sine until a waveform has been loaded
+	auto* cycle = apvts.state.getProperty(USER_WAVEFORM_PROPERTY).getBinaryData();
+	if (cycle == nullptr || cycle->getSize() < sizeof(float)) return;
+
+	synthSound->setUserWaveform(static_cast<const float*>(cycle->getData()), (int)(cycle->getSize() / sizeof(float)));
+}
+
 //==============================================================================
 // This creates new instances of the plugin..
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
@@ -263,7 +418,7 @@ APVTS::ParameterLayout AdditiveSynth1AudioProcessor::getLayout() {
 
 	juce::NormalisableRange partialVolumeRange{ PARTIAL_VOLUME_MIN, PARTIAL_VOLUME_MAX, PARTIAL_VOLUME_STEP };
 
-	for (int i = 0; i < MAX_PARTIALS; i++) {
+	auto addPartial = [&](int i) {
 		layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Partial_Distance) + juce::String(i+1), 
 															   params.at(Names::Partial_Distance) + juce::String(i+1),
 															   //Frequency being determined from previous frequency
@@ -276,7 +431,13 @@ APVTS::ParameterLayout AdditiveSynth1AudioProcessor::getLayout() {
 		layout.add(std::make_unique<juce::AudioParameterBool>(params.at(Names::Partial_Bypass) + juce::String(i+1), 
 															  params.at(Names::Partial_Bypass) + juce::String(i+1), 
 															  PARTIAL_BYPASS_DEF));
-	}
+	};
+
+	//Hosts that automate by parameter index (VST2, AU) keep the index in their sessions, and the index is
+	//the order parameters are added in. So the original layout comes first, as it was: the gain, the first
+	//LEGACY_MAX_PARTIALS partials, the envelope, the filter and the partial count. Everything since goes after
+	for (int i = 0; i < LEGACY_MAX_PARTIALS; i++)
+		addPartial(i);
 
 	//Envelope params
 	layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Envelope_Attack), 
@@ -303,11 +464,89 @@ APVTS::ParameterLayout AdditiveSynth1AudioProcessor::getLayout() {
 														  params.at(Filter_Bypass),
 														  false));
 
-	//Number of voices and partials. 
+	//Number of partials
 	layout.add(std::make_unique<juce::AudioParameterInt>(params.at(Names::Num_Partials),
 														 params.at(Names::Num_Partials),
 														 0, MAX_PARTIALS, NUM_PARTIALS));
-	
+	//Added since the original layout, see above
+	for (int i = LEGACY_MAX_PARTIALS; i < MAX_PARTIALS; i++)
+		addPartial(i);
+
+	for (int i = 0; i < MAX_PARTIALS; i++)
+		layout.add(std::make_unique<juce::AudioParameterChoice>(params.at(Names::Partial_Waveform) + juce::String(i+1),
+																params.at(Names::Partial_Waveform) + juce::String(i+1),
+																Waveform::getNames(), PARTIAL_WAVEFORM_DEF));
+
+	//Filter envelope, per voice
+	layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Filter_Env_Amount),
+														   params.at(Names::Filter_Env_Amount),
+														   juce::NormalisableRange(FILTER_ENV_AMOUNT_MIN, FILTER_ENV_AMOUNT_MAX, FILTER_ENV_AMOUNT_STEP), FILTER_ENV_AMOUNT_DEF));
+	layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Filter_Env_Attack),
+														   params.at(Names::Filter_Env_Attack),
+														   juce::NormalisableRange(ATTACK_MIN, ATTACK_MAX, ATTACK_STEP), FILTER_ATTACK_DEF));
+	layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Filter_Env_Decay),
+														   params.at(Names::Filter_Env_Decay),
+														   juce::NormalisableRange(DECAY_MIN, DECAY_MAX, DECAY_STEP), FILTER_DECAY_DEF));
+	layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Filter_Env_Sustain),
+														   params.at(Names::Filter_Env_Sustain),
+														   juce::NormalisableRange(SUSTAIN_MIN, SUSTAIN_MAX, SUSTAIN_STEP), FILTER_SUSTAIN_DEF));
+	layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Filter_Env_Release),
+														   params.at(Names::Filter_Env_Release),
+														   juce::NormalisableRange(RELEASE_MIN, RELEASE_MAX, RELEASE_STEP), FILTER_RELEASE_DEF));
+
+	//Number of voices
+	layout.add(std::make_unique<juce::AudioParameterInt>(params.at(Names::Num_Voices),
+														 params.at(Names::Num_Voices),
+														 1, MAX_VOICES, NUM_VOICES));
+
+	//Oscillator bank or inverse FFT, see SpectralSynth
+	layout.add(std::make_unique<juce::AudioParameterChoice>(params.at(Names::Synthesis_Mode),
+															params.at(Names::Synthesis_Mode),
+															SynthesisMode::getNames(), SYNTHESIS_MODE_DEF));
+
+	//Partial culling
+	layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Cull_Nyquist),
+														   params.at(Names::Cull_Nyquist),
+														   juce::NormalisableRange(CULL_NYQUIST_MIN, CULL_NYQUIST_MAX, CULL_NYQUIST_STEP), CULL_NYQUIST_DEF));
+	layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Cull_Floor),
+														   params.at(Names::Cull_Floor),
+														   juce::NormalisableRange(CULL_FLOOR_MIN, CULL_FLOOR_MAX, CULL_FLOOR_STEP), CULL_FLOOR_DEF));
+
+	//Render voices on several cores, see AdditiveSynthesiser
+	layout.add(std::make_unique<juce::AudioParameterBool>(params.at(Names::Multicore_Rendering),
+														  params.at(Names::Multicore_Rendering),
+														  MULTICORE_DEF));
+
+	//Modulation matrix, see ModMatrix. The first slot starts as the usual pitch bend
+	for (int i = 0; i < MOD_SLOTS; i++) {
+		const bool pitchBend = i == 0;
+		layout.add(std::make_unique<juce::AudioParameterChoice>(params.at(Names::Mod_Source) + juce::String(i+1),
+																params.at(Names::Mod_Source) + juce::String(i+1),
+																ModSource::getNames(), pitchBend ? ModSource::Pitch_Wheel : ModSource::None));
+		layout.add(std::make_unique<juce::AudioParameterChoice>(params.at(Names::Mod_Destination) + juce::String(i+1),
+																params.at(Names::Mod_Destination) + juce::String(i+1),
+																ModDestination::getNames(), pitchBend ? ModDestination::Pitch : ModDestination::None));
+		layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Mod_Amount) + juce::String(i+1),
+															   params.at(Names::Mod_Amount) + juce::String(i+1),
+															   juce::NormalisableRange(MOD_AMOUNT_MIN, MOD_AMOUNT_MAX, MOD_AMOUNT_STEP), pitchBend ? MOD_AMOUNT_MAX : MOD_AMOUNT_DEF));
+	}
+
+	for (int i = 0; i < NUM_LFOS; i++) {
+		//Skewed so the slow rates get most of the travel
+		juce::NormalisableRange lfoRateRange{ LFO_RATE_MIN, LFO_RATE_MAX, LFO_RATE_STEP };
+		lfoRateRange.setSkewForCentre(LFO_RATE_DEF);
+
+		layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Lfo_Rate) + juce::String(i+1),
+															   params.at(Names::Lfo_Rate) + juce::String(i+1),
+															   lfoRateRange, LFO_RATE_DEF));
+		layout.add(std::make_unique<juce::AudioParameterChoice>(params.at(Names::Lfo_Shape) + juce::String(i+1),
+																params.at(Names::Lfo_Shape) + juce::String(i+1),
+																LfoShape::getNames(), LfoShape::Sine));
+		layout.add(std::make_unique<juce::AudioParameterFloat>(params.at(Names::Lfo_Spread) + juce::String(i+1),
+															   params.at(Names::Lfo_Spread) + juce::String(i+1),
+															   juce::NormalisableRange(LFO_SPREAD_MIN, LFO_SPREAD_MAX, LFO_SPREAD_STEP), LFO_SPREAD_DEF));
+	}
+
 
 	DBG("Parameter layout created");
 	return layout;
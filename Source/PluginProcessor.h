@@ -10,11 +10,26 @@
 
 #include <JuceHeader.h>
 #include "GlobalDefines.h"
+#include "dsp/AdditiveSynthesiser.h"
+#include "dsp/ParameterSnapshot.h"
+#include "dsp/SynthSound.h"
+#include "dsp/LockFreeFifo.h"
+
+//Cost of one processBlock call, see AdditiveSynth1AudioProcessor::popBlockTiming
+struct BlockTiming {
+	double blockSeconds = 0.0;
+	//Summed over voices, and over threads when rendering on several cores
+	double voiceSeconds = 0.0;
+	double sampleRate = 0.0;
+	int numSamples = 0;
+	int activeVoices = 0;
+	int renderedPartials = 0;
+};
 
 //==============================================================================
 /**
 */
-class AdditiveSynth1AudioProcessor  : public juce::AudioProcessor
+class AdditiveSynth1AudioProcessor  : public juce::AudioProcessor, APVTS::Listener, juce::AsyncUpdater
 {
 public:
     //==============================================================================
@@ -30,6 +45,9 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    //Renders in double from the envelopes on, see SynthVoice, into the host's buffers as they are
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -56,15 +74,68 @@ public:
 
 	APVTS apvts;
 
-private:
-	juce::AudioParameterFloat* masterGain{ nullptr };
-	juce::AudioParameterFloat* filterCutoff{ nullptr };
-	juce::AudioParameterFloat* filterResonance{ nullptr };
-	juce::AudioParameterBool* filterBypass{ nullptr };
+	//Partials rendered and culled over all voices in the last block. Safe from any thread
+	CullingStats getCullingStats() const;
+
+	//One cycle of the "User" partial waveform, any length. Message thread, saved with the state
+	void setUserWaveform(const juce::Array<float>& cycle);
 
-	juce::Synthesiser synth;
+	//Takes the oldest block timing not read yet. Message thread only, one reader at a time
+	bool popBlockTiming(BlockTiming& timing) { return blockTimings.pop(timing); }
+
+private:
+	//Read once at the top of every block. Declared before the synth, whose voices point at it
+	ParameterSnapshot parameters;
+
+	//One per precision. The double one only gets its voices the first time the host asks for double
+	AdditiveSynthesiser<float> synth;
+	AdditiveSynthesiser<double> doubleSynth;
+	std::atomic<bool> doublePrecision{ false };
+
+	template <typename SampleType>
+	AdditiveSynthesiser<SampleType>& getSynth() noexcept {
+		if constexpr (std::is_same_v<SampleType, double>) return doubleSynth;
+		else return synth;
+	}
+
+	template <typename SampleType>
+	void addVoices(AdditiveSynthesiser<SampleType>& target);
+
+	//Owned by the synths
+	SynthSound* synthSound{ nullptr };
+	void rebuildUserWaveform();
+
+	std::atomic<int> partialsRendered{ 0 };
+	std::atomic<int> partialsCulledAboveNyquist{ 0 };
+	std::atomic<int> partialsCulledBelowFloor{ 0 };
+
+	template <typename SampleType>
+	void updateCullingStats();
+
+	//The render threads start on the message thread once multicore rendering is on, however it was
+	//turned on. parameterChanged can come from any thread, so it only asks for the update
+	void parameterChanged(const juce::String& parameterID, float newValue) override;
+	void handleAsyncUpdate() override;
+	void updateRenderPool();
+
+	//Written by the audio thread, a full fifo drops the newest timing
+	LockFreeFifo<BlockTiming, 1024> blockTimings;
+	template <typename SampleType>
+	void pushBlockTiming(juce::int64 startTicks, int numSamples);
+
+	//Both processBlocks, with the synth and the gain for the host's precision
+	template <typename SampleType>
+	void processSamples(juce::AudioBuffer<SampleType>& buffer, juce::MidiBuffer& midiMessages);
+
+	//One per precision, only the one for the host's runs
 	juce::dsp::Gain<float> gain;
-	juce::dsp::StateVariableTPTFilter<float> filter;
+	juce::dsp::Gain<double> doubleGain;
+
+	template <typename SampleType>
+	juce::dsp::Gain<SampleType>& getGain() noexcept {
+		if constexpr (std::is_same_v<SampleType, double>) return doubleGain;
+		else return gain;
+	}
 
 	APVTS::ParameterLayout getLayout();
     //==============================================================================
@@ -0,0 +1,164 @@
+/*
+  ==============================================================================
+
+    RealtimeChecker.cpp
+
+  ==============================================================================
+*/
+
+#include "RealtimeChecker.h"
+
+#if ADDSYNTH_REALTIME_CHECKS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if JUCE_LINUX
+ #include <dlfcn.h>
+ #include <pthread.h>
+ #include <typeinfo>
+ #include <cxxabi.h>
+#endif
+
+namespace {
+	//How many sections are open on this thread. Plain int, so no TLS constructor runs
+	thread_local int realtimeDepth = 0;
+	//Set while reporting, so the report itself (DBG allocates) isn't reported
+	thread_local bool isReporting = false;
+
+	std::atomic<int> numViolations{ 0 };
+
+	void* allocate(std::size_t size) {
+		if (realtimeDepth > 0) RealtimeChecker::reportViolation("heap allocation");
+		if (size == 0) size = 1;
+		return std::malloc(size);
+	}
+
+	void* allocateAligned(std::size_t size, std::align_val_t alignment) {
+		if (realtimeDepth > 0) RealtimeChecker::reportViolation("aligned heap allocation");
+		if (size == 0) size = 1;
+	#if JUCE_WINDOWS
+		return _aligned_malloc(size, (std::size_t)alignment);
+	#else
+		void* ptr = nullptr;
+		auto align = juce::jmax((std::size_t)alignment, sizeof(void*));
+		return posix_memalign(&ptr, align, size) == 0 ? ptr : nullptr;
+	#endif
+	}
+
+	void deallocate(void* ptr) noexcept {
+		if (ptr != nullptr && realtimeDepth > 0) RealtimeChecker::reportViolation("heap free");
+		std::free(ptr);
+	}
+
+	void deallocateAligned(void* ptr) noexcept {
+		if (ptr != nullptr && realtimeDepth > 0) RealtimeChecker::reportViolation("aligned heap free");
+	#if JUCE_WINDOWS
+		_aligned_free(ptr);
+	#else
+		std::free(ptr);
+	#endif
+	}
+}
+
+namespace RealtimeChecker {
+	ScopedRealtimeSection::ScopedRealtimeSection() noexcept { ++realtimeDepth; }
+	ScopedRealtimeSection::~ScopedRealtimeSection() noexcept { --realtimeDepth; }
+
+	ScopedAllowance::ScopedAllowance() noexcept : savedDepth(realtimeDepth) { realtimeDepth = 0; }
+	ScopedAllowance::~ScopedAllowance() noexcept { realtimeDepth = savedDepth; }
+
+	bool isInRealtimeSection() noexcept { return realtimeDepth > 0; }
+
+	int getNumViolations() noexcept { return numViolations.load(std::memory_order_relaxed); }
+
+	void reportViolation(const char* what) noexcept {
+		if (isReporting) return;
+
+		isReporting = true;
+		numViolations.fetch_add(1, std::memory_order_relaxed);
+
+		//Leave the section while logging, DBG and jassert both allocate
+		auto depth = realtimeDepth;
+		realtimeDepth = 0;
+
+		DBG("Realtime violation on the audio thread: " << what);
+	#if ADDSYNTH_REALTIME_CHECKS_ASSERT
+		jassertfalse;
+	#endif
+
+		realtimeDepth = depth;
+		isReporting = false;
+	}
+}
+
+//Global allocator replacements
+void* operator new(std::size_t size) {
+	if (auto* ptr = allocate(size)) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+	if (auto* ptr = allocate(size)) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept { return allocate(size); }
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+	if (auto* ptr = allocateAligned(size, alignment)) return ptr;
+	throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+	if (auto* ptr = allocateAligned(size, alignment)) return ptr;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { deallocate(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { deallocate(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { deallocateAligned(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { deallocateAligned(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { deallocateAligned(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { deallocateAligned(ptr); }
+
+#if JUCE_LINUX
+//Symbol interposition, only effective when linked into an executable
+extern "C" int pthread_mutex_lock(pthread_mutex_t* mutex) {
+	//Constant-initialised, so there is no static init guard (that could take a mutex itself)
+	using LockFn = int (*)(pthread_mutex_t*);
+	static std::atomic<LockFn> realLock{ nullptr };
+
+	auto lock = realLock.load(std::memory_order_acquire);
+	if (lock == nullptr) {
+		lock = (LockFn)dlsym(RTLD_NEXT, "pthread_mutex_lock");
+		realLock.store(lock, std::memory_order_release);
+	}
+
+	if (realtimeDepth > 0) RealtimeChecker::reportViolation("mutex lock");
+	return lock(mutex);
+}
+
+extern "C" void* __dynamic_cast(const void* source,
+								const abi::__class_type_info* sourceType,
+								const abi::__class_type_info* destType,
+								std::ptrdiff_t hint) {
+	using CastFn = void* (*)(const void*, const abi::__class_type_info*, const abi::__class_type_info*, std::ptrdiff_t);
+	static std::atomic<CastFn> realCast{ nullptr };
+
+	auto cast = realCast.load(std::memory_order_acquire);
+	if (cast == nullptr) {
+		cast = (CastFn)dlsym(RTLD_NEXT, "__dynamic_cast");
+		realCast.store(cast, std::memory_order_release);
+	}
+
+	if (realtimeDepth > 0) RealtimeChecker::reportViolation("dynamic_cast");
+	return cast(source, sourceType, destType, hint);
+}
+#endif
+
+#endif
@@ -0,0 +1,67 @@
+/*
+  ==============================================================================
+
+    RealtimeChecker.h
+
+	Debug-only real-time safety checker.
+
+	Code that runs on the audio thread opens a REALTIME_SECTION. While a section
+	is open on the current thread, heap allocations, mutex locks and dynamic_casts
+	are reported (jassert or DBG, see ADDSYNTH_REALTIME_CHECKS_ASSERT).
+
+	Allocations are caught by replacing the global operator new/delete.
+	Locks and dynamic_cast are caught by interposing pthread_mutex_lock and
+	__dynamic_cast, which only works on Linux executables (eg the console tools),
+	not in a dlopen'd plugin.
+
+	In release builds everything here compiles away to nothing.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+
+#if ADDSYNTH_REALTIME_CHECKS
+
+namespace RealtimeChecker {
+	//Marks the current thread as rendering audio until destroyed. Sections nest.
+	class ScopedRealtimeSection {
+	public:
+		ScopedRealtimeSection() noexcept;
+		~ScopedRealtimeSection() noexcept;
+
+		JUCE_DECLARE_NON_COPYABLE(ScopedRealtimeSection)
+	};
+
+	//Suspends checking on the current thread, for known unavoidable cases
+	//(eg the lock behind waking a render worker that fell asleep)
+	class ScopedAllowance {
+	public:
+		ScopedAllowance() noexcept;
+		~ScopedAllowance() noexcept;
+
+	private:
+		int savedDepth;
+
+		JUCE_DECLARE_NON_COPYABLE(ScopedAllowance)
+	};
+
+	bool isInRealtimeSection() noexcept;
+
+	//Called by the hooks. what must be a string literal.
+	void reportViolation(const char* what) noexcept;
+
+	//Number of violations seen since startup, from any thread
+	int getNumViolations() noexcept;
+}
+
+#define REALTIME_SECTION RealtimeChecker::ScopedRealtimeSection JUCE_JOIN_MACRO(realtimeSection_, __LINE__);
+#define REALTIME_ALLOWANCE RealtimeChecker::ScopedAllowance JUCE_JOIN_MACRO(realtimeAllowance_, __LINE__);
+
+#else
+
+#define REALTIME_SECTION
+#define REALTIME_ALLOWANCE
+
+#endif
@@ -0,0 +1,496 @@
+/*
+  ==============================================================================
+
+    AdditiveSynthesiser.cpp
+
+  ==============================================================================
+*/
+
+#include "AdditiveSynthesiser.h"
+#include "../debug/RealtimeChecker.h"
+
+template <typename SampleType>
+AdditiveSynthesiser<SampleType>::AdditiveSynthesiser() {
+	//14 bit, centred
+	std::fill(std::begin(pitchWheels), std::end(pitchWheels), 8192);
+}
+
+template <typename SampleType>
+typename AdditiveSynthesiser<SampleType>::Voice* AdditiveSynthesiser<SampleType>::addSynthVoice(Voice* voice) {
+	synthVoices.add(voice);
+	voiceStates.emplace_back();
+	voice->setSound(sound.get());
+
+	activeIndices.ensureStorageAllocated(synthVoices.size());
+	activeVoices.ensureStorageAllocated(synthVoices.size());
+	return voice;
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::setSound(SynthSound* newSound) {
+	sound = newSound;
+
+	for (auto* voice : synthVoices)
+		voice->setSound(newSound);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::initialise(const ParameterSnapshot& snapshot) {
+	parameters = &snapshot;
+
+	for (auto* voice : synthVoices)
+		voice->initialise(snapshot);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::prepareToPlay(juce::dsp::ProcessSpec& spec) {
+	for (auto* voice : synthVoices)
+		voice->prepareToPlay(spec);
+
+	voiceFilter.prepare(spec.sampleRate, (int)spec.maximumBlockSize, parameters != nullptr ? parameters->getFilterCutoff() : FILTER_CUTOFF_DEF);
+
+	//Long enough for the batches within a block, the workers sleep through the rest of it
+	const double blockMs = 1000.0 * spec.maximumBlockSize / spec.sampleRate;
+	workerSpinMs.store(juce::jmin(blockMs * RENDER_WORKER_SPIN_FRACTION, RENDER_WORKER_SPIN_MAX_MS));
+	if (renderPool != nullptr)
+		renderPool->setSpinTime(workerSpinMs.load());
+
+	prepared.store(true);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::startRenderPool() {
+	if (renderPool != nullptr || !prepared.load()) return;
+
+	//The audio thread is one of the participants, so leave it its own core
+	int numWorkers = juce::jmin(juce::SystemStats::getNumPhysicalCpus() - 1, MAX_RENDER_WORKERS);
+	if (numWorkers <= 0) return;
+
+	renderPool = std::make_unique<VoiceRenderPool>(numWorkers, workerSpinMs.load());
+	activePool.store(renderPool.get(), std::memory_order_release);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::releaseResources() {
+	prepared.store(false);
+	activePool.store(nullptr);
+	renderPool.reset();
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::renderNextBlock(juce::AudioBuffer<SampleType>& outputBuffer, const juce::MidiBuffer& midi, int startSample, int numSamples) {
+	REALTIME_SECTION
+
+	if (parameters != nullptr)
+		voiceFilter.setParameters(*parameters);
+
+	const int endSample = startSample + numSamples;
+	const bool lastRange = endSample >= outputBuffer.getNumSamples();
+
+	for (auto it = midi.findNextSamplePosition(startSample); it != midi.end(); ++it) {
+		const auto event = *it;
+		if (event.samplePosition >= endSample && !lastRange) break;
+
+		//Right up to the event, then the event. Several on one sample render nothing in between
+		const int eventSample = juce::jmin(event.samplePosition, endSample);
+		if (eventSample > startSample) {
+			renderVoices(outputBuffer, startSample, eventSample - startSample);
+			startSample = eventSample;
+		}
+
+		handleMidiEvent(event.data, event.numBytes);
+	}
+
+	if (endSample > startSample)
+		renderVoices(outputBuffer, startSample, endSample - startSample);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::skipIdleBlock(int numSamples) noexcept {
+	if (parameters != nullptr)
+		voiceFilter.setParameters(*parameters);
+
+	voiceFilter.skip(numSamples);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::handleMidiEvent(const juce::uint8* data, int numBytes) {
+	if (numBytes < 1) return;
+
+	const int status = data[0] & 0xf0;
+	const int channel = (data[0] & 0x0f) + 1;
+	const int data1 = numBytes > 1 ? data[1] : 0;
+	const int data2 = numBytes > 2 ? data[2] : 0;
+
+	switch (status) {
+	case 0x90:
+		//Velocity 0 is a note off
+		if (data2 > 0)
+			noteOn(channel, data1, (float)data2 / 127.0f);
+		else
+			noteOff(channel, data1, 0.0f, true);
+		break;
+	case 0x80:
+		noteOff(channel, data1, (float)data2 / 127.0f, true);
+		break;
+	case 0xb0:
+		//All sound off and all notes off
+		if (data1 == 120 || data1 == 123)
+			allNotesOff(channel, true);
+		else
+			handleController(channel, data1, data2);
+		break;
+	case 0xe0:
+		handlePitchWheel(channel, data1 | (data2 << 7));
+		break;
+	default:
+		//Aftertouch, program changes and system messages don't do anything here
+		break;
+	}
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::noteOn(int midiChannel, int midiNoteNumber, float velocity) {
+	jassert(midiChannel >= 1 && midiChannel <= 16);
+	if (midiChannel < 1 || midiChannel > 16) return;
+
+	//The same key again on the same channel releases the one already sounding
+	for (int i = activeIndices.size(); --i >= 0;) {
+		const int index = activeIndices.getUnchecked(i);
+		if (voiceStates[(size_t)index].note == midiNoteNumber && voiceStates[(size_t)index].channel == midiChannel)
+			stopVoice(index, 1.0f, true);
+	}
+
+	const int index = findFreeVoice();
+	if (index >= 0)
+		startVoice(index, midiChannel, midiNoteNumber, velocity);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::noteOff(int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff) {
+	for (int i = activeIndices.size(); --i >= 0;) {
+		const int index = activeIndices.getUnchecked(i);
+		auto& state = voiceStates[(size_t)index];
+		if (state.note != midiNoteNumber || state.channel != midiChannel) continue;
+
+		//A pedal holds it until it comes up
+		state.keyDown = false;
+		if (!(state.sustainPedalDown || state.sostenutoPedalDown))
+			stopVoice(index, velocity, allowTailOff);
+	}
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::allNotesOff(int midiChannel, bool allowTailOff) {
+	for (int i = activeIndices.size(); --i >= 0;) {
+		const int index = activeIndices.getUnchecked(i);
+		if (midiChannel <= 0 || voiceStates[(size_t)index].channel == midiChannel)
+			stopVoice(index, 1.0f, allowTailOff);
+	}
+
+	std::fill(std::begin(sustainPedals), std::end(sustainPedals), false);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::handlePitchWheel(int midiChannel, int wheelValue) {
+	if (midiChannel < 1 || midiChannel > 16) return;
+	pitchWheels[midiChannel - 1] = wheelValue;
+
+	for (int index : activeIndices)
+		if (voiceStates[(size_t)index].channel == midiChannel)
+			synthVoices.getUnchecked(index)->pitchWheelMoved(wheelValue);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::handleController(int midiChannel, int controllerNumber, int controllerValue) {
+	if (midiChannel < 1 || midiChannel > 16) return;
+
+	switch (controllerNumber) {
+	case 0x40: handleSustainPedal(midiChannel, controllerValue >= 64); break;
+	case 0x42: handleSostenutoPedal(midiChannel, controllerValue >= 64); break;
+	default: break;
+	}
+
+	const int controllerIndex = ModMatrix::getControllerIndex(controllerNumber);
+	if (controllerIndex >= 0)
+		controllers.values[midiChannel - 1][controllerIndex] = (float)controllerValue / 127.0f;
+
+	//Voices already playing on the channel hear it from here
+	for (int index : activeIndices)
+		if (voiceStates[(size_t)index].channel == midiChannel)
+			synthVoices.getUnchecked(index)->controllerMoved(controllerNumber, controllerValue);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::handleSustainPedal(int midiChannel, bool isDown) {
+	if (isDown) {
+		sustainPedals[midiChannel - 1] = true;
+
+		for (int index : activeIndices) {
+			auto& state = voiceStates[(size_t)index];
+			if (state.channel == midiChannel && state.keyDown)
+				state.sustainPedalDown = true;
+		}
+		return;
+	}
+
+	for (int i = activeIndices.size(); --i >= 0;) {
+		const int index = activeIndices.getUnchecked(i);
+		auto& state = voiceStates[(size_t)index];
+		if (state.channel != midiChannel) continue;
+
+		state.sustainPedalDown = false;
+		if (!(state.keyDown || state.sostenutoPedalDown))
+			stopVoice(index, 1.0f, true);
+	}
+
+	sustainPedals[midiChannel - 1] = false;
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::handleSostenutoPedal(int midiChannel, bool isDown) {
+	for (int i = activeIndices.size(); --i >= 0;) {
+		const int index = activeIndices.getUnchecked(i);
+		auto& state = voiceStates[(size_t)index];
+		if (state.channel != midiChannel) continue;
+
+		if (isDown) {
+			state.sostenutoPedalDown = true;
+		}
+		else if (state.sostenutoPedalDown) {
+			state.sostenutoPedalDown = false;
+			stopVoice(index, 1.0f, true);
+		}
+	}
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::startVoice(int index, int midiChannel, int midiNoteNumber, float velocity) {
+	auto& state = voiceStates[(size_t)index];
+
+	//Stolen, it goes without a tail
+	if (state.isActive())
+		stopVoice(index, 0.0f, false);
+
+	state.note = midiNoteNumber;
+	state.channel = midiChannel;
+	state.noteOnTime = ++lastNoteOnCounter;
+	state.keyDown = true;
+	state.sostenutoPedalDown = false;
+	state.sustainPedalDown = sustainPedals[midiChannel - 1];
+	addActiveVoice(index);
+
+	//Wheels and controllers as they are on this channel
+	synthVoices.getUnchecked(index)->startNote(midiNoteNumber, velocity, pitchWheels[midiChannel - 1], controllers.values[midiChannel - 1]);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::stopVoice(int index, float velocity, bool allowTailOff) {
+	synthVoices.getUnchecked(index)->stopNote(velocity, allowTailOff);
+
+	//With a tail it goes once the tail is over, see freeFinishedVoices
+	if (!allowTailOff) {
+		voiceStates[(size_t)index] = VoiceState();
+		removeActiveVoice(index);
+	}
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::addActiveVoice(int index) noexcept {
+	//Kept in voice order, so voices are always summed in the same order
+	int position = activeIndices.size();
+	while (position > 0 && activeIndices.getUnchecked(position - 1) > index)
+		position--;
+
+	activeIndices.insert(position, index);
+	activeVoices.insert(position, synthVoices.getUnchecked(index));
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::removeActiveVoice(int index) noexcept {
+	const int position = activeIndices.indexOf(index);
+	if (position < 0) return;
+
+	activeIndices.remove(position);
+	activeVoices.remove(position);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::freeFinishedVoices() noexcept {
+	for (int i = activeIndices.size(); --i >= 0;) {
+		const int index = activeIndices.getUnchecked(i);
+		if (!synthVoices.getUnchecked(index)->isFinished()) continue;
+
+		voiceStates[(size_t)index] = VoiceState();
+		activeIndices.remove(i);
+		activeVoices.remove(i);
+	}
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::renderVoices(juce::AudioBuffer<SampleType>& outputBuffer, int startSample, int numSamples) {
+	renderActiveVoices(outputBuffer, startSample, numSamples);
+
+	for (auto* voice : activeVoices)
+		voiceRenderTicks += voice->takeRenderTicks();
+
+	freeFinishedVoices();
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::renderActiveVoices(juce::AudioBuffer<SampleType>& outputBuffer, int startSample, int numSamples) {
+	auto* pool = activePool.load(std::memory_order_acquire);
+	const bool multicore = pool != nullptr
+						&& parameters != nullptr && parameters->isMulticore()
+						&& activeVoices.size() >= MULTICORE_MIN_VOICES;
+
+	if (activeVoices.isEmpty()) return;
+
+	const int scratchSize = activeVoices.getFirst()->getScratchSize();
+	jassert(scratchSize > 0); //prepareToPlay hasn't been called
+	if (scratchSize == 0) return;
+
+	while (numSamples > 0) {
+		chunkSize = juce::jmin(numSamples, scratchSize);
+		renderChunk(multicore ? pool : nullptr);
+
+		//Always summed in voice order, so the output is the same whichever thread rendered what
+		for (auto* voice : activeVoices)
+			voice->addScratchTo(outputBuffer, startSample, chunkSize);
+
+		startSample += chunkSize;
+		numSamples -= chunkSize;
+	}
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::renderChunk(VoiceRenderPool* pool) {
+	//Sparse voices go a register's worth at a time, otherwise one voice at a time
+	const bool interleaved = shouldInterleaveVoices();
+	const int numTasks = interleaved ? (activeVoices.size() + PartialBank::lanes - 1) / PartialBank::lanes : activeVoices.size();
+
+	//A handful of voices isn't worth the handoff
+	if (pool != nullptr)
+		pool->run(interleaved ? renderGroupTask : renderVoiceTask, this, numTasks);
+	else if (interleaved)
+		for (int group = 0; group < numTasks; group++)
+			renderGroup(group);
+	else
+		for (auto* voice : activeVoices)
+			voice->renderScratch(chunkSize);
+
+	voiceFilter.process(activeVoices, chunkSize);
+}
+
+template <typename SampleType>
+int AdditiveSynthesiser<SampleType>::getNumUsableVoices() const noexcept {
+	if (parameters == nullptr) return synthVoices.size();
+	return juce::jlimit(1, synthVoices.size(), parameters->getNumVoices());
+}
+
+template <typename SampleType>
+int AdditiveSynthesiser<SampleType>::findFreeVoice() const noexcept {
+	//Voices past the limit still finish their release, they just don't get new notes
+	const int numUsable = getNumUsableVoices();
+	for (int i = 0; i < numUsable; i++)
+		if (!voiceStates[(size_t)i].isActive())
+			return i;
+
+	return findVoiceToSteal();
+}
+
+template <typename SampleType>
+int AdditiveSynthesiser<SampleType>::findVoiceToSteal() const noexcept {
+	int oldestReleased = -1;
+	int quietest = -1;
+
+	const int numUsable = getNumUsableVoices();
+	for (int i = 0; i < numUsable; i++) {
+		const auto& state = voiceStates[(size_t)i];
+
+		//A released voice is already on its way out
+		if (state.isReleased()) {
+			if (oldestReleased < 0 || state.noteOnTime < voiceStates[(size_t)oldestReleased].noteOnTime)
+				oldestReleased = i;
+		}
+		else if (quietest < 0 || synthVoices.getUnchecked(i)->getLastPeak() < synthVoices.getUnchecked(quietest)->getLastPeak()) {
+			quietest = i;
+		}
+	}
+
+	return oldestReleased >= 0 ? oldestReleased : quietest;
+}
+
+template <typename SampleType>
+bool AdditiveSynthesiser<SampleType>::shouldInterleaveVoices() const noexcept {
+	constexpr int lanes = PartialBank::lanes;
+	const PartialBank* banks[lanes];
+
+	for (int first = 0; first < activeVoices.size(); first += lanes) {
+		const int count = juce::jmin(lanes, activeVoices.size() - first);
+		for (int i = 0; i < count; i++)
+			banks[i] = &activeVoices.getUnchecked(first + i)->getPartialBank();
+
+		if (PartialBank::shouldInterleave(banks, count))
+			return true;
+	}
+
+	return false;
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::renderGroup(int group) {
+	constexpr int lanes = PartialBank::lanes;
+	const int first = group * lanes;
+	const int count = juce::jmin(lanes, activeVoices.size() - first);
+
+	//The voices that left their partial bank to render
+	Voice* voices[lanes];
+	PartialBank* banks[lanes];
+	const float* envelopes[lanes];
+	float* outputs[lanes];
+	int numLeft = 0;
+
+	for (int i = 0; i < count; i++) {
+		auto* voice = activeVoices.getUnchecked(first + i);
+		if (!voice->beginScratch(chunkSize)) continue;
+
+		voices[numLeft] = voice;
+		banks[numLeft] = &voice->getPartialBank();
+		envelopes[numLeft] = voice->getOscillatorGains();
+		outputs[numLeft] = voice->getOscillatorOutput();
+		numLeft++;
+	}
+
+	//Asked again with the banks up to date, the partials may have changed since the last chunk
+	if (PartialBank::shouldInterleave(banks, numLeft)) {
+		auto startTicks = juce::Time::getHighResolutionTicks();
+		PartialBank::processInterleaved(banks, numLeft, voices[0]->getTables(), envelopes, outputs, chunkSize);
+
+		//Every voice had a lane all the way through, so they share the time evenly
+		auto ticks = (juce::Time::getHighResolutionTicks() - startTicks) / numLeft;
+		for (int i = 0; i < numLeft; i++)
+			voices[i]->addRenderTicks(ticks);
+	}
+	else {
+		for (int i = 0; i < numLeft; i++)
+			voices[i]->renderBankPartials(chunkSize);
+	}
+
+	for (int i = 0; i < count; i++)
+		activeVoices.getUnchecked(first + i)->endScratch(chunkSize);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::renderVoiceTask(void* context, int taskIndex) {
+	auto* synth = static_cast<AdditiveSynthesiser*>(context);
+	synth->activeVoices.getUnchecked(taskIndex)->renderScratch(synth->chunkSize);
+}
+
+template <typename SampleType>
+void AdditiveSynthesiser<SampleType>::renderGroupTask(void* context, int taskIndex) {
+	static_cast<AdditiveSynthesiser*>(context)->renderGroup(taskIndex);
+}
+
+template class AdditiveSynthesiser<float>;
+template class AdditiveSynthesiser<double>;
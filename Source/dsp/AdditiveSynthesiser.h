@@ -0,0 +1,199 @@
+/*
+  ==============================================================================
+
+    AdditiveSynthesiser.h
+
+	Polyphonic engine for SynthVoice, in place of juce::Synthesiser, that can
+	render its voices on several cores.
+
+	The note state of every voice (VoiceState) sits in one flat array here,
+	next to the list of voices that have a note, in voice order. The list is
+	only touched when a voice starts or finishes, so idle voices cost nothing
+	per block. Voices are plain objects bound to the one SynthSound up front,
+	nothing is called through a virtual or cast on the audio thread.
+
+	MIDI is read straight from the buffer's raw bytes. The voices render up to
+	each event's sample exactly, then the event is played. Notes behave as
+	they did under juce::Synthesiser: a key already sounding on the channel is
+	released before it's played again, the sustain and sostenuto pedals hold
+	released keys, and all notes off or all sound off release the channel.
+	The latest pitch wheel and the controllers the modulation matrix reads
+	are kept per channel, for voices that start after they moved.
+
+	Voice allocation only hands out the first "Number of Voices" voices, so
+	polyphony can change without creating or destroying voices on the audio
+	thread. When it has to steal, the oldest released voice goes first,
+	otherwise the quietest one.
+
+	Each voice renders into its own scratch buffer, then the voices are
+	filtered together (see VoiceFilter) and added to the output in voice order.
+	The synth, its voices and their filter are float or double throughout, as
+	the host processes (see SynthVoice for where double starts).
+	When voices have so few audible partials that they'd leave most of a
+	register empty, a register's worth of voices renders their partials
+	together instead, voice major (see PartialBank::processInterleaved). The
+	layout is picked per group of voices, from how many partials each has.
+
+	A voice gives its note back once its release has finished and its filter
+	has rung out. With no voice left at all, the processor skips the synth for
+	the block (see isIdle).
+
+	With multicore rendering on and enough voices sounding, each active voice,
+	or each group when they're interleaved, renders as one task on a
+	VoiceRenderPool. Filtering and summing stay on
+	the audio thread, so the result doesn't depend on which thread rendered
+	which voice. The pool's threads only exist once multicore rendering has
+	been turned on, and until releaseResources.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+#include "SynthVoice.h"
+#include "SynthSound.h"
+#include "VoiceRenderPool.h"
+#include "VoiceFilter.h"
+
+template <typename SampleType>
+class AdditiveSynthesiser {
+public:
+	using Voice = SynthVoice<SampleType>;
+
+	AdditiveSynthesiser();
+
+	//Takes ownership. Message thread, before prepareToPlay
+	Voice* addSynthVoice(Voice* voice);
+
+	//Takes ownership, and binds it to every voice. Message thread, before prepareToPlay
+	void setSound(SynthSound* newSound);
+
+	const juce::OwnedArray<Voice>& getSynthVoices() const noexcept { return synthVoices; }
+
+	//Voices with a note, in voice order. Audio thread only
+	const juce::Array<Voice*>& getActiveVoices() const noexcept { return activeVoices; }
+
+	//Time the voices spent rendering since the last call, summed over voices and threads
+	juce::int64 takeVoiceRenderTicks() noexcept {
+		auto ticks = voiceRenderTicks;
+		voiceRenderTicks = 0;
+		return ticks;
+	}
+
+	//Hands the snapshot to every voice, it has to outlive the synth
+	void initialise(const ParameterSnapshot& snapshot);
+
+	//Prepares the voices and the filter
+	void prepareToPlay(juce::dsp::ProcessSpec& spec);
+
+	//Starts the worker threads, if the machine has cores to spare and they aren't running yet. Message
+	//thread, between prepareToPlay and releaseResources, when multicore rendering turns on
+	void startRenderPool();
+
+	//Stops the worker threads. Message thread, while nothing renders
+	void releaseResources();
+
+	//Adds numSamples of every voice from startSample, playing the events of midi that fall in that range
+	//on their sample. Events past the end of the buffer are played after its last range has rendered
+	void renderNextBlock(juce::AudioBuffer<SampleType>& outputBuffer, const juce::MidiBuffer& midi, int startSample, int numSamples);
+
+	//No voice has a note, release or filter tail left. A block with no MIDI either would be silent
+	bool isIdle() const noexcept { return activeVoices.isEmpty(); }
+
+	//In place of renderNextBlock for a block isIdle says is silent. Keeps the filter's
+	//cutoff glide in time
+	void skipIdleBlock(int numSamples) noexcept;
+
+	//What renderNextBlock does with each event. Channels 1 to 16, 0 for all in allNotesOff
+	void noteOn(int midiChannel, int midiNoteNumber, float velocity);
+	void noteOff(int midiChannel, int midiNoteNumber, float velocity, bool allowTailOff);
+	void allNotesOff(int midiChannel, bool allowTailOff);
+	void handlePitchWheel(int midiChannel, int wheelValue);
+	void handleController(int midiChannel, int controllerNumber, int controllerValue);
+
+private:
+	//Note state of the voice at the same index
+	struct VoiceState {
+		//-1 while the voice is free
+		int note = -1;
+		int channel = 0;
+		juce::uint32 noteOnTime = 0;
+
+		bool keyDown = false;
+		bool sustainPedalDown = false;
+		bool sostenutoPedalDown = false;
+
+		bool isActive() const noexcept { return note >= 0; }
+		bool isPlayingChannel(int midiChannel) const noexcept { return isActive() && channel == midiChannel; }
+
+		//Key up and no pedal holding it, so it's on its way out
+		bool isReleased() const noexcept { return isActive() && !(keyDown || sustainPedalDown || sostenutoPedalDown); }
+	};
+
+	juce::OwnedArray<Voice> synthVoices;
+	std::vector<VoiceState> voiceStates;
+
+	//Indices of the voices with a note and the voices themselves, in voice order. Kept up to date
+	//as notes start and voices finish. Storage reserved in addSynthVoice
+	juce::Array<int> activeIndices;
+	juce::Array<Voice*> activeVoices;
+	juce::uint32 lastNoteOnCounter = 0;
+
+	int chunkSize = 0;
+	juce::int64 voiceRenderTicks = 0;
+
+	const ParameterSnapshot* parameters{ nullptr };
+	SynthSound::Ptr sound;
+
+	//Made on the message thread while the audio thread may be rendering, so the audio thread only
+	//ever reads it through activePool
+	std::unique_ptr<VoiceRenderPool> renderPool;
+	std::atomic<VoiceRenderPool*> activePool{ nullptr };
+	std::atomic<bool> prepared{ false };
+
+	//Worker spin from the block period, set in prepareToPlay
+	std::atomic<double> workerSpinMs{ RENDER_WORKER_SPIN_MAX_MS };
+	VoiceFilter<SampleType> voiceFilter;
+
+	//Per channel, for notes that start later
+	int pitchWheels[16];
+	bool sustainPedals[16] = {};
+	ModMatrix::ControllerState controllers;
+
+	void handleMidiEvent(const juce::uint8* data, int numBytes);
+	void handleSustainPedal(int midiChannel, bool isDown);
+	void handleSostenutoPedal(int midiChannel, bool isDown);
+
+	void startVoice(int index, int midiChannel, int midiNoteNumber, float velocity);
+	void stopVoice(int index, float velocity, bool allowTailOff);
+
+	//Index of the voice to give a new note, stealing one if they're all busy
+	int findFreeVoice() const noexcept;
+	int findVoiceToSteal() const noexcept;
+
+	//How many voices, from the front, notes may be given to
+	int getNumUsableVoices() const noexcept;
+
+	void renderVoices(juce::AudioBuffer<SampleType>& outputBuffer, int startSample, int numSamples);
+	void renderActiveVoices(juce::AudioBuffer<SampleType>& outputBuffer, int startSample, int numSamples);
+
+	//Renders and filters chunkSize samples of every active voice into their scratch buffers, on the
+	//pool's workers as well unless it's null
+	void renderChunk(VoiceRenderPool* pool);
+
+	void addActiveVoice(int index) noexcept;
+	void removeActiveVoice(int index) noexcept;
+
+	//Gives back the notes of voices that have finished their tail
+	void freeFinishedVoices() noexcept;
+
+	//Some group of PartialBank::lanes voices, from the front, has few enough partials to interleave.
+	//From the banks as the last chunk left them
+	bool shouldInterleaveVoices() const noexcept;
+
+	//Renders the active voices from group * PartialBank::lanes on, interleaved if their partials suit
+	void renderGroup(int group);
+
+	static void renderVoiceTask(void* context, int taskIndex);
+	static void renderGroupTask(void* context, int taskIndex);
+};
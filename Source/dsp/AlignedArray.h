@@ -0,0 +1,43 @@
+/*
+  ==============================================================================
+
+    AlignedArray.h
+
+	Fixed size heap array aligned for SIMD loads (64 bytes covers up to AVX-512).
+	Only meant for trivially copyable types, and only allocated off the audio thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+
+template <typename Type>
+class AlignedArray {
+public:
+	static constexpr size_t alignment = 64;
+
+	void allocate(size_t numElements) {
+		storage.allocate(numElements * sizeof(Type) + alignment, true);
+		auto address = reinterpret_cast<juce::pointer_sized_uint>(storage.get());
+		data = reinterpret_cast<Type*>((address + alignment - 1) & ~(juce::pointer_sized_uint)(alignment - 1));
+		size = numElements;
+	}
+
+	void clear() noexcept {
+		std::fill(data, data + size, Type{});
+	}
+
+	Type* get() noexcept { return data; }
+	const Type* get() const noexcept { return data; }
+
+	Type& operator[](size_t index) noexcept { jassert(index < size); return data[index]; }
+	const Type& operator[](size_t index) const noexcept { jassert(index < size); return data[index]; }
+
+	size_t getSize() const noexcept { return size; }
+
+private:
+	juce::HeapBlock<char> storage;
+	Type* data = nullptr;
+	size_t size = 0;
+};
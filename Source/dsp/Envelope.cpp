@@ -0,0 +1,142 @@
+/*
+  ==============================================================================
+
+    Envelope.cpp
+
+  ==============================================================================
+*/
+
+#include "Envelope.h"
+#include "OscillatorKernels.h"
+
+template <typename SampleType>
+void Envelope<SampleType>::setParameters(const juce::ADSR::Parameters& newParameters) noexcept {
+	const bool sustainMoved = newParameters.sustain != parameters.sustain;
+	parameters = newParameters;
+
+	//Holding, glide rather than jump
+	if (stage == Stage::Sustain && sustainMoved)
+		startSegment(Stage::Decay, (SampleType)parameters.sustain, (float)PARTIAL_GAIN_RAMP_SECONDS, decayOvershoot);
+}
+
+template <typename SampleType>
+void Envelope<SampleType>::noteOn() noexcept {
+	startSegment(Stage::Attack, 1, parameters.attack, attackOvershoot);
+}
+
+template <typename SampleType>
+void Envelope<SampleType>::noteOff() noexcept {
+	if (stage == Stage::Idle) return;
+	startSegment(Stage::Release, 0, parameters.release, decayOvershoot);
+}
+
+template <typename SampleType>
+void Envelope<SampleType>::reset() noexcept {
+	stage = Stage::Idle;
+	level = 0;
+	remaining = 0;
+}
+
+template <typename SampleType>
+void Envelope<SampleType>::startSegment(Stage newStage, SampleType newTarget, float seconds, SampleType overshoot) noexcept {
+	stage = newStage;
+	target = newTarget;
+	remaining = juce::jmax(1, juce::roundToInt(seconds * sampleRate));
+
+	//Aiming at asymptote, the curve has covered 1 / (1 + overshoot) of the way after remaining samples
+	const SampleType distance = target - level;
+	const SampleType asymptote = target + overshoot * distance;
+	coefficient = (SampleType)std::exp(-std::log((1.0 + overshoot) / overshoot) / remaining);
+	base = asymptote * (1 - coefficient);
+
+	//Already there, eg a decay to a sustain of 1
+	if (distance == 0)
+		remaining = 0;
+}
+
+template <typename SampleType>
+void Envelope<SampleType>::endSegment() noexcept {
+	level = target;
+
+	switch (stage) {
+	case Stage::Attack:
+		startSegment(Stage::Decay, (SampleType)parameters.sustain, parameters.decay, decayOvershoot);
+		break;
+	case Stage::Decay:
+		stage = Stage::Sustain;
+		break;
+	case Stage::Release:
+		stage = Stage::Idle;
+		level = 0;
+		break;
+	default:
+		break;
+	}
+}
+
+template <typename SampleType>
+void Envelope<SampleType>::render(SampleType* gains, int numSamples) noexcept {
+	while (numSamples > 0) {
+		if (stage == Stage::Idle || stage == Stage::Sustain) {
+			juce::FloatVectorOperations::fill(gains, level, numSamples);
+			return;
+		}
+
+		if (remaining == 0) {
+			endSegment();
+			continue;
+		}
+
+		//No end test in here, the segment's length is known. A float segment goes to the widest
+		//kernel variant, which steps a register of samples at a time
+		const int count = juce::jmin(numSamples, remaining);
+		SampleType value = level;
+		bool rendered = false;
+		if constexpr (std::is_same_v<SampleType, float>)
+			rendered = OscillatorKernels::renderSegment(OscillatorKernels::getVariant(), gains, count, value, coefficient, base);
+
+		if (!rendered) {
+			for (int i = 0; i < count; i++) {
+				value = value * coefficient + base;
+				gains[i] = value;
+			}
+		}
+
+		level = value;
+		remaining -= count;
+		gains += count;
+		numSamples -= count;
+
+		//So a release that just finished reads as idle straight away
+		if (remaining == 0)
+			endSegment();
+	}
+}
+
+template <typename SampleType>
+SampleType Envelope<SampleType>::advance(int numSamples) noexcept {
+	const SampleType start = level;
+
+	while (numSamples > 0 && stage != Stage::Idle && stage != Stage::Sustain) {
+		if (remaining == 0) {
+			endSegment();
+			continue;
+		}
+
+		//Closed form for count steps of the recursion
+		const int count = juce::jmin(numSamples, remaining);
+		const SampleType asymptote = base / (1 - coefficient);
+		level = asymptote + (level - asymptote) * std::pow(coefficient, (SampleType)count);
+
+		remaining -= count;
+		numSamples -= count;
+	}
+
+	if (remaining == 0 && stage != Stage::Idle && stage != Stage::Sustain)
+		endSegment();
+
+	return start;
+}
+
+template class Envelope<float>;
+template class Envelope<double>;
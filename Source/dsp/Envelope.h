@@ -0,0 +1,73 @@
+/*
+  ==============================================================================
+
+    Envelope.h
+
+	ADSR envelope generator, rendered a block at a time.
+
+	Every segment is an exponential curve towards a point a little past its
+	target, so it lands on the target in exactly the segment's time. Each
+	sample is one multiply and one add, level = level * coefficient + base.
+	How many samples are left in the segment is worked out when it starts,
+	so the inner loop never checks for the end.
+
+	Attack and release always start from wherever the level is. A note that
+	is released half way up its attack, or retriggered while releasing,
+	ramps from there rather than jumping. A new sustain level is glided to
+	over a few milliseconds.
+
+	Takes juce::ADSR::Parameters, times in seconds and sustain as a level.
+	Float or double, the level and the recursion are kept in SampleType.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+
+template <typename SampleType>
+class Envelope {
+public:
+	void setSampleRate(double newSampleRate) noexcept { sampleRate = newSampleRate; }
+
+	//Applies from the next segment, except a new sustain level which is glided to
+	void setParameters(const juce::ADSR::Parameters& newParameters) noexcept;
+
+	void noteOn() noexcept;
+	void noteOff() noexcept;
+
+	//Silent straight away
+	void reset() noexcept;
+
+	bool isActive() const noexcept { return stage != Stage::Idle; }
+
+	//Writes the next numSamples levels into gains
+	void render(SampleType* gains, int numSamples) noexcept;
+
+	//Moves on numSamples without writing them, returns the level it started from. For control rate
+	SampleType advance(int numSamples) noexcept;
+
+private:
+	enum class Stage { Idle, Attack, Decay, Sustain, Release };
+
+	juce::ADSR::Parameters parameters;
+	double sampleRate = 44100.0;
+
+	Stage stage = Stage::Idle;
+	SampleType level = 0;
+
+	//Current segment
+	SampleType target = 0;
+	SampleType coefficient = 0;
+	SampleType base = 0;
+	int remaining = 0;
+
+	//Aims this far past the target, as a fraction of the distance. Smaller is more exponential
+	static constexpr SampleType attackOvershoot = (SampleType)0.3;
+	static constexpr SampleType decayOvershoot = (SampleType)0.0001;
+
+	void startSegment(Stage newStage, SampleType newTarget, float seconds, SampleType overshoot) noexcept;
+
+	//Lands on the target and starts whatever comes next
+	void endSegment() noexcept;
+};
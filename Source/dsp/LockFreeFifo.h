@@ -0,0 +1,49 @@
+/*
+  ==============================================================================
+
+    LockFreeFifo.h
+
+	Fixed capacity single producer, single consumer queue on juce::AbstractFifo.
+	Neither side ever waits: push fails when the queue is full and pop fails
+	when it is empty. Meant for handing small trivially copyable records from
+	the audio thread to the message thread.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+
+template <typename Type, int Capacity>
+class LockFreeFifo {
+public:
+	//Producer side. Drops the item rather than wait when the consumer is behind
+	bool push(const Type& item) noexcept {
+		int start1, size1, start2, size2;
+		fifo.prepareToWrite(1, start1, size1, start2, size2);
+		if (size1 + size2 == 0) return false;
+
+		items[(size_t)(size1 > 0 ? start1 : start2)] = item;
+		fifo.finishedWrite(1);
+		return true;
+	}
+
+	//Consumer side
+	bool pop(Type& item) noexcept {
+		int start1, size1, start2, size2;
+		fifo.prepareToRead(1, start1, size1, start2, size2);
+		if (size1 + size2 == 0) return false;
+
+		item = items[(size_t)(size1 > 0 ? start1 : start2)];
+		fifo.finishedRead(1);
+		return true;
+	}
+
+	int getNumReady() const noexcept { return fifo.getNumReady(); }
+
+private:
+	static_assert(std::is_trivially_copyable<Type>::value, "Items are copied in and out by value");
+
+	juce::AbstractFifo fifo{ Capacity };
+	std::array<Type, (size_t)Capacity> items{};
+};
@@ -0,0 +1,144 @@
+/*
+  ==============================================================================
+
+    ModMatrix.cpp
+
+  ==============================================================================
+*/
+
+#include "ModMatrix.h"
+
+int ModMatrix::getControllerIndex(int controllerNumber) noexcept {
+	switch (controllerNumber) {
+	case 1: return ModSource::Mod_Wheel - ModSource::Mod_Wheel;
+	case 2: return ModSource::Breath - ModSource::Mod_Wheel;
+	case 11: return ModSource::Expression - ModSource::Mod_Wheel;
+	default: return -1;
+	}
+}
+
+void ModMatrix::noteOn(float velocity, int pitchWheelPosition, const float* controllerValues) noexcept {
+	setSource(ModSource::Velocity, velocity);
+	setPitchWheel(pitchWheelPosition);
+
+	for (int i = 0; i < numControllers; i++)
+		setSource(ModSource::Mod_Wheel + i, controllerValues != nullptr ? controllerValues[i] : 0.0f);
+
+	for (auto& phase : lfoPhases)
+		phase = 0.0f;
+}
+
+void ModMatrix::setPitchWheel(int position) noexcept {
+	//14 bit, centred on 8192
+	setSource(ModSource::Pitch_Wheel, juce::jlimit(-1.0f, 1.0f, (float)(position - 8192) / 8192.0f));
+}
+
+void ModMatrix::setController(int controllerNumber, int value) noexcept {
+	const int index = getControllerIndex(controllerNumber);
+	if (index >= 0)
+		setSource(ModSource::Mod_Wheel + index, (float)value / 127.0f);
+}
+
+void ModMatrix::setSource(int source, float value) noexcept {
+	if (sources[source] == value) return;
+
+	sources[source] = value;
+	version++;
+}
+
+void ModMatrix::setParameters(const ParameterSnapshot& parameters) noexcept {
+	const auto* newSlots = parameters.getModSlots();
+
+	for (int i = 0; i < MOD_SLOTS; i++) {
+		if (newSlots[i].source != slots[i].source || newSlots[i].destination != slots[i].destination || newSlots[i].amount != slots[i].amount) {
+			version++;
+			break;
+		}
+	}
+
+	std::copy(newSlots, newSlots + MOD_SLOTS, slots);
+	std::copy(parameters.getLfos(), parameters.getLfos() + NUM_LFOS, lfos);
+}
+
+bool ModMatrix::modulatesPartials() const noexcept {
+	for (auto& slot : slots) {
+		if (slot.amount == 0.0f || slot.source == ModSource::None) continue;
+		if (!isPartialDestination(slot.destination) && slot.destination != ModDestination::Pitch) continue;
+
+		//LFOs and the envelope move on their own, the rest only matter while they're off 0
+		if (isMovingSource(slot.source) || sources[slot.source] != 0.0f)
+			return true;
+	}
+
+	return false;
+}
+
+bool ModMatrix::movesPartials() const noexcept {
+	for (auto& slot : slots) {
+		if (slot.amount == 0.0f || !isMovingSource(slot.source)) continue;
+
+		if (isPartialDestination(slot.destination) || slot.destination == ModDestination::Pitch)
+			return true;
+	}
+
+	return false;
+}
+
+float ModMatrix::getLfoValue(int shape, float phase) noexcept {
+	switch (shape) {
+	case LfoShape::Triangle: return 1.0f - 4.0f * std::abs(phase - 0.5f);
+	case LfoShape::Saw: return 2.0f * phase - 1.0f;
+	case LfoShape::Square: return phase < 0.5f ? 1.0f : -1.0f;
+	default: return std::sin(juce::MathConstants<float>::twoPi * phase);
+	}
+}
+
+void ModMatrix::evaluate(float filterEnvelope, int numSamples) noexcept {
+	sources[ModSource::Filter_Envelope] = filterEnvelope;
+
+	for (int lfo = 0; lfo < NUM_LFOS; lfo++) {
+		evaluatedPhases[lfo] = lfoPhases[lfo];
+		sources[ModSource::Lfo_1 + lfo] = getLfoValue(lfos[lfo].shape, lfoPhases[lfo]);
+
+		//Free running over the note, in whole steps
+		float phase = lfoPhases[lfo] + (float)(lfos[lfo].rate * numSamples / sampleRate);
+		lfoPhases[lfo] = phase - std::floor(phase);
+	}
+
+	evaluateSlots();
+}
+
+void ModMatrix::evaluateSlots() noexcept {
+	std::fill(std::begin(uniform), std::end(uniform), 0.0f);
+	numSpreadSlots = 0;
+
+	for (int i = 0; i < MOD_SLOTS; i++) {
+		const auto& slot = slots[i];
+		if (slot.amount == 0.0f || slot.source == ModSource::None || slot.destination == ModDestination::None) continue;
+
+		//Staggered LFOs are left to getPartialModulation
+		const int lfo = slot.source - ModSource::Lfo_1;
+		if (lfo >= 0 && lfo < NUM_LFOS && lfos[lfo].spread != 0.0f && isPartialDestination(slot.destination)) {
+			spreadSlots[numSpreadSlots++] = i;
+			continue;
+		}
+
+		uniform[slot.destination] += slot.amount * sources[slot.source];
+	}
+}
+
+float ModMatrix::getPartialModulation(int destination, int partial, int numPartials) const noexcept {
+	float modulation = uniform[destination];
+
+	for (int i = 0; i < numSpreadSlots; i++) {
+		const auto& slot = slots[spreadSlots[i]];
+		if (slot.destination != destination) continue;
+
+		//Spread 1 lays the partials out over one whole cycle
+		const int lfo = slot.source - ModSource::Lfo_1;
+		float phase = evaluatedPhases[lfo] + lfos[lfo].spread * (float)partial / (float)juce::jmax(numPartials, 1);
+		modulation += slot.amount * getLfoValue(lfos[lfo].shape, phase - std::floor(phase));
+	}
+
+	return modulation;
+}
@@ -0,0 +1,115 @@
+/*
+  ==============================================================================
+
+    ModMatrix.h
+
+	Modulation matrix for one voice.
+
+	MOD_SLOTS slots each route a source (ModSource) to a destination
+	(ModDestination) at an amount. Sources are two LFOs, the filter envelope,
+	velocity, the pitch wheel and the mod wheel, breath and expression
+	controllers. Destinations are every partial's volume, every partial's
+	distance from the fundamental, the filter cutoff and pitch.
+
+	Everything is evaluated at control rate, once every CONTROL_SAMPLES. The
+	voice then ramps partial gains to the new values over the step, so the
+	cost is a small fraction of running the matrix per sample. Only the LFOs
+	and the filter envelope move by themselves, so only they make the voice
+	step its partials. Velocity, wheels and controllers hold still between
+	changes, and the partials are redone once per change.
+
+	LFOs restart with each note. Their spread staggers the phase partial by
+	partial, so one LFO on the partial volumes makes the spectrum ripple
+	instead of the whole voice pulsing. Every other source moves every
+	partial by the same amount.
+
+	Controllers arrive at the voices playing on their channel. A voice
+	starting later picks them up from the ControllerState the synth keeps.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+#include "ParameterSnapshot.h"
+
+class ModMatrix {
+public:
+	//Controllers the matrix reads, Mod_Wheel onwards in ModSource order
+	static constexpr int numControllers = ModSource::Num_Sources - ModSource::Mod_Wheel;
+
+	//Index among the matrix's controllers of a MIDI controller number, -1 if it isn't one
+	static int getControllerIndex(int controllerNumber) noexcept;
+
+	//Last value of each matrix controller per MIDI channel, 0 to 1. Kept by the synth
+	struct ControllerState {
+		float values[16][numControllers] = {};
+	};
+
+	void prepare(double newSampleRate) noexcept { sampleRate = newSampleRate; }
+
+	//Audio thread, at the start of a note. Restarts the LFOs
+	void noteOn(float velocity, int pitchWheelPosition, const float* controllerValues) noexcept;
+
+	void setPitchWheel(int position) noexcept;
+	void setController(int controllerNumber, int value) noexcept;
+
+	//Audio thread, once per chunk. Slots and LFO settings
+	void setParameters(const ParameterSnapshot& parameters) noexcept;
+
+	//A slot moves the partials or the pitch
+	bool modulatesPartials() const noexcept;
+
+	//One of those slots has a source that moves by itself, so they have to be updated every step
+	bool movesPartials() const noexcept;
+
+	//Bumped whenever the slots change, or a source that only changes when told to (velocity, wheels,
+	//controllers) does
+	juce::uint32 getVersion() const noexcept { return version; }
+
+	//Evaluates every slot at the start of a step, with the filter envelope's level there,
+	//then moves the LFOs on numSamples
+	void evaluate(float filterEnvelope, int numSamples) noexcept;
+
+	//Evaluates every slot again with the sources as they are, moving nothing
+	void evaluateSlots() noexcept;
+
+	float getCutoffOctaves() const noexcept { return uniform[ModDestination::Filter_Cutoff] * MOD_CUTOFF_OCTAVES; }
+	float getPitchRatio() const noexcept { return std::exp2(uniform[ModDestination::Pitch] * (MOD_PITCH_SEMITONES / 12.0f)); }
+
+	//Summed modulation of a partial destination for partial 1 to numPartials, -1 to 1 per unit of amount
+	float getPartialModulation(int destination, int partial, int numPartials) const noexcept;
+
+private:
+	double sampleRate = 44100.0;
+
+	ParameterSnapshot::ModSlot slots[MOD_SLOTS];
+	ParameterSnapshot::LfoSettings lfos[NUM_LFOS];
+
+	//Current value of every source, LFOs at spread 0
+	float sources[ModSource::Num_Sources] = {};
+	juce::uint32 version = 0;
+
+	//LFO phases, 0 to 1, now and where the last evaluate saw them
+	float lfoPhases[NUM_LFOS] = {};
+	float evaluatedPhases[NUM_LFOS] = {};
+
+	//Modulation that is the same for every partial, per destination. From the last evaluate
+	float uniform[ModDestination::Num_Destinations] = {};
+
+	//LFO slots with a spread, worked out per partial
+	int spreadSlots[MOD_SLOTS] = {};
+	int numSpreadSlots = 0;
+
+	static float getLfoValue(int shape, float phase) noexcept;
+
+	void setSource(int source, float value) noexcept;
+
+	static bool isMovingSource(int source) noexcept {
+		return source == ModSource::Lfo_1 || source == ModSource::Lfo_2 || source == ModSource::Filter_Envelope;
+	}
+
+	static bool isPartialDestination(int destination) noexcept {
+		return destination == ModDestination::Partial_Volume || destination == ModDestination::Partial_Distance;
+	}
+};
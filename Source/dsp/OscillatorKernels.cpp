@@ -0,0 +1,458 @@
+/*
+  ==============================================================================
+
+    OscillatorKernels.cpp
+
+  ==============================================================================
+*/
+
+#include "OscillatorKernels.h"
+
+//64 bit only, the gathers take each partial's table pointer as a 64 bit address
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+ #define OSCILLATOR_KERNELS_X86 1
+ #define OSCILLATOR_KERNELS_TARGET(isa) __attribute__((target(isa)))
+ #define OSCILLATOR_KERNELS_INLINE __attribute__((always_inline)) inline
+ #include <immintrin.h>
+#elif defined(_MSC_VER) && defined(_M_X64) && !defined(_M_ARM64EC)
+ //MSVC takes any set's intrinsics without /arch, and only emits them where they're written
+ #define OSCILLATOR_KERNELS_X86 1
+ #define OSCILLATOR_KERNELS_TARGET(isa)
+ #define OSCILLATOR_KERNELS_INLINE __forceinline
+ #include <immintrin.h>
+ #include <intrin.h>
+#else
+ #define OSCILLATOR_KERNELS_X86 0
+#endif
+
+namespace {
+	//Runs before anything renders, so the audio thread only ever reads the results
+	struct CpuFeatures {
+		bool supported[KernelVariant::Num_Variants] = { true };
+
+		CpuFeatures() {
+		#if OSCILLATOR_KERNELS_X86 && defined(_MSC_VER) && !defined(__clang__)
+			int info[4];
+			__cpuid(info, 0);
+			const int maxLeaf = info[0];
+
+			//The OS has to save the wider registers too, which XCR0 says
+			__cpuid(info, 1);
+			const bool fma = (info[2] & (1 << 12)) != 0;
+			const bool osSaves = (info[2] & (1 << 27)) != 0;
+			const unsigned long long xcr0 = osSaves ? _xgetbv(0) : 0;
+			const bool ymmSaved = (xcr0 & 0x06) == 0x06;
+			const bool zmmSaved = (xcr0 & 0xe6) == 0xe6;
+
+			if (maxLeaf >= 7) {
+				__cpuidex(info, 7, 0);
+				supported[KernelVariant::Avx2] = ymmSaved && fma && (info[1] & (1 << 5)) != 0;
+				supported[KernelVariant::Avx512] = zmmSaved && (info[1] & (1 << 16)) != 0;
+			}
+		#elif OSCILLATOR_KERNELS_X86
+			//These check the OS saves the wider registers too
+			__builtin_cpu_init();
+			supported[KernelVariant::Avx2] = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+			supported[KernelVariant::Avx512] = __builtin_cpu_supports("avx512f");
+		#endif
+		}
+	};
+
+	const CpuFeatures cpuFeatures;
+
+	int getStartupVariant() {
+		const int forced = OscillatorKernels::findVariant(juce::SystemStats::getEnvironmentVariable("ADDITIVE_SYNTH_KERNEL", {}));
+		return forced >= 0 && OscillatorKernels::isSupported(forced) ? forced : OscillatorKernels::getBestVariant();
+	}
+
+	std::atomic<int> activeVariant{ getStartupVariant() };
+
+#if OSCILLATOR_KERNELS_X86
+	//Keeps base + offset + index inside a signed 32 bit gather index, with room for the table
+	constexpr std::intptr_t maxTableOffset = std::intptr_t(1) << 29;
+
+	//Each partial's table as an offset in floats from the first partial's table, into args.tableOffsets.
+	//False if one is out of a 32 bit gather's reach
+	bool findTableOffsets(const OscillatorKernels::RenderArgs& args, int numSlots, const float*& base) noexcept {
+		base = args.tables[args.tableIds[0]];
+		const auto baseAddress = reinterpret_cast<std::intptr_t>(base);
+
+		for (int k = 0; k < numSlots; k++) {
+			const auto bytes = reinterpret_cast<std::intptr_t>(args.tables[args.tableIds[k]]) - baseAddress;
+			if (bytes % (std::intptr_t)sizeof(float) != 0) return false;
+
+			const auto offset = bytes / (std::intptr_t)sizeof(float);
+			if (offset < -maxTableOffset || offset > maxTableOffset) return false;
+
+			args.tableOffsets[k] = (int)offset;
+		}
+
+		return true;
+	}
+
+	//Table values neighbour floats on from each lane's byte address, 4 lanes in each half
+	OSCILLATOR_KERNELS_TARGET("avx2,fma")
+	OSCILLATOR_KERNELS_INLINE __m256 gatherAvx2(__m256i low, __m256i high, int neighbour) noexcept {
+		const __m256i offset = _mm256_set1_epi64x((long long)neighbour * (long long)sizeof(float));
+		const __m128 lowValues = _mm256_i64gather_ps(static_cast<const float*>(nullptr), _mm256_add_epi64(low, offset), 1);
+		const __m128 highValues = _mm256_i64gather_ps(static_cast<const float*>(nullptr), _mm256_add_epi64(high, offset), 1);
+		return _mm256_insertf128_ps(_mm256_castps128_ps256(lowValues), highValues, 1);
+	}
+
+	//The same, 8 lanes in each half
+	OSCILLATOR_KERNELS_TARGET("avx512f")
+	OSCILLATOR_KERNELS_INLINE __m512 gatherAvx512(__m512i low, __m512i high, int neighbour) noexcept {
+		const __m512i offset = _mm512_set1_epi64((long long)neighbour * (long long)sizeof(float));
+		const __m256 lowValues = _mm512_i64gather_ps(_mm512_add_epi64(low, offset), nullptr, 1);
+		const __m256 highValues = _mm512_i64gather_ps(_mm512_add_epi64(high, offset), nullptr, 1);
+		return _mm512_castpd_ps(_mm512_insertf64x4(_mm512_castps_pd(_mm512_castps256_ps512(lowValues)), _mm256_castps_pd(highValues), 1));
+	}
+
+	//The same loop as PartialBank::render, 8 partials a register. With fullPointers each lane gathers
+	//from its partial's own table pointer, otherwise from base plus its table offset
+	template <bool ramping, bool fullPointers>
+	OSCILLATOR_KERNELS_TARGET("avx2,fma")
+	void renderAvx2(const OscillatorKernels::RenderArgs& args, const float* base, int numSlots) noexcept {
+		const __m128i shift = _mm_cvtsi32_si128(args.indexShift);
+		const __m256i fractionMask = _mm256_set1_epi32((int)args.fractionMask);
+		const __m256 fractionScale = _mm256_set1_ps(args.fractionScale);
+		const __m256i previous = _mm256_set1_epi32(-1);
+		const __m256i next = _mm256_set1_epi32(1);
+		const __m256i afterNext = _mm256_set1_epi32(2);
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 half = _mm256_set1_ps(0.5f);
+
+		juce::uint32* phases = args.phases;
+		float* gains = args.gains;
+
+		for (int sample = 0; sample < args.numSamples; sample++) {
+			__m256 sum = _mm256_setzero_ps();
+
+			for (int k = 0; k < numSlots; k += 8) {
+				const __m256i phase = _mm256_load_si256(reinterpret_cast<const __m256i*>(phases + k));
+				__m256 before, y0, y1, after;
+
+				if constexpr (fullPointers) {
+					//Byte address of each partial's y0
+					const __m256i index = _mm256_srl_epi32(phase, shift);
+					const auto* pointers = reinterpret_cast<const __m256i*>(args.tablePointers + k);
+					const __m256i low = _mm256_add_epi64(_mm256_load_si256(pointers),
+														 _mm256_slli_epi64(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(index)), 2));
+					const __m256i high = _mm256_add_epi64(_mm256_load_si256(pointers + 1),
+														  _mm256_slli_epi64(_mm256_cvtepu32_epi64(_mm256_extracti128_si256(index, 1)), 2));
+
+					before = gatherAvx2(low, high, -1);
+					y0 = gatherAvx2(low, high, 0);
+					y1 = gatherAvx2(low, high, 1);
+					after = gatherAvx2(low, high, 2);
+				}
+				else {
+					const __m256i index = _mm256_add_epi32(_mm256_srl_epi32(phase, shift),
+														   _mm256_load_si256(reinterpret_cast<const __m256i*>(args.tableOffsets + k)));
+
+					before = _mm256_i32gather_ps(base, _mm256_add_epi32(index, previous), 4);
+					y0 = _mm256_i32gather_ps(base, index, 4);
+					y1 = _mm256_i32gather_ps(base, _mm256_add_epi32(index, next), 4);
+					after = _mm256_i32gather_ps(base, _mm256_add_epi32(index, afterNext), 4);
+				}
+
+				//Same cubic Hermite as SynthSound::interpolate
+				const __m256 x = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_and_si256(phase, fractionMask)), fractionScale);
+				const __m256 rest = _mm256_sub_ps(one, x);
+				const __m256 d = _mm256_sub_ps(y1, y0);
+				const __m256 m0 = _mm256_mul_ps(_mm256_sub_ps(y1, before), half);
+				const __m256 m1 = _mm256_mul_ps(_mm256_sub_ps(after, y0), half);
+				const __m256 bend = _mm256_sub_ps(_mm256_mul_ps(_mm256_sub_ps(m0, d), rest), _mm256_mul_ps(_mm256_sub_ps(m1, d), x));
+				const __m256 value = _mm256_add_ps(y0, _mm256_mul_ps(x, _mm256_add_ps(d, _mm256_mul_ps(rest, bend))));
+
+				const __m256 level = _mm256_load_ps(gains + k);
+				sum = _mm256_fmadd_ps(value, level, sum);
+
+				if (ramping)
+					_mm256_store_ps(gains + k, _mm256_add_ps(level, _mm256_load_ps(args.gainSteps + k)));
+
+				//Wraps by overflowing
+				_mm256_store_si256(reinterpret_cast<__m256i*>(phases + k),
+								   _mm256_add_epi32(phase, _mm256_load_si256(reinterpret_cast<const __m256i*>(args.deltas + k))));
+			}
+
+			__m128 total = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+			total = _mm_add_ps(total, _mm_movehl_ps(total, total));
+			total = _mm_add_ss(total, _mm_movehdup_ps(total));
+			_mm_store_ss(args.output + sample, _mm_mul_ss(total, _mm_load_ss(args.envelope + sample)));
+		}
+
+		//GCC and Clang add this themselves, MSVC's baseline code after the call may be legacy SSE
+		_mm256_zeroupper();
+	}
+
+	//The same loop again, 16 partials a register
+	template <bool ramping, bool fullPointers>
+	OSCILLATOR_KERNELS_TARGET("avx512f")
+	void renderAvx512(const OscillatorKernels::RenderArgs& args, const float* base, int numSlots) noexcept {
+		const __m128i shift = _mm_cvtsi32_si128(args.indexShift);
+		const __m512i fractionMask = _mm512_set1_epi32((int)args.fractionMask);
+		const __m512 fractionScale = _mm512_set1_ps(args.fractionScale);
+		const __m512i previous = _mm512_set1_epi32(-1);
+		const __m512i next = _mm512_set1_epi32(1);
+		const __m512i afterNext = _mm512_set1_epi32(2);
+		const __m512 one = _mm512_set1_ps(1.0f);
+		const __m512 half = _mm512_set1_ps(0.5f);
+
+		juce::uint32* phases = args.phases;
+		float* gains = args.gains;
+
+		for (int sample = 0; sample < args.numSamples; sample++) {
+			__m512 sum = _mm512_setzero_ps();
+
+			for (int k = 0; k < numSlots; k += 16) {
+				const __m512i phase = _mm512_load_si512(phases + k);
+				__m512 before, y0, y1, after;
+
+				if constexpr (fullPointers) {
+					const __m512i index = _mm512_srl_epi32(phase, shift);
+					const __m512i low = _mm512_add_epi64(_mm512_load_si512(args.tablePointers + k),
+														 _mm512_slli_epi64(_mm512_cvtepu32_epi64(_mm512_castsi512_si256(index)), 2));
+					const __m512i high = _mm512_add_epi64(_mm512_load_si512(args.tablePointers + k + 8),
+														  _mm512_slli_epi64(_mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(index, 1)), 2));
+
+					before = gatherAvx512(low, high, -1);
+					y0 = gatherAvx512(low, high, 0);
+					y1 = gatherAvx512(low, high, 1);
+					after = gatherAvx512(low, high, 2);
+				}
+				else {
+					const __m512i index = _mm512_add_epi32(_mm512_srl_epi32(phase, shift), _mm512_load_si512(args.tableOffsets + k));
+
+					before = _mm512_i32gather_ps(_mm512_add_epi32(index, previous), base, 4);
+					y0 = _mm512_i32gather_ps(index, base, 4);
+					y1 = _mm512_i32gather_ps(_mm512_add_epi32(index, next), base, 4);
+					after = _mm512_i32gather_ps(_mm512_add_epi32(index, afterNext), base, 4);
+				}
+
+				const __m512 x = _mm512_mul_ps(_mm512_cvtepi32_ps(_mm512_and_si512(phase, fractionMask)), fractionScale);
+				const __m512 rest = _mm512_sub_ps(one, x);
+				const __m512 d = _mm512_sub_ps(y1, y0);
+				const __m512 m0 = _mm512_mul_ps(_mm512_sub_ps(y1, before), half);
+				const __m512 m1 = _mm512_mul_ps(_mm512_sub_ps(after, y0), half);
+				const __m512 bend = _mm512_sub_ps(_mm512_mul_ps(_mm512_sub_ps(m0, d), rest), _mm512_mul_ps(_mm512_sub_ps(m1, d), x));
+				const __m512 value = _mm512_add_ps(y0, _mm512_mul_ps(x, _mm512_add_ps(d, _mm512_mul_ps(rest, bend))));
+
+				const __m512 level = _mm512_load_ps(gains + k);
+				sum = _mm512_fmadd_ps(value, level, sum);
+
+				if (ramping)
+					_mm512_store_ps(gains + k, _mm512_add_ps(level, _mm512_load_ps(args.gainSteps + k)));
+
+				_mm512_store_si512(phases + k, _mm512_add_epi32(phase, _mm512_load_si512(args.deltas + k)));
+			}
+
+			_mm_store_ss(args.output + sample, _mm_mul_ss(_mm_set_ss(_mm512_reduce_add_ps(sum)), _mm_load_ss(args.envelope + sample)));
+		}
+
+		_mm256_zeroupper();
+	}
+
+	template <bool fullPointers>
+	void renderWith(int variant, const OscillatorKernels::RenderArgs& args, const float* base, int numSlots) noexcept {
+		if (variant == KernelVariant::Avx512) {
+			if (args.ramping) renderAvx512<true, fullPointers>(args, base, numSlots);
+			else renderAvx512<false, fullPointers>(args, base, numSlots);
+		}
+		else {
+			if (args.ramping) renderAvx2<true, fullPointers>(args, base, numSlots);
+			else renderAvx2<false, fullPointers>(args, base, numSlots);
+		}
+	}
+
+	//Coefficient and offset for lanes steps of the segment at once, worked out in double
+	void getSegmentStride(float coefficient, float base, int lanes, float& strideCoefficient, float& strideBase) noexcept {
+		double power = 1.0, offset = 0.0;
+		for (int i = 0; i < lanes; i++) {
+			offset = offset * coefficient + base;
+			power *= coefficient;
+		}
+
+		strideCoefficient = (float)power;
+		strideBase = (float)offset;
+	}
+
+	//The first register's samples one at a time, then every register from the one before it
+	OSCILLATOR_KERNELS_TARGET("avx2,fma")
+	void renderSegmentAvx2(float* gains, int numSamples, float& value, float coefficient, float base) noexcept {
+		for (int i = 0; i < 8; i++) {
+			value = value * coefficient + base;
+			gains[i] = value;
+		}
+
+		float strideCoefficient, strideBase;
+		getSegmentStride(coefficient, base, 8, strideCoefficient, strideBase);
+		const __m256 scale = _mm256_set1_ps(strideCoefficient);
+		const __m256 offset = _mm256_set1_ps(strideBase);
+
+		__m256 levels = _mm256_loadu_ps(gains);
+		int sample = 8;
+		for (; sample + 8 <= numSamples; sample += 8) {
+			levels = _mm256_fmadd_ps(levels, scale, offset);
+			_mm256_storeu_ps(gains + sample, levels);
+		}
+
+		value = gains[sample - 1];
+		for (; sample < numSamples; sample++) {
+			value = value * coefficient + base;
+			gains[sample] = value;
+		}
+
+		_mm256_zeroupper();
+	}
+
+	OSCILLATOR_KERNELS_TARGET("avx512f")
+	void renderSegmentAvx512(float* gains, int numSamples, float& value, float coefficient, float base) noexcept {
+		for (int i = 0; i < 16; i++) {
+			value = value * coefficient + base;
+			gains[i] = value;
+		}
+
+		float strideCoefficient, strideBase;
+		getSegmentStride(coefficient, base, 16, strideCoefficient, strideBase);
+		const __m512 scale = _mm512_set1_ps(strideCoefficient);
+		const __m512 offset = _mm512_set1_ps(strideBase);
+
+		__m512 levels = _mm512_loadu_ps(gains);
+		int sample = 16;
+		for (; sample + 16 <= numSamples; sample += 16) {
+			levels = _mm512_fmadd_ps(levels, scale, offset);
+			_mm512_storeu_ps(gains + sample, levels);
+		}
+
+		value = gains[sample - 1];
+		for (; sample < numSamples; sample++) {
+			value = value * coefficient + base;
+			gains[sample] = value;
+		}
+
+		_mm256_zeroupper();
+	}
+
+	OSCILLATOR_KERNELS_TARGET("avx2,fma")
+	void mixAvx2(const float* source, float* const* outputs, int numChannels, int startSample, int numSamples) noexcept {
+		int sample = 0;
+		for (; sample + 8 <= numSamples; sample += 8) {
+			const __m256 voice = _mm256_loadu_ps(source + sample);
+			for (int channel = 0; channel < numChannels; channel++) {
+				float* output = outputs[channel] + startSample + sample;
+				_mm256_storeu_ps(output, _mm256_add_ps(_mm256_loadu_ps(output), voice));
+			}
+		}
+
+		for (; sample < numSamples; sample++)
+			for (int channel = 0; channel < numChannels; channel++)
+				outputs[channel][startSample + sample] += source[sample];
+
+		_mm256_zeroupper();
+	}
+
+	OSCILLATOR_KERNELS_TARGET("avx512f")
+	void mixAvx512(const float* source, float* const* outputs, int numChannels, int startSample, int numSamples) noexcept {
+		int sample = 0;
+		for (; sample + 16 <= numSamples; sample += 16) {
+			const __m512 voice = _mm512_loadu_ps(source + sample);
+			for (int channel = 0; channel < numChannels; channel++) {
+				float* output = outputs[channel] + startSample + sample;
+				_mm512_storeu_ps(output, _mm512_add_ps(_mm512_loadu_ps(output), voice));
+			}
+		}
+
+		for (; sample < numSamples; sample++)
+			for (int channel = 0; channel < numChannels; channel++)
+				outputs[channel][startSample + sample] += source[sample];
+
+		_mm256_zeroupper();
+	}
+#endif
+}
+
+bool OscillatorKernels::isSupported(int variant) noexcept {
+	return variant >= 0 && variant < KernelVariant::Num_Variants && cpuFeatures.supported[variant];
+}
+
+int OscillatorKernels::getBestVariant() noexcept {
+	for (int variant = KernelVariant::Num_Variants - 1; variant > KernelVariant::Generic; variant--)
+		if (isSupported(variant))
+			return variant;
+
+	return KernelVariant::Generic;
+}
+
+int OscillatorKernels::getVariant() noexcept {
+	return activeVariant.load(std::memory_order_relaxed);
+}
+
+bool OscillatorKernels::setVariant(int variant) noexcept {
+	if (!isSupported(variant)) return false;
+
+	activeVariant.store(variant, std::memory_order_relaxed);
+	return true;
+}
+
+int OscillatorKernels::findVariant(const juce::String& name) {
+	return KernelVariant::getNames().indexOf(name.trim(), true);
+}
+
+bool OscillatorKernels::render(int variant, const RenderArgs& args) noexcept {
+#if OSCILLATOR_KERNELS_X86
+	if (variant == KernelVariant::Generic || !isSupported(variant) || args.numPartials <= 0) return false;
+
+	//The padding lanes are silent, so a variant can run to the end of its last register
+	const int width = variant == KernelVariant::Avx512 ? 16 : 8;
+	const int numSlots = ((args.numPartials + width - 1) / width) * width;
+
+	//Offsets from one base take half the gathers. Tables further apart than those reach are
+	//gathered from each partial's own pointer instead
+	const float* base = nullptr;
+	if (findTableOffsets(args, numSlots, base)) {
+		renderWith<false>(variant, args, base, numSlots);
+	}
+	else {
+		for (int k = 0; k < numSlots; k++)
+			args.tablePointers[k] = args.tables[args.tableIds[k]];
+
+		renderWith<true>(variant, args, nullptr, numSlots);
+	}
+
+	return true;
+#else
+	juce::ignoreUnused(variant, args);
+	return false;
+#endif
+}
+
+bool OscillatorKernels::renderSegment(int variant, float* gains, int numSamples, float& value, float coefficient, float base) noexcept {
+#if OSCILLATOR_KERNELS_X86
+	if (variant == KernelVariant::Generic || !isSupported(variant)) return false;
+
+	//Needs a register past the serial first one to step
+	const int width = variant == KernelVariant::Avx512 ? 16 : 8;
+	if (numSamples < 2 * width) return false;
+
+	if (variant == KernelVariant::Avx512) renderSegmentAvx512(gains, numSamples, value, coefficient, base);
+	else renderSegmentAvx2(gains, numSamples, value, coefficient, base);
+	return true;
+#else
+	juce::ignoreUnused(variant, gains, numSamples, value, coefficient, base);
+	return false;
+#endif
+}
+
+bool OscillatorKernels::mix(int variant, const float* source, float* const* outputs, int numChannels, int startSample, int numSamples) noexcept {
+#if OSCILLATOR_KERNELS_X86
+	if (variant == KernelVariant::Generic || !isSupported(variant)) return false;
+
+	if (variant == KernelVariant::Avx512) mixAvx512(source, outputs, numChannels, startSample, numSamples);
+	else mixAvx2(source, outputs, numChannels, startSample, numSamples);
+	return true;
+#else
+	juce::ignoreUnused(variant, source, outputs, numChannels, startSample, numSamples);
+	return false;
+#endif
+}
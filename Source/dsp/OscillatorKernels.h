@@ -0,0 +1,100 @@
+/*
+  ==============================================================================
+
+    OscillatorKernels.h
+
+	PartialBank's render loop built again for wider instruction sets than the
+	plugin is compiled for, with the variant picked at startup from what the
+	CPU supports. So are the two other per sample loops of a float voice, its
+	amplitude envelope and its mix into the output.
+
+	Everything else is built for the baseline ISA, where SIMDRegister is four
+	lanes and has no gather. The AVX2 and AVX-512 loops here use their sets
+	in those functions alone, so one binary carries every variant and only
+	runs the ones the host can. GCC and Clang compile them for their sets by
+	a target attribute, MSVC takes the intrinsics without a flag. They take
+	8 or 16 partials a step, and fetch the four table neighbours of each
+	with hardware gathers.
+
+	A 32 bit gather indexes from one base pointer, so every partial's table
+	is turned into an offset from the first partial's. When the tables are
+	further apart than that reaches, as the sine and the heap allocated
+	wavetables usually are, each lane gathers from its own partial's table
+	pointer instead, as a full 64 bit address. That takes twice the gather
+	instructions, but no table set makes a block fall back to the generic
+	loop.
+
+	An envelope segment is a recursion along time, but a fixed one, so a
+	register holds 8 or 16 consecutive samples and steps them all that many
+	samples at once, with the coefficient and offset raised to match. The
+	mix adds the voice to every channel with one read of it, at the full
+	width where juce::FloatVectorOperations has the baseline's four lanes.
+	The filters' coefficients move every control step, and a double voice
+	has no float loops to widen, so those stay on the generic build.
+
+	Tests can force a variant with setVariant, or for a whole process with
+	the ADDITIVE_SYNTH_KERNEL environment variable (a KernelVariant name).
+	The wider variants are built for x86-64 by GCC, Clang and MSVC, elsewhere
+	generic is the only one.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+
+namespace OscillatorKernels {
+	//One PartialBank::render call. The arrays are the bank's packed, aligned ones, padded with silent
+	//partials to a multiple of the widest variant's register
+	struct RenderArgs {
+		const float* const* tables;
+		const int* tableIds;
+		juce::uint32* phases;
+		const juce::uint32* deltas;
+		float* gains;
+		const float* gainSteps;
+
+		//Scratch for each partial's table offset and table pointer, as long as the others
+		int* tableOffsets;
+		const float** tablePointers;
+
+		int numPartials;
+		int indexShift;
+		juce::uint32 fractionMask;
+		float fractionScale;
+
+		const float* envelope;
+		float* output;
+		int numSamples;
+		bool ramping;
+	};
+
+	//Widest register of any variant, in floats
+	constexpr int maxLanes = 16;
+
+	//Built in, and the CPU and OS run it
+	bool isSupported(int variant) noexcept;
+
+	//The widest supported variant
+	int getBestVariant() noexcept;
+
+	//The variant PartialBank renders with. The best one, unless forced
+	int getVariant() noexcept;
+
+	//Forces a variant, for testing. False, keeping the current one, if it isn't supported
+	bool setVariant(int variant) noexcept;
+
+	//KernelVariant index of a name, -1 if there's none
+	int findVariant(const juce::String& name);
+
+	//Renders the block with the variant. False, having touched nothing, for Generic or a variant
+	//the CPU doesn't run, and then PartialBank renders it
+	bool render(int variant, const RenderArgs& args) noexcept;
+
+	//numSamples steps of value = value * coefficient + base into gains, leaving value at the last.
+	//False, having touched nothing, as for render or for a segment too short to gain from it
+	bool renderSegment(int variant, float* gains, int numSamples, float& value, float coefficient, float base) noexcept;
+
+	//Adds source to each of the outputs from startSample on. False, having touched nothing, as for render
+	bool mix(int variant, const float* source, float* const* outputs, int numChannels, int startSample, int numSamples) noexcept;
+}
@@ -0,0 +1,282 @@
+/*
+  ==============================================================================
+
+    ParameterSnapshot.cpp
+
+  ==============================================================================
+*/
+
+#include "ParameterSnapshot.h"
+
+void ParameterSnapshot::initialise(APVTS& apvts) {
+	using namespace Params;
+	using APFloat = juce::AudioParameterFloat;
+	using APBool = juce::AudioParameterBool;
+	using APInt = juce::AudioParameterInt;
+	using APChoice = juce::AudioParameterChoice;
+
+	auto params = getParams();
+
+	//Hook up partial controls, as many as the layout has
+	numPartialsParam = dynamic_cast<APInt*>(apvts.getParameter(params.at(Names::Num_Partials)));
+	maxPartials = numPartialsParam->getRange().getEnd();
+
+	partialDistanceParams.clearQuick();
+	partialVolumeParams.clearQuick();
+	partialBypassParams.clearQuick();
+	partialWaveformParams.clearQuick();
+
+	for (int i = 0; i < maxPartials; i++) {
+		partialDistanceParams.add(dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Partial_Distance) + juce::String(i+1))));
+		partialVolumeParams.add(dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Partial_Volume) + juce::String(i+1))));
+		partialBypassParams.add(dynamic_cast<APBool*>(apvts.getParameter(params.at(Names::Partial_Bypass) + juce::String(i+1))));
+		partialWaveformParams.add(dynamic_cast<APChoice*>(apvts.getParameter(params.at(Names::Partial_Waveform) + juce::String(i+1))));
+	}
+
+	attackParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Envelope_Attack)));
+	decayParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Envelope_Decay)));
+	sustainParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Envelope_Sustain)));
+	releaseParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Envelope_Release)));
+
+	filterAttackParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Filter_Env_Attack)));
+	filterDecayParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Filter_Env_Decay)));
+	filterSustainParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Filter_Env_Sustain)));
+	filterReleaseParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Filter_Env_Release)));
+	filterEnvelopeAmountParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Filter_Env_Amount)));
+
+	modSourceParams.clearQuick();
+	modDestinationParams.clearQuick();
+	modAmountParams.clearQuick();
+
+	for (int i = 0; i < MOD_SLOTS; i++) {
+		modSourceParams.add(dynamic_cast<APChoice*>(apvts.getParameter(params.at(Names::Mod_Source) + juce::String(i+1))));
+		modDestinationParams.add(dynamic_cast<APChoice*>(apvts.getParameter(params.at(Names::Mod_Destination) + juce::String(i+1))));
+		modAmountParams.add(dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Mod_Amount) + juce::String(i+1))));
+	}
+
+	lfoRateParams.clearQuick();
+	lfoShapeParams.clearQuick();
+	lfoSpreadParams.clearQuick();
+
+	for (int i = 0; i < NUM_LFOS; i++) {
+		lfoRateParams.add(dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Lfo_Rate) + juce::String(i+1))));
+		lfoShapeParams.add(dynamic_cast<APChoice*>(apvts.getParameter(params.at(Names::Lfo_Shape) + juce::String(i+1))));
+		lfoSpreadParams.add(dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Lfo_Spread) + juce::String(i+1))));
+	}
+
+	synthesisModeParam = dynamic_cast<APChoice*>(apvts.getParameter(params.at(Names::Synthesis_Mode)));
+	cullNyquistParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Cull_Nyquist)));
+	cullFloorParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Cull_Floor)));
+
+	numVoicesParam = dynamic_cast<APInt*>(apvts.getParameter(params.at(Names::Num_Voices)));
+	multicoreParam = dynamic_cast<APBool*>(apvts.getParameter(params.at(Names::Multicore_Rendering)));
+
+	masterGainParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Master_Gain)));
+	filterCutoffParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Filter_Cutoff)));
+	filterResonanceParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Filter_Resonance)));
+	filterBypassParam = dynamic_cast<APBool*>(apvts.getParameter(params.at(Names::Filter_Bypass)));
+
+	//The fundamental is always there at full level
+	for (auto* values : { &ratios, &levels, &startRatios, &startLevels, &targetRatios, &targetLevels }) {
+		values->calloc((size_t)maxPartials + 1);
+		(*values)[0] = 1.0f;
+	}
+
+	waveforms.calloc((size_t)maxPartials + 1);
+	harmonics.calloc((size_t)maxPartials + 1);
+	waveforms[0] = Waveform::Sine;
+
+	//Valid before the first block
+	update();
+	jumpToTargets();
+	DBG("Initialised Parameter Snapshot");
+}
+
+void ParameterSnapshot::update() noexcept {
+	//Partials are offset by one in the parameters, the fundamental has none
+	const int newNumPartials = juce::jmin(numPartialsParam->get(), maxPartials);
+	const bool wasMoving = partialsMoving;
+
+	//Partials coming, going or changing waveform switch at the block start, the rest glide
+	bool partialsSwitched = newNumPartials != numPartials;
+	bool partialsChanged = partialsSwitched;
+	numPartials = newNumPartials;
+
+	for (int i = 1; i <= numPartials; i++) {
+		// If the frequency is being determined from the previous frequency use this
+		//float ratio = ratios[i - 1] * (1 + partialDistanceParams[i-1]->get());
+		//If the frequency is determined from the fundamental, use this
+		float ratio = 1.0f + partialDistanceParams[i-1]->get();
+
+		//Muting and the volume weighting fold into one level
+		float level = partialBypassParams[i-1]->get() ? 0.0f : partialVolumeParams[i-1]->get() / std::sqrt((float)(i + 1));
+
+		int waveform = partialWaveformParams[i-1]->getIndex();
+
+		partialsChanged = partialsChanged || ratio != targetRatios[i] || level != targetLevels[i];
+		partialsSwitched = partialsSwitched || waveform != waveforms[i];
+		startRatios[i] = targetRatios[i];
+		startLevels[i] = targetLevels[i];
+		targetRatios[i] = ratios[i] = ratio;
+		targetLevels[i] = levels[i] = level;
+		waveforms[i] = waveform;
+	}
+
+	partialsChanged = partialsChanged || partialsSwitched;
+	partialsMoving = partialsChanged && !partialsSwitched;
+
+	if (partialsSwitched) {
+		std::copy(targetRatios.get(), targetRatios.get() + numPartials + 1, startRatios.get());
+		std::copy(targetLevels.get(), targetLevels.get() + numPartials + 1, startLevels.get());
+	}
+
+	//A set still moving isn't harmonic, it gets its turn the block it settles
+	if (partialsChanged || wasMoving) {
+		if (partialsMoving) {
+			harmonicDenominator = 0;
+			highestHarmonic = 0;
+			harmonicKey = 0;
+		}
+		else {
+			findHarmonics();
+		}
+	}
+
+	if (partialsChanged)
+		partialsVersion++;
+
+	juce::ADSR::Parameters newEnvelope{ attackParam->get() + ENVELOPE_TIME_OFFSET,
+										decayParam->get() + ENVELOPE_TIME_OFFSET,
+										sustainParam->get(),
+										releaseParam->get() + ENVELOPE_TIME_OFFSET };
+
+	juce::ADSR::Parameters newFilterEnvelope{ filterAttackParam->get(),
+											  filterDecayParam->get(),
+											  filterSustainParam->get(),
+											  filterReleaseParam->get() };
+
+	auto differs = [](const juce::ADSR::Parameters& a, const juce::ADSR::Parameters& b) {
+		return a.attack != b.attack || a.decay != b.decay || a.sustain != b.sustain || a.release != b.release;
+	};
+
+	if (differs(newEnvelope, envelope) || differs(newFilterEnvelope, filterEnvelope)) {
+		envelope = newEnvelope;
+		filterEnvelope = newFilterEnvelope;
+		envelopeVersion++;
+	}
+
+	//Cheap enough to copy every block, the voices read them every step anyway
+	for (int i = 0; i < MOD_SLOTS; i++) {
+		modSlots[i].source = modSourceParams[i]->getIndex();
+		modSlots[i].destination = modDestinationParams[i]->getIndex();
+		modSlots[i].amount = modAmountParams[i]->get();
+	}
+
+	for (int i = 0; i < NUM_LFOS; i++) {
+		lfos[i].rate = lfoRateParams[i]->get();
+		lfos[i].shape = lfoShapeParams[i]->getIndex();
+		lfos[i].spread = lfoSpreadParams[i]->get();
+	}
+
+	const int newMode = synthesisModeParam->getIndex();
+	const float newNyquistFraction = cullNyquistParam->get();
+	const float newAmplitudeFloor = juce::Decibels::decibelsToGain(cullFloorParam->get(), CULL_FLOOR_MIN);
+
+	if (newMode != synthesisMode || newNyquistFraction != nyquistFraction || newAmplitudeFloor != amplitudeFloor) {
+		synthesisMode = newMode;
+		nyquistFraction = newNyquistFraction;
+		amplitudeFloor = newAmplitudeFloor;
+		renderingVersion++;
+	}
+
+	numVoices = numVoicesParam->get();
+	multicore = multicoreParam->get();
+
+	masterGain.set(masterGainParam->get());
+	filterCutoff.set(filterCutoffParam->get());
+	filterResonance.set(filterResonanceParam->get());
+	filterBypass = filterBypassParam->get();
+	filterEnvelopeAmount.set(filterEnvelopeAmountParam->get());
+}
+
+bool ParameterSnapshot::isInterpolating() const noexcept {
+	return partialsMoving || masterGain.isMoving() || filterCutoff.isMoving()
+		|| filterResonance.isMoving() || filterEnvelopeAmount.isMoving();
+}
+
+void ParameterSnapshot::setBlockPosition(float position) noexcept {
+	if (partialsMoving) {
+		for (int i = 1; i <= numPartials; i++) {
+			ratios[i] = startRatios[i] + (targetRatios[i] - startRatios[i]) * position;
+			levels[i] = startLevels[i] + (targetLevels[i] - startLevels[i]) * position;
+		}
+		partialsVersion++;
+	}
+
+	masterGain.moveTo(position);
+	filterCutoff.moveTo(position);
+	filterResonance.moveTo(position);
+	filterEnvelopeAmount.moveTo(position);
+}
+
+void ParameterSnapshot::jumpToTargets() noexcept {
+	std::copy(targetRatios.get(), targetRatios.get() + numPartials + 1, startRatios.get());
+	std::copy(targetLevels.get(), targetLevels.get() + numPartials + 1, startLevels.get());
+	partialsMoving = false;
+
+	for (auto* value : { &masterGain, &filterCutoff, &filterResonance, &filterEnvelopeAmount })
+		value->start = value->target;
+}
+
+void ParameterSnapshot::findHarmonics() noexcept {
+	harmonicDenominator = 0;
+	highestHarmonic = 0;
+	harmonicKey = 0;
+
+	//Smallest denominator that makes every audible ratio whole
+	for (int denominator = 1; denominator <= HARMONIC_MAX_DENOMINATOR && harmonicDenominator == 0; denominator++) {
+		bool whole = true;
+		int highest = 0;
+
+		for (int i = 0; i <= numPartials && whole; i++) {
+			if (targetLevels[i] == 0.0f) continue;
+
+			float scaled = targetRatios[i] * (float)denominator;
+			float rounded = std::round(scaled);
+			whole = std::abs(scaled - rounded) <= HARMONIC_RATIO_TOLERANCE * scaled;
+			harmonics[i] = (int)rounded;
+			highest = juce::jmax(highest, harmonics[i]);
+		}
+
+		//A table can't hold more than TABLE_SIZE/2 - 1 harmonics
+		if (whole && highest < TABLE_SIZE / 2) {
+			harmonicDenominator = denominator;
+			highestHarmonic = highest;
+		}
+	}
+
+	if (harmonicDenominator == 0) return;
+
+	//FNV-1a over what a baked table depends on
+	juce::uint64 hash = 14695981039346656037ull;
+	auto mix = [&hash](juce::uint32 value) {
+		for (int byte = 0; byte < 4; byte++) {
+			hash ^= (value >> (8 * byte)) & 0xff;
+			hash *= 1099511628211ull;
+		}
+	};
+
+	mix((juce::uint32)harmonicDenominator);
+	for (int i = 0; i <= numPartials; i++) {
+		if (targetLevels[i] == 0.0f) continue;
+
+		juce::uint32 levelBits;
+		std::memcpy(&levelBits, &targetLevels[i], sizeof(levelBits));
+		mix((juce::uint32)harmonics[i]);
+		mix(levelBits);
+		mix((juce::uint32)waveforms[i]);
+	}
+
+	//0 means "not harmonic"
+	harmonicKey = hash == 0 ? 1 : hash;
+}
@@ -0,0 +1,223 @@
+/*
+  ==============================================================================
+
+    ParameterSnapshot.h
+
+	Every parameter the audio thread uses, read once per block.
+
+	The processor calls update() at the top of processBlock, voices and the
+	synth then only read the snapshot. Derived values are worked out here,
+	once, rather than in every voice: partial frequency ratios, partial levels
+	with muting and volume weighting folded in, the ADSR parameters, the
+	modulation matrix and the culling floor as a gain.
+
+	Partial sets are also checked for being harmonic, every ratio a whole
+	multiple of fundamental / denominator. Harmonic Table mode bakes those
+	into one table, keyed by a hash of everything that goes into it.
+
+	Each group of values carries a version that is bumped when anything in the
+	group changed. A voice keeps the versions it last saw and only redoes the
+	work that depends on a group that moved.
+
+	Hosts only hand over one value per parameter per block, so automation
+	would step once per block, at a rate set by the buffer size. Continuous
+	values (partial ratios and levels, master gain, the filter's cutoff,
+	resonance and envelope amount) instead move in a straight line from where
+	the last block left them to this block's value. The processor renders a
+	block that has anything moving in AUTOMATION_STEP_SAMPLES steps, calling
+	setBlockPosition before each. Switches (partial counts, waveforms, modes)
+	still apply at the block start, and so do partials that were added or
+	removed. A partial set that is moving is never reported as harmonic, so
+	nothing gets baked mid sweep.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+
+class ParameterSnapshot {
+public:
+	//One routing of the modulation matrix, see ModMatrix
+	struct ModSlot {
+		int source = ModSource::None;
+		int destination = ModDestination::None;
+		float amount = MOD_AMOUNT_DEF;
+	};
+
+	struct LfoSettings {
+		float rate = LFO_RATE_DEF;
+		int shape = LfoShape::Sine;
+		float spread = LFO_SPREAD_DEF;
+	};
+
+	//Message thread, before any audio. Hooks up the parameters and sizes the per partial arrays
+	void initialise(APVTS& apvts);
+
+	//Audio thread, once per block. Leaves every value at this block's, see setBlockPosition
+	void update() noexcept;
+
+	//Anything continuous changed since the last block, so the block should be rendered in steps
+	bool isInterpolating() const noexcept;
+
+	//Audio thread, between update() and rendering. Moves the continuous values to position through
+	//the block, 0 where the last block ended and 1 this block's values. Bumps the partials version
+	//if they moved
+	void setBlockPosition(float position) noexcept;
+
+	//Partial count, ratios, levels and waveforms
+	juce::uint32 getPartialsVersion() const noexcept { return partialsVersion; }
+	//ADSR parameters, amplitude and filter
+	juce::uint32 getEnvelopeVersion() const noexcept { return envelopeVersion; }
+	//Synthesis mode and culling
+	juce::uint32 getRenderingVersion() const noexcept { return renderingVersion; }
+
+	int getMaxPartials() const noexcept { return maxPartials; }
+	int getNumPartials() const noexcept { return numPartials; }
+
+	//Frequency over the fundamental, getNumPartials()+1 long with the fundamental at 0
+	const float* getPartialRatios() const noexcept { return ratios.get(); }
+
+	//Gain before velocity, 0 when muted. Same layout as the ratios
+	const float* getPartialLevels() const noexcept { return levels.get(); }
+
+	//Waveform::Shapes, same layout again. The fundamental is always a sine
+	const int* getPartialWaveforms() const noexcept { return waveforms.get(); }
+
+	//Ratios times this are whole numbers, 0 when no denominator up to HARMONIC_MAX_DENOMINATOR does it
+	int getHarmonicDenominator() const noexcept { return harmonicDenominator; }
+
+	//Ratio times the denominator, same layout as the ratios. Only meaningful while harmonic
+	const int* getPartialHarmonics() const noexcept { return harmonics.get(); }
+
+	//Highest harmonic of an audible partial, and a hash of the whole harmonic set. Both 0 when not harmonic
+	int getHighestHarmonic() const noexcept { return highestHarmonic; }
+	juce::uint64 getHarmonicKey() const noexcept { return harmonicKey; }
+
+	const juce::ADSR::Parameters& getEnvelope() const noexcept { return envelope; }
+	const juce::ADSR::Parameters& getFilterEnvelope() const noexcept { return filterEnvelope; }
+
+	//Octaves of cutoff the filter envelope adds at its peak
+	float getFilterEnvelopeAmount() const noexcept { return filterEnvelopeAmount.value; }
+
+	//MOD_SLOTS slots and NUM_LFOS LFOs
+	const ModSlot* getModSlots() const noexcept { return modSlots; }
+	const LfoSettings* getLfos() const noexcept { return lfos; }
+
+	int getSynthesisMode() const noexcept { return synthesisMode; }
+
+	//Fraction of Nyquist above which partials are culled
+	float getNyquistFraction() const noexcept { return nyquistFraction; }
+
+	//Level below which partials are culled, as a gain
+	float getAmplitudeFloor() const noexcept { return amplitudeFloor; }
+
+	int getNumVoices() const noexcept { return numVoices; }
+	bool isMulticore() const noexcept { return multicore; }
+
+	float getMasterGain() const noexcept { return masterGain.value; }
+	float getFilterCutoff() const noexcept { return filterCutoff.value; }
+	float getFilterResonance() const noexcept { return filterResonance.value; }
+	bool isFilterBypassed() const noexcept { return filterBypass; }
+
+private:
+	//A value on its way from the last block's value to this one's
+	struct Interpolated {
+		float start = 0.0f;
+		float target = 0.0f;
+		float value = 0.0f;
+
+		void set(float newTarget) noexcept {
+			start = target;
+			target = value = newTarget;
+		}
+
+		void moveTo(float position) noexcept { value = start + (target - start) * position; }
+		bool isMoving() const noexcept { return start != target; }
+	};
+
+	juce::AudioParameterInt* numPartialsParam{ nullptr };
+	juce::Array<juce::AudioParameterFloat*> partialDistanceParams;
+	juce::Array<juce::AudioParameterFloat*> partialVolumeParams;
+	juce::Array<juce::AudioParameterBool*> partialBypassParams;
+	juce::Array<juce::AudioParameterChoice*> partialWaveformParams;
+
+	juce::AudioParameterFloat* attackParam{ nullptr };
+	juce::AudioParameterFloat* decayParam{ nullptr };
+	juce::AudioParameterFloat* sustainParam{ nullptr };
+	juce::AudioParameterFloat* releaseParam{ nullptr };
+
+	juce::AudioParameterFloat* filterAttackParam{ nullptr };
+	juce::AudioParameterFloat* filterDecayParam{ nullptr };
+	juce::AudioParameterFloat* filterSustainParam{ nullptr };
+	juce::AudioParameterFloat* filterReleaseParam{ nullptr };
+	juce::AudioParameterFloat* filterEnvelopeAmountParam{ nullptr };
+
+	juce::Array<juce::AudioParameterChoice*> modSourceParams;
+	juce::Array<juce::AudioParameterChoice*> modDestinationParams;
+	juce::Array<juce::AudioParameterFloat*> modAmountParams;
+
+	juce::Array<juce::AudioParameterFloat*> lfoRateParams;
+	juce::Array<juce::AudioParameterChoice*> lfoShapeParams;
+	juce::Array<juce::AudioParameterFloat*> lfoSpreadParams;
+
+	juce::AudioParameterChoice* synthesisModeParam{ nullptr };
+	juce::AudioParameterFloat* cullNyquistParam{ nullptr };
+	juce::AudioParameterFloat* cullFloorParam{ nullptr };
+
+	juce::AudioParameterInt* numVoicesParam{ nullptr };
+	juce::AudioParameterBool* multicoreParam{ nullptr };
+
+	juce::AudioParameterFloat* masterGainParam{ nullptr };
+	juce::AudioParameterFloat* filterCutoffParam{ nullptr };
+	juce::AudioParameterFloat* filterResonanceParam{ nullptr };
+	juce::AudioParameterBool* filterBypassParam{ nullptr };
+
+	//Start at 1, so a voice that has seen nothing yet (0) always catches up
+	juce::uint32 partialsVersion = 1;
+	juce::uint32 envelopeVersion = 1;
+	juce::uint32 renderingVersion = 1;
+
+	int maxPartials = 0;
+	int numPartials = 0;
+	juce::HeapBlock<float> ratios;
+	juce::HeapBlock<float> levels;
+	juce::HeapBlock<int> waveforms;
+
+	//Where the partials are interpolating from and to. ratios and levels hold the current position
+	juce::HeapBlock<float> startRatios;
+	juce::HeapBlock<float> startLevels;
+	juce::HeapBlock<float> targetRatios;
+	juce::HeapBlock<float> targetLevels;
+	bool partialsMoving = false;
+
+	int harmonicDenominator = 0;
+	int highestHarmonic = 0;
+	juce::uint64 harmonicKey = 0;
+	juce::HeapBlock<int> harmonics;
+
+	//Works out the harmonic values above from the partials' targets
+	void findHarmonics() noexcept;
+
+	juce::ADSR::Parameters envelope;
+	juce::ADSR::Parameters filterEnvelope;
+
+	ModSlot modSlots[MOD_SLOTS];
+	LfoSettings lfos[NUM_LFOS];
+
+	int synthesisMode = SYNTHESIS_MODE_DEF;
+	float nyquistFraction = CULL_NYQUIST_DEF;
+	float amplitudeFloor = 0.0f;
+
+	int numVoices = NUM_VOICES;
+	bool multicore = MULTICORE_DEF;
+
+	Interpolated masterGain;
+	Interpolated filterCutoff;
+	Interpolated filterResonance;
+	bool filterBypass = false;
+	Interpolated filterEnvelopeAmount;
+
+	//Nothing to come from, on the first update
+	void jumpToTargets() noexcept;
+};
@@ -0,0 +1,423 @@
+/*
+  ==============================================================================
+
+    PartialBank.cpp
+
+  ==============================================================================
+*/
+
+#include "PartialBank.h"
+#include "SynthSound.h"
+
+juce::uint32 PartialBank::getPhaseDelta(double frequency, double sampleRate) noexcept {
+	//Above the sample rate a phase still wraps by itself, only the fraction of a cycle matters
+	double cycles = frequency / sampleRate;
+	cycles -= std::floor(cycles);
+	return (juce::uint32)(juce::uint64)std::llround(cycles * 4294967296.0);
+}
+
+void PartialBank::prepare(int maxPartials, int tableSize, int gainRampSamples) {
+	jassert(juce::isPowerOfTwo(tableSize));
+
+	//Round up to whole registers of the widest kernel, the padding lanes stay silent
+	capacity = ((maxPartials + OscillatorKernels::maxLanes - 1) / OscillatorKernels::maxLanes) * OscillatorKernels::maxLanes;
+
+	int tableBits = 0;
+	while ((1 << (tableBits + 1)) <= tableSize) tableBits++;
+	indexShift = 32 - tableBits;
+	fractionMask = (juce::uint32)((juce::uint64(1) << indexShift) - 1);
+	fractionScale = 1.0f / (float)(juce::uint64(1) << indexShift);
+
+	rampLength = juce::jmax(1, gainRampSamples);
+
+	phases.allocate((size_t)capacity);
+	deltas.allocate((size_t)capacity);
+	gains.allocate((size_t)capacity);
+	gainSteps.allocate((size_t)capacity);
+	targetGains.allocate((size_t)capacity);
+	tableIds.allocate((size_t)capacity);
+	ids.allocate((size_t)capacity);
+	tableOffsets.allocate((size_t)capacity);
+	tablePointers.allocate((size_t)capacity);
+
+	savedPhases.allocate((size_t)capacity);
+	savedDeltas.allocate((size_t)capacity);
+	savedGains.allocate((size_t)capacity);
+	savedTableIds.allocate((size_t)capacity);
+	savedAt.allocate((size_t)capacity);
+
+	resetPhases();
+}
+
+void PartialBank::resetPhases() noexcept {
+	phases.clear();
+	gains.clear();
+	gainSteps.clear();
+	tableIds.clear();
+	savedPhases.clear();
+	savedGains.clear();
+	savedAt.clear();
+	numActive = 0;
+	packedRange = 0;
+	rampRemaining = 0;
+	samplesRendered = 0;
+}
+
+void PartialBank::update(int numPartials, const juce::uint32* partialDeltas, const float* partialGains, const int* partialTables, int rampSamples) noexcept {
+	jassert(numPartials <= capacity);
+	numPartials = juce::jmin(numPartials, capacity);
+	const int ramp = rampSamples > 0 ? rampSamples : rampLength;
+
+	//Park the packed partials, then repack from the parked ones
+	for (int k = 0; k < numActive; k++) {
+		auto id = (size_t)ids[(size_t)k];
+		savedPhases[id] = phases[(size_t)k];
+		savedDeltas[id] = deltas[(size_t)k];
+		savedGains[id] = gains[(size_t)k];
+		savedTableIds[id] = tableIds[(size_t)k];
+		savedAt[id] = samplesRendered;
+	}
+
+	//Partials past numPartials that are still sounding ramp out
+	const int scanEnd = juce::jmax(numPartials, packedRange);
+
+	int packed = 0;
+	bool ramping = false;
+	packedRange = numPartials;
+
+	for (int i = 0; i < scanEnd; i++) {
+		const float target = i < numPartials ? partialGains[i] : 0.0f;
+		const float current = savedGains[(size_t)i];
+		if (target == 0.0f && current == 0.0f) continue;
+
+		const juce::uint32 delta = i < numPartials ? partialDeltas[i] : savedDeltas[(size_t)i];
+		const int table = i < numPartials ? partialTables[i] : savedTableIds[(size_t)i];
+
+		//Advance a parked phase by the time it was away, so partials stay phase coherent. Exact, modulo 2^32
+		auto elapsed = (juce::uint64)(samplesRendered - savedAt[(size_t)i]);
+		juce::uint32 phase = savedPhases[(size_t)i] + (juce::uint32)((juce::uint64)delta * elapsed);
+
+		phases[(size_t)packed] = phase;
+		deltas[(size_t)packed] = delta;
+		gains[(size_t)packed] = current;
+		targetGains[(size_t)packed] = target;
+		gainSteps[(size_t)packed] = (target - current) / (float)ramp;
+		tableIds[(size_t)packed] = table;
+		ids[(size_t)packed] = i;
+		packed++;
+
+		ramping = ramping || target != current;
+		packedRange = juce::jmax(packedRange, i + 1);
+	}
+
+	silenceTail(packed);
+	numActive = packed;
+
+	//Every change restarts the ramp, a partial half way there just gets a new slope
+	rampRemaining = ramping ? ramp : 0;
+	if (!ramping)
+		finishRamp();
+}
+
+void PartialBank::finishRamp() noexcept {
+	int packed = 0;
+
+	for (int k = 0; k < numActive; k++) {
+		auto id = (size_t)ids[(size_t)k];
+
+		if (targetGains[(size_t)k] == 0.0f) {
+			savedPhases[id] = phases[(size_t)k];
+			savedDeltas[id] = deltas[(size_t)k];
+			savedTableIds[id] = tableIds[(size_t)k];
+			savedAt[id] = samplesRendered;
+			savedGains[id] = 0.0f;
+			continue;
+		}
+
+		phases[(size_t)packed] = phases[(size_t)k];
+		deltas[(size_t)packed] = deltas[(size_t)k];
+		gains[(size_t)packed] = targetGains[(size_t)k];
+		targetGains[(size_t)packed] = targetGains[(size_t)k];
+		gainSteps[(size_t)packed] = 0.0f;
+		tableIds[(size_t)packed] = tableIds[(size_t)k];
+		ids[(size_t)packed] = (int)id;
+		packed++;
+	}
+
+	silenceTail(packed);
+	numActive = packed;
+}
+
+void PartialBank::silenceTail(int from) noexcept {
+	//The rest of the last, partly used register, as wide as any kernel's
+	constexpr int width = OscillatorKernels::maxLanes;
+	for (int k = from; k < ((from + width - 1) / width) * width; k++) {
+		gains[(size_t)k] = 0.0f;
+		gainSteps[(size_t)k] = 0.0f;
+		targetGains[(size_t)k] = 0.0f;
+		tableIds[(size_t)k] = 0;
+		deltas[(size_t)k] = 0;
+		phases[(size_t)k] = 0;
+	}
+}
+
+void PartialBank::process(const float* const* tables, const float* envelope, float* output, int numSamples) noexcept {
+	if (rampRemaining > 0) {
+		const int rampSamples = juce::jmin(numSamples, rampRemaining);
+		render<true>(tables, envelope, output, rampSamples);
+		advance(rampSamples);
+
+		envelope += rampSamples;
+		output += rampSamples;
+		numSamples -= rampSamples;
+	}
+
+	if (numSamples > 0) {
+		render<false>(tables, envelope, output, numSamples);
+		advance(numSamples);
+	}
+}
+
+void PartialBank::advance(int numSamples) noexcept {
+	samplesRendered += numSamples;
+	if (rampRemaining == 0) return;
+
+	jassert(numSamples <= rampRemaining); //Rendered past the end of the ramp
+	rampRemaining = juce::jmax(0, rampRemaining - numSamples);
+	if (rampRemaining == 0)
+		finishRamp();
+}
+
+#if JUCE_USE_SIMD
+PartialBank::FloatVec PartialBank::lookup(const float* const* tables, const int* tableId, const juce::uint32* phase) const noexcept {
+	alignas(AlignedArray<float>::alignment) float before[lanes];
+	alignas(AlignedArray<float>::alignment) float left[lanes];
+	alignas(AlignedArray<float>::alignment) float right[lanes];
+	alignas(AlignedArray<float>::alignment) float after[lanes];
+	alignas(AlignedArray<float>::alignment) float fraction[lanes];
+
+	//Gather the table neighbours, there is no SIMD gather (or shift) in SIMDRegister
+	for (int lane = 0; lane < lanes; lane++) {
+		const float* values = tables[tableId[lane]];
+		juce::uint32 pos = phase[lane];
+		int index = (int)(pos >> indexShift);
+		before[lane] = values[index - 1];
+		left[lane] = values[index];
+		right[lane] = values[index + 1];
+		after[lane] = values[index + 2];
+		fraction[lane] = (float)(pos & fractionMask) * fractionScale;
+	}
+
+	//Same cubic Hermite as SynthSound::interpolate, a register at a time
+	const auto one = FloatVec::expand(1.0f);
+	const auto half = FloatVec::expand(0.5f);
+
+	auto y0 = FloatVec::fromRawArray(left);
+	auto y1 = FloatVec::fromRawArray(right);
+	auto x = FloatVec::fromRawArray(fraction);
+	auto rest = one - x;
+
+	auto d = y1 - y0;
+	auto m0 = (y1 - FloatVec::fromRawArray(before)) * half;
+	auto m1 = (FloatVec::fromRawArray(after) - y0) * half;
+	return y0 + x * (d + rest * ((m0 - d) * rest - (m1 - d) * x));
+}
+#endif
+
+template <bool ramping>
+void PartialBank::render(const float* const* tables, const float* envelope, float* output, int numSamples) noexcept {
+	const int numRegisters = (numActive + lanes - 1) / lanes;
+
+	if (numRegisters == 0) {
+		juce::FloatVectorOperations::clear(output, numSamples);
+		return;
+	}
+
+	juce::uint32* phase = phases.get();
+	const juce::uint32* delta = deltas.get();
+	float* gain = gains.get();
+	const float* step = gainSteps.get();
+	const int* tableId = tableIds.get();
+
+	//Wider registers and hardware gathers, where the CPU has them
+	const int variant = OscillatorKernels::getVariant();
+	if (variant != KernelVariant::Generic) {
+		const OscillatorKernels::RenderArgs args{ tables, tableId, phase, delta, gain, step, tableOffsets.get(), tablePointers.get(),
+												  numActive, indexShift, fractionMask, fractionScale,
+												  envelope, output, numSamples, ramping };
+		if (OscillatorKernels::render(variant, args))
+			return;
+	}
+
+#if JUCE_USE_SIMD
+	for (int sample = 0; sample < numSamples; sample++) {
+		auto sum = FloatVec::expand(0.0f);
+
+		for (int reg = 0; reg < numRegisters; reg++) {
+			const int offset = reg * lanes;
+
+			auto level = FloatVec::fromRawArray(gain + offset);
+			sum += lookup(tables, tableId + offset, phase + offset) * level;
+
+			if (ramping)
+				(level + FloatVec::fromRawArray(step + offset)).copyToRawArray(gain + offset);
+
+			//Wraps by overflowing
+			(PhaseVec::fromRawArray(phase + offset) + PhaseVec::fromRawArray(delta + offset)).copyToRawArray(phase + offset);
+		}
+
+		//The voice's amplitude envelope, while the sum is still in a register
+		output[sample] = sum.sum() * envelope[sample];
+	}
+#else
+	for (int sample = 0; sample < numSamples; sample++) {
+		float sum = 0.0f;
+
+		for (int i = 0; i < numRegisters; i++) {
+			juce::uint32 pos = phase[i];
+			sum += SynthSound::interpolate(tables[tableId[i]], (int)(pos >> indexShift), (float)(pos & fractionMask) * fractionScale) * gain[i];
+
+			if (ramping)
+				gain[i] += step[i];
+
+			phase[i] = pos + delta[i];
+		}
+
+		output[sample] = sum * envelope[sample];
+	}
+#endif
+}
+
+bool PartialBank::shouldInterleave(const PartialBank* const* banks, int numBanks) noexcept {
+	if (lanes == 1 || numBanks < 2 || numBanks > lanes) return false;
+
+	int ownRegisters = 0;
+	int slots = 0;
+
+	for (int b = 0; b < numBanks; b++) {
+		const int numPartials = banks[b]->numActive;
+		if (numPartials > INTERLEAVE_MAX_PARTIALS) return false;
+
+		ownRegisters += (numPartials + lanes - 1) / lanes;
+		slots = juce::jmax(slots, numPartials);
+	}
+
+	//Voice major is one register per slot for every bank at once
+	return slots < ownRegisters;
+}
+
+void PartialBank::processInterleaved(PartialBank* const* banks, int numBanks, const float* const* tables,
+									 const float* const* envelopes, float* const* outputs, int numSamples) noexcept {
+	jassert(numBanks >= 1 && numBanks <= lanes);
+
+#if JUCE_USE_SIMD
+	for (int offset = 0; offset < numSamples;) {
+		//Every bank's ramp has to end on a segment boundary, where finishRamp repacks it
+		int length = numSamples - offset;
+		bool ramping = false;
+
+		for (int b = 0; b < numBanks; b++) {
+			if (banks[b]->rampRemaining > 0) {
+				length = juce::jmin(length, banks[b]->rampRemaining);
+				ramping = true;
+			}
+		}
+
+		if (ramping)
+			renderInterleaved<true>(banks, numBanks, tables, envelopes, outputs, offset, length);
+		else
+			renderInterleaved<false>(banks, numBanks, tables, envelopes, outputs, offset, length);
+
+		for (int b = 0; b < numBanks; b++)
+			banks[b]->advance(length);
+
+		offset += length;
+	}
+#else
+	for (int b = 0; b < numBanks; b++)
+		banks[b]->process(tables, envelopes[b], outputs[b], numSamples);
+#endif
+}
+
+template <bool ramping>
+void PartialBank::renderInterleaved(PartialBank* const* banks, int numBanks, const float* const* tables,
+									const float* const* envelopes, float* const* outputs, int offset, int numSamples) noexcept {
+#if JUCE_USE_SIMD
+	constexpr int maxValues = INTERLEAVE_MAX_PARTIALS * lanes;
+
+	//Slot k of bank b at k * lanes + b. Lanes with no bank, and slots past a bank's partials, stay silent
+	alignas(AlignedArray<float>::alignment) juce::uint32 phase[maxValues];
+	alignas(AlignedArray<float>::alignment) juce::uint32 delta[maxValues];
+	alignas(AlignedArray<float>::alignment) float gain[maxValues];
+	alignas(AlignedArray<float>::alignment) float step[maxValues];
+	alignas(AlignedArray<float>::alignment) int tableId[maxValues];
+
+	int numSlots = 0;
+	for (int b = 0; b < numBanks; b++)
+		numSlots = juce::jmax(numSlots, banks[b]->numActive);
+
+	jassert(numSlots <= INTERLEAVE_MAX_PARTIALS); //shouldInterleave would have said no
+	numSlots = juce::jmin(numSlots, INTERLEAVE_MAX_PARTIALS);
+
+	for (int k = 0; k < numSlots; k++) {
+		for (int lane = 0; lane < lanes; lane++) {
+			const int i = k * lanes + lane;
+			const PartialBank* bank = lane < numBanks ? banks[lane] : nullptr;
+
+			if (bank != nullptr && k < bank->numActive) {
+				phase[i] = bank->phases[(size_t)k];
+				delta[i] = bank->deltas[(size_t)k];
+				gain[i] = bank->gains[(size_t)k];
+				step[i] = bank->gainSteps[(size_t)k];
+				tableId[i] = bank->tableIds[(size_t)k];
+			}
+			else {
+				phase[i] = delta[i] = 0;
+				gain[i] = step[i] = 0.0f;
+				tableId[i] = 0;
+			}
+		}
+	}
+
+	//Same table size for every bank, so any of them can split the phases
+	const PartialBank& first = *banks[0];
+
+	alignas(AlignedArray<float>::alignment) float envelope[lanes] = {};
+	alignas(AlignedArray<float>::alignment) float output[lanes];
+
+	for (int sample = offset; sample < offset + numSamples; sample++) {
+		auto sum = FloatVec::expand(0.0f);
+
+		for (int k = 0; k < numSlots; k++) {
+			const int slot = k * lanes;
+
+			auto level = FloatVec::fromRawArray(gain + slot);
+			sum += first.lookup(tables, tableId + slot, phase + slot) * level;
+
+			if (ramping)
+				(level + FloatVec::fromRawArray(step + slot)).copyToRawArray(gain + slot);
+
+			(PhaseVec::fromRawArray(phase + slot) + PhaseVec::fromRawArray(delta + slot)).copyToRawArray(phase + slot);
+		}
+
+		//One sample of every voice, each with its own envelope
+		for (int lane = 0; lane < numBanks; lane++)
+			envelope[lane] = envelopes[lane][sample];
+
+		(sum * FloatVec::fromRawArray(envelope)).copyToRawArray(output);
+
+		for (int lane = 0; lane < numBanks; lane++)
+			outputs[lane][sample] = output[lane];
+	}
+
+	for (int b = 0; b < numBanks; b++) {
+		auto* bank = banks[b];
+		for (int k = 0; k < bank->numActive; k++) {
+			bank->phases[(size_t)k] = phase[k * lanes + b];
+			bank->gains[(size_t)k] = gain[k * lanes + b];
+		}
+	}
+#else
+	juce::ignoreUnused(banks, numBanks, tables, envelopes, outputs, offset, numSamples);
+#endif
+}
@@ -0,0 +1,145 @@
+/*
+  ==============================================================================
+
+    PartialBank.h
+
+	Oscillator bank for the partials of one voice.
+
+	Phases, deltas and gains are kept structure-of-arrays in aligned storage,
+	so a whole SIMD register of partials is advanced per instruction.
+
+	Phases are unsigned 32 bit fixed point, a full cycle being 2^32. They wrap
+	by overflowing, so there is no wrap test, and a phase is exactly as
+	precise at the end of the table as at the start. The top bits are the
+	table index and the rest the fraction.
+
+	Only partials with a non zero gain are packed into those arrays, so the
+	render cost follows the number of audible partials, not the partial count.
+	Partials that drop out keep their phase and catch up when they come back.
+
+	Gain changes ramp linearly, per sample, over a fixed number of samples.
+	A partial ramping down to 0 stays packed until the ramp is over.
+
+	Each partial reads its own table, by id into the table set handed to
+	process (see SynthSound::getTables), so partials can have different
+	waveforms and wavetable levels.
+
+	Partial 0 is the fundamental, like the arrays in SynthVoice.
+
+	A voice with only a few audible partials leaves most of its registers
+	empty. processInterleaved renders up to lanes such banks together,
+	voice major: one register holds the same packed partial of every voice,
+	and the sum that comes out is one sample of every voice. The voices'
+	states are copied into the register layout on the stack for the call
+	and back after, so each bank stays the same between calls whichever
+	way it rendered. shouldInterleave says which layout needs fewer
+	registers for a set of banks.
+
+	Where the CPU has AVX2 or AVX-512, process hands the loop to the wider
+	build of it in OscillatorKernels. Storage is padded for those registers.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+#include "AlignedArray.h"
+#include "OscillatorKernels.h"
+
+class PartialBank {
+public:
+#if JUCE_USE_SIMD
+	using FloatVec = juce::dsp::SIMDRegister<float>;
+	using PhaseVec = juce::dsp::SIMDRegister<juce::uint32>;
+	static constexpr int lanes = (int)FloatVec::SIMDNumElements;
+	static_assert(PhaseVec::SIMDNumElements == FloatVec::SIMDNumElements, "Phases and gains share a register layout");
+#else
+	static constexpr int lanes = 1;
+#endif
+
+	//Per sample phase increment for a frequency, wrapped into one cycle
+	static juce::uint32 getPhaseDelta(double frequency, double sampleRate) noexcept;
+
+	//Allocates storage for up to maxPartials partials, call from prepareToPlay. tableSize must be a power of two
+	void prepare(int maxPartials, int tableSize, int gainRampSamples);
+
+	//Silences the bank, with no ramp
+	void resetPhases() noexcept;
+
+	//Repacks the bank from per partial deltas, gains and table ids, numPartials long. Deltas and
+	//tables apply straight away, gains ramp, over rampSamples or the prepared ramp length if 0.
+	//A gain of 0 drops the partial once it ramped out
+	void update(int numPartials, const juce::uint32* partialDeltas, const float* partialGains, const int* partialTables, int rampSamples = 0) noexcept;
+
+	//Writes numSamples of the summed partials, times the per sample envelope gain, into output.
+	//Tables are laid out as SynthSound::getTables()
+	void process(const float* const* tables, const float* envelope, float* output, int numSamples) noexcept;
+
+	int getNumActivePartials() const noexcept { return numActive; }
+
+	//Voice major takes fewer registers per sample than each bank on its own. Never for one bank,
+	//or a bank with more than INTERLEAVE_MAX_PARTIALS audible partials
+	static bool shouldInterleave(const PartialBank* const* banks, int numBanks) noexcept;
+
+	//process for up to lanes banks at once, voice major. Banks must have been prepared for the same
+	//table size. Envelopes and outputs are per bank, like process's
+	static void processInterleaved(PartialBank* const* banks, int numBanks, const float* const* tables,
+								   const float* const* envelopes, float* const* outputs, int numSamples) noexcept;
+
+private:
+	//Packed, only the audible partials
+	AlignedArray<juce::uint32> phases;
+	AlignedArray<juce::uint32> deltas;
+	AlignedArray<float> gains;
+	AlignedArray<float> gainSteps;
+	AlignedArray<float> targetGains;
+	AlignedArray<int> tableIds;
+	AlignedArray<int> ids;
+
+	//Scratch for OscillatorKernels
+	AlignedArray<int> tableOffsets;
+	AlignedArray<const float*> tablePointers;
+
+	//Per partial, where a partial's state is kept while it is not packed
+	AlignedArray<juce::uint32> savedPhases;
+	AlignedArray<juce::uint32> savedDeltas;
+	AlignedArray<float> savedGains;
+	AlignedArray<int> savedTableIds;
+	AlignedArray<juce::int64> savedAt;
+
+	juce::int64 samplesRendered = 0;
+
+	//Splitting a phase into table index and fraction
+	int indexShift = 0;
+	juce::uint32 fractionMask = 0;
+	float fractionScale = 0.0f;
+
+	int numActive = 0;
+	int capacity = 0;
+
+	//Partial ids below this may be packed
+	int packedRange = 0;
+
+	int rampLength = 1;
+	int rampRemaining = 0;
+
+	template <bool ramping>
+	void render(const float* const* tables, const float* envelope, float* output, int numSamples) noexcept;
+
+	template <bool ramping>
+	static void renderInterleaved(PartialBank* const* banks, int numBanks, const float* const* tables,
+								  const float* const* envelopes, float* const* outputs, int offset, int numSamples) noexcept;
+
+	//Moves the bank on numSamples it rendered, landing its ramp if that's where it ends
+	void advance(int numSamples) noexcept;
+
+#if JUCE_USE_SIMD
+	//One register of cubic Hermite lookups, each lane reading its own table at its own phase
+	forcedinline FloatVec lookup(const float* const* tables, const int* tableId, const juce::uint32* phase) const noexcept;
+#endif
+
+	//Lands every gain on its target and drops the partials that ramped out
+	void finishRamp() noexcept;
+
+	void silenceTail(int from) noexcept;
+};
@@ -0,0 +1,179 @@
+/*
+  ==============================================================================
+
+    SpectralSynth.cpp
+
+  ==============================================================================
+*/
+
+#include "SpectralSynth.h"
+
+namespace {
+	constexpr int lobeOversample = 64;
+	constexpr int lobeTableSize = SpectralSynth::lobeHalfWidth * lobeOversample + 1;
+
+	//4 term Blackman-Harris, centred on n = 0
+	double blackmanHarris(double n) {
+		const double x = juce::MathConstants<double>::twoPi * n / SpectralSynth::fftSize;
+		return 0.35875 + 0.48829 * std::cos(x) + 0.14128 * std::cos(2.0 * x) + 0.01168 * std::cos(3.0 * x);
+	}
+
+	//Read only tables shared by every voice, built the first time a SpectralSynth is constructed
+	struct SpectralTables {
+		SpectralTables() {
+			constexpr int N = SpectralSynth::fftSize;
+
+			//Window transform at fractional bin offsets. The window is symmetric so it is real
+			for (int i = 0; i < lobeTableSize; i++) {
+				double delta = (double)i / lobeOversample;
+				double sum = 0;
+				for (int n = -N / 2; n < N / 2; n++)
+					sum += blackmanHarris(n) * std::cos(juce::MathConstants<double>::twoPi * delta * n / N);
+				lobe[i] = (float)sum;
+			}
+
+			//Swaps the window for a triangle over the middle half of the frame
+			constexpr int quarter = N / 4;
+			for (int t = 0; t < N / 2; t++) {
+				int n = t - quarter;
+				double triangle = 1.0 - std::abs(n) / (double)quarter;
+				correction[t] = (float)(triangle / blackmanHarris(n));
+			}
+		}
+
+		float lookupLobe(float delta) const noexcept {
+			float pos = delta * lobeOversample;
+			int index = (int)pos;
+			float frac = pos - (float)index;
+			return lobe[index] + frac * (lobe[index + 1] - lobe[index]);
+		}
+
+		float lobe[lobeTableSize + 1]{};
+		float correction[SpectralSynth::fftSize / 2]{};
+	};
+
+	const SpectralTables& getTables() {
+		static const SpectralTables tables;
+		return tables;
+	}
+}
+
+SpectralSynth::SpectralSynth() {
+	//Build the shared tables now, not on the audio thread
+	getTables();
+}
+
+void SpectralSynth::prepare(int maxPartials, double newSampleRate) {
+	sampleRate = newSampleRate;
+	capacity = maxPartials;
+
+	spectrum.calloc((size_t)(2 * fftSize));
+	tail.calloc((size_t)hopSize);
+	hop.calloc((size_t)hopSize);
+
+	phases.calloc((size_t)capacity);
+	binFrequencies.calloc((size_t)capacity);
+	gains.calloc((size_t)capacity);
+
+	numPartials = 0;
+	reset();
+}
+
+void SpectralSynth::reset() noexcept {
+	juce::FloatVectorOperations::clear(tail.get(), hopSize);
+	juce::FloatVectorOperations::clear(hop.get(), hopSize);
+	std::fill(phases.get(), phases.get() + capacity, 0.0);
+	hopPosition = hopSize;
+}
+
+void SpectralSynth::update(int newNumPartials, const float* frequencies, const float* newGains) noexcept {
+	jassert(newNumPartials <= capacity);
+	numPartials = juce::jmin(newNumPartials, capacity);
+
+	const float binsPerHz = (float)(fftSize / sampleRate);
+	for (int i = 0; i < numPartials; i++) {
+		binFrequencies[i] = frequencies[i] * binsPerHz;
+		gains[i] = newGains[i];
+	}
+}
+
+void SpectralSynth::process(float* output, int numSamples) noexcept {
+	while (numSamples > 0) {
+		if (hopPosition == hopSize)
+			synthesiseFrame();
+
+		int num = juce::jmin(numSamples, hopSize - hopPosition);
+		juce::FloatVectorOperations::copy(output, hop.get() + hopPosition, num);
+
+		output += num;
+		numSamples -= num;
+		hopPosition += num;
+	}
+}
+
+void SpectralSynth::synthesiseFrame() noexcept {
+	const auto& tables = getTables();
+	constexpr double twoPi = juce::MathConstants<double>::twoPi;
+	constexpr float nyquistBin = (float)(fftSize / 2);
+
+	juce::FloatVectorOperations::clear(spectrum.get(), 2 * fftSize);
+
+	for (int i = 0; i < numPartials; i++) {
+		if (gains[i] == 0.0f || binFrequencies[i] >= nyquistBin) continue;
+
+		addLobe(binFrequencies[i], gains[i], phases[i]);
+		phases[i] = std::fmod(phases[i] + twoPi * binFrequencies[i] * hopSize / fftSize, twoPi);
+	}
+
+	fft.performRealOnlyInverseTransform(spectrum.get());
+
+	//The frame is centred on sample 0, so the middle half wraps around the buffer
+	constexpr int quarter = fftSize / 4;
+	for (int t = 0; t < hopSize; t++) {
+		int index = (t - quarter + fftSize) & (fftSize - 1);
+		hop[t] = tail[t] + spectrum[index] * tables.correction[t];
+	}
+	for (int t = hopSize; t < 2 * hopSize; t++) {
+		int index = (t - quarter + fftSize) & (fftSize - 1);
+		tail[t - hopSize] = spectrum[index] * tables.correction[t];
+	}
+
+	hopPosition = 0;
+}
+
+void SpectralSynth::addLobe(float binFrequency, float amplitude, double phase) noexcept {
+	const auto& tables = getTables();
+
+	//A sine, to match the oscillator bank: A sin(x + phase) = A cos(x + phase - pi/2)
+	const float re = (float)(0.5 * amplitude * std::sin(phase));
+	const float im = (float)(-0.5 * amplitude * std::cos(phase));
+
+	const int centre = (int)binFrequency;
+	for (int k = centre - lobeHalfWidth + 1; k <= centre + lobeHalfWidth; k++) {
+		float delta = std::abs((float)k - binFrequency);
+		if (delta >= (float)lobeHalfWidth) continue;
+
+		float weight = tables.lookupLobe(delta);
+
+		//DC and Nyquist are their own mirror image, so they get the real part twice
+		if (k == 0 || k == fftSize / 2) {
+			spectrum[2 * k] += 2.0f * re * weight;
+			continue;
+		}
+
+		//Lobes reaching past DC or Nyquist fold back as the conjugate
+		int bin = k;
+		float imSign = 1.0f;
+		if (bin < 0) {
+			bin = -bin;
+			imSign = -1.0f;
+		}
+		else if (bin > fftSize / 2) {
+			bin = fftSize - bin;
+			imSign = -1.0f;
+		}
+
+		spectrum[2 * bin] += re * weight;
+		spectrum[2 * bin + 1] += imSign * im * weight;
+	}
+}
@@ -0,0 +1,69 @@
+/*
+  ==============================================================================
+
+    SpectralSynth.h
+
+	Inverse FFT additive synthesis (FFT^-1, Rodet & Depalle) for one voice.
+
+	Every hop a short time spectrum is built: each partial adds the main lobe
+	of a Blackman-Harris window, centred on its frequency, scaled by its gain
+	and rotated by its phase. One inverse FFT turns that into a windowed frame.
+	The window is swapped for a triangle over the middle half of the frame and
+	the triangles are overlap-added at a quarter frame hop.
+
+	Cost per sample barely depends on the partial count, each partial only
+	touches a handful of bins once per hop.
+
+	Output is delayed by fftSize / 4 samples against the oscillator bank.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+
+class SpectralSynth {
+public:
+	static constexpr int fftOrder = 10;
+	static constexpr int fftSize = 1 << fftOrder;
+	static constexpr int hopSize = fftSize / 4;
+
+	//Half width of the Blackman-Harris main lobe, in bins
+	static constexpr int lobeHalfWidth = 4;
+
+	SpectralSynth();
+
+	//Allocates storage for up to maxPartials partials, call from prepareToPlay
+	void prepare(int maxPartials, double newSampleRate);
+
+	void reset() noexcept;
+
+	//Frequencies in Hz, a gain of 0 leaves the partial out. Takes effect at the next hop
+	void update(int numPartials, const float* frequencies, const float* gains) noexcept;
+
+	//Writes numSamples of the summed partials into output
+	void process(float* output, int numSamples) noexcept;
+
+private:
+	juce::dsp::FFT fft{ fftOrder };
+
+	//Interleaved complex spectrum, and workspace for the transform
+	juce::HeapBlock<float> spectrum;
+
+	//Pending second half of the last triangle, and the hop being played out
+	juce::HeapBlock<float> tail;
+	juce::HeapBlock<float> hop;
+	int hopPosition = hopSize;
+
+	//Per partial, phases at the centre of the next frame
+	juce::HeapBlock<double> phases;
+	juce::HeapBlock<float> binFrequencies;
+	juce::HeapBlock<float> gains;
+	int numPartials = 0;
+	int capacity = 0;
+
+	double sampleRate = 44100.0;
+
+	void synthesiseFrame() noexcept;
+	void addLobe(float binFrequency, float amplitude, double phase) noexcept;
+};
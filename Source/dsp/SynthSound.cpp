@@ -10,28 +10,215 @@
 
 #include "SynthSound.h"
 
-float SynthSound::lookup(float index) {
+namespace {
+	//How often the builder looks for requests from the audio thread, which never wakes it
+	constexpr int builderPollMs = 10;
+
+	juce::uint64 mixKey(juce::uint64 key, juce::uint64 value) noexcept {
+		return (key ^ value) * 1099511628211ull;
+	}
+}
+
+//One thread for every SynthSound in the process, held through a juce::SharedResourcePointer
+class SynthSound::TableBuilder : public juce::Thread {
+public:
+	TableBuilder() : juce::Thread("Wavetable Builder") {
+		startThread(juce::Thread::Priority::background);
+	}
+
+	~TableBuilder() override {
+		signalThreadShouldExit();
+		notify();
+		stopThread(-1);
+	}
+
+	void addSound(SynthSound& sound) {
+		const juce::ScopedLock lock(soundsLock);
+		sounds.add(&sound);
+	}
+
+	//Waits for a build of this sound that is already under way
+	void removeSound(SynthSound& sound) {
+		const juce::ScopedLock lock(soundsLock);
+		sounds.removeFirstMatchingValue(&sound);
+	}
+
+	void run() override {
+		while (!threadShouldExit()) {
+			{
+				const juce::ScopedLock lock(soundsLock);
+				for (auto* sound : sounds) {
+					sound->buildPendingUserTables();
+					sound->buildPendingHarmonicTables();
+				}
+			}
+
+			//Woken straight away for the message thread, found by the next poll for the audio thread
+			wait(builderPollMs);
+		}
+	}
+
+private:
+	juce::CriticalSection soundsLock;
+	juce::Array<SynthSound*> sounds;
+};
+
+SynthSound::SynthSound() {
+	//Valid tables before the first block, the sine stands in for anything still building
+	for (auto& table : tables)
+		table = sineTable->getTable();
+
+	builder->addSound(*this);
+	DBG("Sound created");
+}
+
+SynthSound::~SynthSound() {
+	builder->removeSound(*this);
+}
+
+void SynthSound::beginBlock(const ParameterSnapshot& parameters) noexcept {
+	auto* user = userTables.acquire();
+	auto* harmonic = harmonicTables.acquire();
+
+	for (int waveform = 0; waveform < Waveform::Num_Shapes; waveform++) {
+		const MipmappedWavetable* mipmaps = waveform == Waveform::User ? user : library->getTable(waveform);
+
+		for (int level = 0; level < WAVETABLE_LEVELS; level++)
+			tables[waveform * WAVETABLE_LEVELS + level] = mipmaps != nullptr ? mipmaps->getLevel(level) : sineTable->getTable();
+	}
+
+	for (int level = 0; level < WAVETABLE_LEVELS; level++)
+		tables[harmonicTableBase + level] = harmonic != nullptr ? harmonic->getLevel(level) : sineTable->getTable();
+
+	juce::uint64 wanted = 0;
+	if (parameters.getSynthesisMode() == SynthesisMode::Harmonic_Table && parameters.getHarmonicKey() != 0) {
+		//The tables the partials read go into the bake too, so a finished saw or a newly loaded user waveform means a new one
+		wanted = mixKey(parameters.getHarmonicKey(), library->getTable(Waveform::Saw) != nullptr ? 1 : 0);
+		wanted = mixKey(wanted, library->getTable(Waveform::Square) != nullptr ? 1 : 0);
+		wanted = mixKey(wanted, user != nullptr ? user->key : 0);
+		wanted = wanted == 0 ? 1 : wanted;
+
+		if (wanted != requestedHarmonicKey && (harmonic == nullptr || harmonic->key != wanted))
+			requestHarmonicTable(parameters, wanted);
+	}
 
-	int lindex = (int)index;
-	int rindex = lindex + 1;
+	harmonicTableReady = wanted != 0 && harmonic != nullptr && harmonic->key == wanted;
+}
+
+void SynthSound::requestHarmonicTable(const ParameterSnapshot& parameters, juce::uint64 key) noexcept {
+	auto& request = outgoingRequest;
+	request.key = key;
+	request.numPartials = juce::jmin(parameters.getNumPartials(), MAX_PARTIALS);
+
+	const int* harmonics = parameters.getPartialHarmonics();
+	const float* levels = parameters.getPartialLevels();
+	const int* waveforms = parameters.getPartialWaveforms();
+
+	for (int i = 0; i <= request.numPartials; i++) {
+		request.harmonics[i] = harmonics[i];
+		request.levels[i] = levels[i];
+		request.waveforms[i] = waveforms[i];
+	}
+
+	//A full queue is tried again next block. Waking the builder would take a lock, so it finds the request when it next polls
+	if (harmonicRequests.push(request))
+		requestedHarmonicKey = key;
+}
 
-	float lval = table[lindex];
-	float rval = table[rindex];
+int SynthSound::getTableId(int waveform, double frequency, double sampleRate) noexcept {
+	waveform = juce::jlimit(0, Waveform::Num_Shapes - 1, waveform);
 
-	float dif = index - lindex;
-	float height = rval - lval;
+	//Every level of a sine is the same
+	int level = waveform == Waveform::Sine ? 0 : MipmappedWavetable::getLevelFor(frequency, sampleRate);
+	return waveform * WAVETABLE_LEVELS + level;
+}
 
-	float val = lval + dif * height;
+int SynthSound::getHarmonicTableId(double baseFrequency, double sampleRate) noexcept {
+	return harmonicTableBase + MipmappedWavetable::getLevelFor(baseFrequency, sampleRate);
+}
+
+void SynthSound::setUserWaveform(const float* cycle, int length) {
+	{
+		const juce::ScopedLock lock(pendingLock);
+		pendingCycle.assign(cycle, cycle + juce::jmax(0, length));
+		hasPendingCycle = true;
+	}
+
+	builder->notify();
+	userTables.releaseRetired();
+}
+
+void SynthSound::buildPendingUserTables() {
+	std::vector<float> cycle;
+	{
+		const juce::ScopedLock lock(pendingLock);
+		if (!hasPendingCycle) return;
+		cycle.swap(pendingCycle);
+		hasPendingCycle = false;
+	}
 
-	return val;
+	auto table = std::make_unique<MipmappedWavetable>();
+	table->build(MipmappedWavetable::getHarmonics(cycle.data(), (int)cycle.size()));
+	table->key = nextUserKey++;
+	userTables.publish(std::move(table));
+	userTables.releaseRetired();
+}
+
+void SynthSound::buildPendingHarmonicTables() {
+	//Only the newest request is worth building
+	bool pending = false;
+	while (harmonicRequests.pop(incomingRequest))
+		pending = true;
+
+	if (!pending) return;
+
+	const auto& request = incomingRequest;
+	if (!harmonicTables.publishCached(request.key)) {
+		std::vector<std::complex<float>> spectrum((size_t)TABLE_SIZE / 2);
+
+		for (int i = 0; i <= request.numPartials; i++) {
+			const float level = request.levels[i];
+			const int harmonic = request.harmonics[i];
+			if (level == 0.0f || harmonic <= 0) continue;
+
+			//Partials read what the voices would have read, the sine until a table is ready
+			const int waveform = request.waveforms[i];
+			const MipmappedWavetable* shape = waveform == Waveform::Sine ? nullptr
+											: waveform == Waveform::User ? userTables.getPublished()
+											: library->getTable(waveform);
+
+			if (shape == nullptr) {
+				spectrum[(size_t)harmonic] += std::complex<float>(level, 0.0f);
+				continue;
+			}
+
+			//Every harmonic of the partial's own waveform lands on a multiple of its harmonic
+			const auto& shapeSpectrum = shape->getSpectrum();
+			const float shapeLevel = level * shape->getScale();
+			for (size_t k = 1; k < shapeSpectrum.size() && (size_t)harmonic * k < spectrum.size(); k++)
+				spectrum[(size_t)harmonic * k] += shapeLevel * shapeSpectrum[k];
+		}
+
+		auto table = std::make_unique<MipmappedWavetable>();
+		table->build(spectrum, false);
+		table->key = request.key;
+		harmonicTables.publish(std::move(table));
+	}
+
+	harmonicTables.releaseRetired();
+}
+
+float SynthSound::lookup(float index) {
+	return interpolate(getTable(), index);
 }
 
-void SynthSound::generateTable(int length) {
-	double step = TWOPI / length;
+SineTable::SineTable() {
+	double step = TWOPI / TABLE_SIZE;
 
-	for (int i = 0; i < length; i++) {
-		table[i] = sin(step * i);
+	//Guard points included, sin wraps them round by itself
+	for (int i = -1; i <= TABLE_SIZE + 1; i++) {
+		table[i + 1] = (float)sin(step * i);
 	}
 
-	table[TABLE_SIZE] = table[0];
+	DBG("Sine table created");
 }
\ No newline at end of file
@@ -3,33 +3,143 @@
 
     SynthSound.h
 
-	Implementation of juce::SynthesiserSound
+	The one sound every voice plays, bound to them up front (see
+	AdditiveSynthesiser::setSound).
 
-	Probably will end up holding global/shared information, like computed wavetables
+	Hands out the tables the partials read: the sine, shared by every instance
+	(see SineTable), the saw and square, also shared (see WavetableLibrary),
+	this instance's own user waveform and, in Harmonic Table mode, the
+	current partial set baked into one table.
+
+	Voices only see tables through getTables(), which is refreshed once per
+	block by beginBlock(). A table that isn't built yet reads as the sine.
+	User and baked tables are built on one background thread shared by every
+	instance, and handed over through WavetableCaches, so the audio thread
+	never waits or frees anything.
+
+	A baked table is the sum of every partial, each a whole harmonic of
+	fundamental / denominator (see ParameterSnapshot), so a voice can play the
+	whole set with one lookup per sample. When the partials change the audio
+	thread queues a request, which the builder picks up when it next polls,
+	and voices go back to the partials until the new table is published.
 
   ==============================================================================
 */
 
 #pragma once
 #include "../GlobalDefines.h"
+#include "Wavetables.h"
+#include "ParameterSnapshot.h"
+#include "LockFreeFifo.h"
 
-class SynthSound : public juce::SynthesiserSound {
+//The sine table, built once per process and shared read only by every plugin instance.
+//Hold it through a juce::SharedResourcePointer, it goes when the last holder does
+class SineTable {
 public:
-	SynthSound()
-	{
-		generateTable(TABLE_SIZE);
-		DBG("Sound created");
-	}
-	bool appliesToNote(int midiNoteNumber) override { return true; }
-	bool appliesToChannel(int midiChannel) override { return true; }
+	SineTable();
+
+	//TABLE_SIZE long, getTable()[-1] and getTable()[TABLE_SIZE+1] are valid guard points
+	const float* getTable() const noexcept { return table + 1; }
+
+private:
+	//One guard point before the table, two after. Small enough to stay in L1
+	alignas(64) float table[TABLE_SIZE + 3];
+};
+
+class SynthSound : public juce::ReferenceCountedObject {
+public:
+	using Ptr = juce::ReferenceCountedObjectPtr<SynthSound>;
+
+	SynthSound();
+	~SynthSound() override;
 
 	int getTableSize() { return TABLE_SIZE; }
 
 	float lookup(float index);
 
+	//Raw table for the vectorised partial bank, TABLE_SIZE long. Guard points make
+	//getTable()[-1] and getTable()[TABLE_SIZE+1] valid, so indices never need wrapping
+	const float* getTable() const { return sineTable->getTable(); }
+
+	//Cubic Hermite between table[index] and table[index+1], slopes from the neighbours either side.
+	//Written as the linear term plus a correction, which keeps the float rounding down
+	static float interpolate(const float* table, int index, float fraction) noexcept {
+		float y0 = table[index];
+		float d = table[index + 1] - y0;
+		float m0 = 0.5f * (table[index + 1] - table[index - 1]);
+		float m1 = 0.5f * (table[index + 2] - y0);
+
+		return y0 + fraction * (d + (1.0f - fraction) * ((m0 - d) * (1.0f - fraction) - (m1 - d) * fraction));
+	}
+
+	static float interpolate(const float* table, float index) noexcept {
+		int i = (int)index;
+		return interpolate(table, i, index - (float)i);
+	}
+
+	//Audio thread, once per block before any voice renders. Picks up tables built since the last
+	//block, and asks for a new baked table when the partials have changed
+	void beginBlock(const ParameterSnapshot& parameters) noexcept;
+
+	//Every table by id, as of the last beginBlock, each laid out like getTable(). The array itself
+	//never moves, so voices keep the pointer rather than asking each block
+	const float* const* getTables() const noexcept { return tables; }
+
+	//Id of the table a partial of this waveform and frequency should read
+	static int getTableId(int waveform, double frequency, double sampleRate) noexcept;
+
+	//Whether the baked table matches the partials, as of the last beginBlock
+	bool hasHarmonicTable() const noexcept { return harmonicTableReady; }
+
+	//Id of the baked table level for a set on this base frequency (fundamental / denominator)
+	static int getHarmonicTableId(double baseFrequency, double sampleRate) noexcept;
+
+	//Message thread. Builds the user waveform from one cycle of any length, on a background thread
+	void setUserWaveform(const float* cycle, int length);
+
 private:
 
-	float table[TABLE_SIZE+1];
+	//Shared with every other SynthSound in the process
+	juce::SharedResourcePointer<SineTable> sineTable;
+	juce::SharedResourcePointer<WavetableLibrary> library;
+
+	//Waveform major, WAVETABLE_LEVELS per waveform, then WAVETABLE_LEVELS of the baked table
+	static constexpr int harmonicTableBase = Waveform::Num_Shapes * WAVETABLE_LEVELS;
+	const float* tables[harmonicTableBase + WAVETABLE_LEVELS];
+
+	WavetableCache userTables{ 1 };
+	WavetableCache harmonicTables{ HARMONIC_TABLE_CACHE };
+
+	//User waveform waiting to be built, message thread to builder
+	juce::CriticalSection pendingLock;
+	std::vector<float> pendingCycle;
+	bool hasPendingCycle = false;
+	juce::uint64 nextUserKey = 1;
+
+	//Everything a bake needs, copied out of the snapshot on the audio thread
+	struct HarmonicRequest {
+		juce::uint64 key = 0;
+		int numPartials = 0;
+		int harmonics[MAX_PARTIALS + 1];
+		float levels[MAX_PARTIALS + 1];
+		int waveforms[MAX_PARTIALS + 1];
+	};
+
+	//Audio thread to builder. Only the newest request matters, the builder skips the rest
+	LockFreeFifo<HarmonicRequest, 4> harmonicRequests;
+	HarmonicRequest outgoingRequest;
+	HarmonicRequest incomingRequest;
+	juce::uint64 requestedHarmonicKey = 0;
+	bool harmonicTableReady = false;
+
+	//Builds user and baked tables for every sound in the process, sleeping in between
+	class TableBuilder;
+	juce::SharedResourcePointer<TableBuilder> builder;
+
+	//Audio thread
+	void requestHarmonicTable(const ParameterSnapshot& parameters, juce::uint64 key) noexcept;
 
-	void generateTable(int length);
+	//Builder thread
+	void buildPendingUserTables();
+	void buildPendingHarmonicTables();
 };
\ No newline at end of file
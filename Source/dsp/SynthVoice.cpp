@@ -9,151 +9,404 @@
 */
 
 #include "SynthVoice.h"
+#include "OscillatorKernels.h"
+#include "../debug/RealtimeChecker.h"
 
-SynthVoice::~SynthVoice() {
+template <typename SampleType>
+SynthVoice<SampleType>::~SynthVoice() {
 	synthSound = nullptr;
 	DBG("Constructed Voice");
 }
 
-bool SynthVoice::canPlaySound(juce::SynthesiserSound*)
-{
-    return true;
+template <typename SampleType>
+void SynthVoice<SampleType>::setSound(SynthSound* sound) noexcept {
+	synthSound = sound;
+	tables = sound != nullptr ? sound->getTables() : nullptr;
 }
 
-void SynthVoice::startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound* sound, int currentPitchWheelPosition)
+template <typename SampleType>
+void SynthVoice<SampleType>::startNote(int midiNoteNumber, float velocity, int pitchWheelPosition, const float* controllerValues)
 {
-	synthSound = dynamic_cast<SynthSound*>(sound);
+	REALTIME_SECTION
 
-	jassert(synthSound != nullptr);
+	jassert(synthSound != nullptr); //setSound hasn't been called
 
 	this->velocity = velocity;
-	float frequency = juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber);
+	noteFrequency = (float)juce::MidiMessage::getMidiNoteInHertz(midiNoteNumber);
+	frequencies[0] = noteFrequency;
+	partialBank.resetPhases();
+	spectralSynth.reset();
+	partialsDirty = true;
 
-	frequencies[0] = frequency;
-	for (int i = 0; i <= numberOfPartials; i++) {
-		currentPos[i] = 0;
-	}
+	//Nothing rendered yet, assume it's as loud as it was hit so it isn't stolen straight away
+	lastPeak = velocity;
+
+	//Wheels and controllers as they were when the note came in, on this note's channel
+	modMatrix.noteOn(velocity, pitchWheelPosition, controllerValues);
 	
 	updateParams();
 
 	adsr.noteOn();
+	filterEnvelope.noteOn();
+	filterState[0] = filterState[1] = 0;
 }
 
-void SynthVoice::stopNote(float velocity, bool allowTailOff)
+template <typename SampleType>
+void SynthVoice<SampleType>::stopNote(float velocity, bool allowTailOff)
 {
-	adsr.noteOff();
+	if (allowTailOff) {
+		adsr.noteOff();
+		filterEnvelope.noteOff();
+		return;
+	}
+
+	//Stolen, or all notes off. The voice has to be free straight away, filter and all
+	adsr.reset();
+	filterEnvelope.reset();
+	filterState[0] = filterState[1] = 0;
+	lastPeak = 0.0f;
 }
 
-void SynthVoice::pitchWheelMoved(int newPitchWheelValue)
+template <typename SampleType>
+void SynthVoice<SampleType>::pitchWheelMoved(int newPitchWheelValue)
 {
+	modMatrix.setPitchWheel(newPitchWheelValue);
 }
 
-void SynthVoice::controllerMoved(int controllerNumber, int newControllerValue)
+template <typename SampleType>
+void SynthVoice<SampleType>::controllerMoved(int controllerNumber, int newControllerValue)
 {
+	modMatrix.setController(controllerNumber, newControllerValue);
 }
 
-void SynthVoice::initialise(APVTS& apvts) {
-	using namespace Params;
-	using APFloat = juce::AudioParameterFloat;
-	using APBool = juce::AudioParameterBool;
-	using APInt = juce::AudioParameterInt;
+template <typename SampleType>
+void SynthVoice<SampleType>::initialise(const ParameterSnapshot& snapshot) {
+	parameters = &snapshot;
+	maxPartials = snapshot.getMaxPartials();
+	partialsDirty = true;
 
-	auto params = getParams();
+	DBG("Initialised Voice");
+}
 
-	//Set number of initial harmonies
-	numberOfPartialsParam = dynamic_cast<APInt*>(apvts.getParameter(params.at(Names::Num_Partials)));
-	numberOfPartials = numberOfPartialsParam->get();
+template <typename SampleType>
+void SynthVoice<SampleType>::prepareToPlay(juce::dsp::ProcessSpec& spec) {
+	sampleRate = spec.sampleRate;
+	adsr.setSampleRate(sampleRate);
+	filterEnvelope.setSampleRate(sampleRate);
+	modMatrix.prepare(sampleRate);
 
-	//Hook up partial controls
-	for (int i = 0; i < MAX_PARTIALS; i++) {
-		partial_spaces[i] = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Partial_Distance) + juce::String(i+1)));
-		partial_volumes[i] = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Partial_Volume) + juce::String(i+1)));
-		partial_bypass[i]=dynamic_cast<APBool*>(apvts.getParameter(params.at(Names::Partial_Bypass) + juce::String(i+1)));
+	//The voice is mono, channels are filled from the one scratch channel
+	scratchBuffer.setSize(1, (int)spec.maximumBlockSize, false, true, false);
+	envelopeGains.calloc((size_t)spec.maximumBlockSize);
 
-		volumeWeights[i+1] = sqrt(i + 2);
+	if constexpr (envelopeAfterOscillators) {
+		oscillatorBuffer.calloc((size_t)spec.maximumBlockSize);
+		unityGains.malloc((size_t)spec.maximumBlockSize);
+		std::fill(unityGains.get(), unityGains.get() + spec.maximumBlockSize, 1.0f);
 	}
+	filterModulation.calloc((size_t)((int)spec.maximumBlockSize / CONTROL_SAMPLES + 1));
+
+	//Every per partial buffer is sized here, never while rendering
+	bakedSlot = maxPartials + 1;
+	const int numSlots = bakedSlot + 1;
+	frequencies.calloc((size_t)numSlots);
+	partialDeltas.calloc((size_t)numSlots);
+	partialGains.calloc((size_t)numSlots);
+	culledGains.calloc((size_t)numSlots);
+	partialTables.calloc((size_t)numSlots);
+
+	partialBank.prepare(numSlots, TABLE_SIZE, (int)(PARTIAL_GAIN_RAMP_SECONDS * sampleRate));
+	spectralSynth.prepare(maxPartials + 1, sampleRate);
+	partialsDirty = true;
+	DBG("Voice is prepared to play");
+}
 
-	//Envelope initialisation
-	attackParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Envelope_Attack)));
-	decayParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Envelope_Decay)));
-	sustainParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Envelope_Sustain)));
-	releaseParam = dynamic_cast<APFloat*>(apvts.getParameter(params.at(Names::Envelope_Release)));
+template <typename SampleType>
+void SynthVoice<SampleType>::renderNextBlock(juce::AudioBuffer<SampleType>& outputBuffer, int startSample, int numSamples)
+{
+	REALTIME_SECTION
 
-	DBG("Initialised Voice");
+	jassert(scratchBuffer.getNumSamples() > 0); //prepareToPlay hasn't been called
+	if (scratchBuffer.getNumSamples() == 0) return;
+
+	//Hosts may exceed the block size given to prepareToPlay, render in scratch sized chunks
+	while (numSamples > 0) {
+		int chunk = juce::jmin(numSamples, scratchBuffer.getNumSamples());
+		renderScratch(chunk);
+		addScratchTo(outputBuffer, startSample, chunk);
+
+		startSample += chunk;
+		numSamples -= chunk;
+	}
 }
 
-void SynthVoice::prepareToPlay(juce::dsp::ProcessSpec& spec) {
-	sampleRate = spec.sampleRate;
-	adsr.setSampleRate(sampleRate);
-	DBG("Voice is prepared to play");
+template <typename SampleType>
+void SynthVoice<SampleType>::renderScratch(int numSamples) {
+	if (beginScratch(numSamples))
+		renderBankPartials(numSamples);
+
+	endScratch(numSamples);
 }
 
-void SynthVoice::renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
-{
-	juce::AudioBuffer<float> buffer{ outputBuffer.getNumChannels(), outputBuffer.getNumSamples()};
-	buffer.clear();
+template <typename SampleType>
+bool SynthVoice<SampleType>::beginScratch(int numSamples) {
+	REALTIME_SECTION
+
+	jassert(numSamples <= scratchBuffer.getNumSamples());
+	auto startTicks = juce::Time::getHighResolutionTicks();
+	auto* output = getOscillatorOutput();
+	const float* gains = getOscillatorGains();
 
 	updateParams();
 
-	//float max = 0;
-
-	for (int sample = startSample; sample < numSamples; sample++) {
-		
-		double val = 0;
-		if (adsr.isActive() && synthSound != nullptr) {
-			val += synthSound->lookup(currentPos[0]);
-			for (int i = 1; i <= numberOfPartials; i++)
-				if (!isBypassed[i])
-					val += synthSound->lookup(currentPos[i]) * (volumes[i] / volumeWeights[i]);
-			val *= velocity;
-		}
-		//DBG(val);
-		//if (val > max) max = val;
+	sounding = adsr.isActive() && synthSound != nullptr;
+	if (sounding)
+		adsr.render(envelopeGains, numSamples);
+
+	//While an LFO or the filter envelope moves the partials they are updated every control step,
+	//ramping to the new gains over the step. Otherwise the whole chunk renders in one go
+	const bool stepped = sounding && stepping;
+	const float envelopeAmount = parameters->getFilterEnvelopeAmount();
 
-		
-		for (int channel = 0; channel < buffer.getNumChannels(); channel++) {
-			buffer.addSample(channel, sample, val);
+	for (int step = 0, start = 0; start < numSamples; step++, start += CONTROL_SAMPLES) {
+		const int length = juce::jmin(CONTROL_SAMPLES, numSamples - start);
+		const float envelope = filterEnvelope.advance(length);
+
+		modMatrix.evaluate(envelope, length);
+		filterModulation[step] = envelopeAmount * envelope + modMatrix.getCutoffOctaves();
+
+		if (stepped) {
+			updatePartials();
+			updateEngines(length);
+			renderPartials(output + start, gains + start, length);
 		}
+	}
+
+	//The partial bank's whole chunk is left to the caller, it may render it alongside other voices
+	bool partialsLeft = false;
+	if (!stepped) {
+		if (!sounding)
+			juce::FloatVectorOperations::clear(getScratch(), numSamples);
+		else if (synthesisMode == SynthesisMode::Inverse_FFT)
+			renderPartials(output, gains, numSamples);
+		else
+			partialsLeft = true;
+	}
 
-		for (int i = 0; i <= numberOfPartials; i++) {
-			currentPos[i] += deltas[i];
-			if (currentPos[i] > TABLE_SIZE) currentPos[i] -= TABLE_SIZE;
+	renderTicks += juce::Time::getHighResolutionTicks() - startTicks;
+	return partialsLeft;
+}
+
+template <typename SampleType>
+void SynthVoice<SampleType>::renderBankPartials(int numSamples) noexcept {
+	auto startTicks = juce::Time::getHighResolutionTicks();
+	partialBank.process(tables, getOscillatorGains(), getOscillatorOutput(), numSamples);
+	renderTicks += juce::Time::getHighResolutionTicks() - startTicks;
+}
+
+template <typename SampleType>
+void SynthVoice<SampleType>::endScratch(int numSamples) {
+	//The envelope in double, as the float sum goes into the scratch. A silent voice already cleared it
+	if constexpr (envelopeAfterOscillators) {
+		if (sounding) {
+			SampleType* scratch = getScratch();
+			for (int i = 0; i < numSamples; i++)
+				scratch[i] = (SampleType)oscillatorBuffer[i] * envelopeGains[i];
 		}
 	}
 
-	adsr.applyEnvelopeToBuffer(buffer, startSample, numSamples);
+	lastPeak = (float)scratchBuffer.getMagnitude(0, 0, numSamples);
+}
+
+template <typename SampleType>
+float* SynthVoice<SampleType>::getOscillatorOutput() noexcept {
+	if constexpr (envelopeAfterOscillators) return oscillatorBuffer.get();
+	else return scratchBuffer.getWritePointer(0);
+}
+
+template <typename SampleType>
+const float* SynthVoice<SampleType>::getOscillatorGains() const noexcept {
+	if constexpr (envelopeAfterOscillators) return unityGains.get();
+	else return envelopeGains.get();
+}
+
+template <typename SampleType>
+void SynthVoice<SampleType>::renderPartials(float* output, const float* gains, int numSamples) noexcept {
+	//The envelope goes in with the oscillator sum, not as a pass over the output after. Unit gains
+	//for a double voice, which has nothing to multiply
+	if (synthesisMode == SynthesisMode::Inverse_FFT) {
+		spectralSynth.process(output, numSamples);
+		if constexpr (!envelopeAfterOscillators)
+			juce::FloatVectorOperations::multiply(output, gains, numSamples);
+	}
+	else
+		partialBank.process(tables, gains, output, numSamples);
+}
+
+template <typename SampleType>
+void SynthVoice<SampleType>::addScratchTo(juce::AudioBuffer<SampleType>& outputBuffer, int startSample, int numSamples) const {
+	//Every channel from one read of the scratch, at the kernel variant's width
+	if constexpr (std::is_same_v<SampleType, float>) {
+		if (OscillatorKernels::mix(OscillatorKernels::getVariant(), scratchBuffer.getReadPointer(0), outputBuffer.getArrayOfWritePointers(),
+								   outputBuffer.getNumChannels(), startSample, numSamples))
+			return;
+	}
+
+	for (int channel = 0; channel < outputBuffer.getNumChannels(); channel++)
+		outputBuffer.addFrom(channel, startSample, scratchBuffer, 0, 0, numSamples);
+}
+
+template <typename SampleType>
+void SynthVoice<SampleType>::updateParams() {
+	jassert(parameters != nullptr); //initialise hasn't been called
+
+	if (partialsDirty || parameters->getEnvelopeVersion() != envelopeVersion) {
+		envelopeVersion = parameters->getEnvelopeVersion();
+		adsr.setParameters(parameters->getEnvelope());
+		filterEnvelope.setParameters(parameters->getFilterEnvelope());
+	}
+
+	modMatrix.setParameters(*parameters);
 
-	for (int channel = 0; channel < outputBuffer.getNumChannels(); channel++) {
-		outputBuffer.addFrom(channel, startSample, buffer, channel, startSample, numSamples);
+	//Partials the matrix moves are redone every control step, or when the slots or a held source like
+	//velocity or a wheel change. Once it lets go, or stops stepping, they need putting back once more
+	const bool modulating = modMatrix.modulatesPartials();
+	const bool moving = modulating && modMatrix.movesPartials();
+	const bool matrixChanged = modMatrix.getVersion() != matrixVersion;
+	const bool partialsChanged = partialsDirty || parameters->getPartialsVersion() != partialsVersion
+							   || modulating != modulated || moving != stepping || (modulating && matrixChanged);
+	modulated = modulating;
+	stepping = moving;
+	matrixVersion = modMatrix.getVersion();
+
+	if (partialsChanged) {
+		partialsVersion = parameters->getPartialsVersion();
+
+		//The last evaluate may be from before the change, or the last note
+		if (modulated)
+			modMatrix.evaluateSlots();
+
+		updatePartials();
 	}
 
+	//Checked every block, the table turns up some time after the partials change. Moving partials aren't harmonic
+	const bool bake = !modulated && canUseHarmonicTable();
+
+	//Nothing moved, the engines already have the culled partials
+	if (!partialsChanged && bake == baked && parameters->getRenderingVersion() == renderingVersion) return;
+
+	baked = bake;
+	renderingVersion = parameters->getRenderingVersion();
+	synthesisMode = parameters->getSynthesisMode();
+	partialsDirty = false;
 
-	//if (max != 0)DBG(max);
+	updateEngines(0);
 }
 
-void SynthVoice::updateParams() {
-	numberOfPartials = numberOfPartialsParam->get();
+template <typename SampleType>
+void SynthVoice<SampleType>::updatePartials() noexcept {
+	numberOfPartials = juce::jmin(parameters->getNumPartials(), maxPartials);
 
-	//gain.setGainLinear(masterGain->get());
-	
-	for (int i = 1; i <= numberOfPartials; i++) {
-		//Partials are offset by one
-		// If the frequency is being determined from the previous frequency use this 
-		//frequencies[i] = frequencies[i - 1] * (1 + partial_spaces[i-1]->get());
-		//If the frequency is determined from the fundamental, use this
-		frequencies[i] = frequencies[0] * (1 + partial_spaces[i-1]->get());
-		volumes[i] = partial_volumes[i-1]->get();
-		isBypassed[i] = partial_bypass[i-1]->get();
+	const float* ratios = parameters->getPartialRatios();
+	const float* levels = parameters->getPartialLevels();
+	const int* waveforms = parameters->getPartialWaveforms();
+
+	//Unmodulated, this is just the note and the snapshot's values
+	frequencies[0] = noteFrequency * (modulated ? modMatrix.getPitchRatio() : 1.0f);
+
+	for (int i = 0; i <= numberOfPartials; i++) {
+		float ratio = ratios[i];
+		float level = levels[i];
+
+		//The fundamental has no distance or volume of its own
+		if (modulated && i > 0) {
+			ratio = 1.0f + (ratio - 1.0f) * juce::jmax(0.0f, 1.0f + modMatrix.getPartialModulation(ModDestination::Partial_Distance, i, numberOfPartials));
+			level *= juce::jlimit(0.0f, 2.0f, 1.0f + modMatrix.getPartialModulation(ModDestination::Partial_Volume, i, numberOfPartials));
+		}
+
+		frequencies[i] = frequencies[0] * ratio;
+
+		//Velocity and the snapshot's levels fold into one gain per partial
+		partialDeltas[i] = PartialBank::getPhaseDelta(frequencies[i], sampleRate);
+		partialGains[i] = velocity * level;
+
+		//The wavetable level depends on the frequency, so it's picked per note
+		partialTables[i] = SynthSound::getTableId(waveforms[i], frequencies[i], sampleRate);
+	}
+}
+
+template <typename SampleType>
+void SynthVoice<SampleType>::updateEngines(int rampSamples) noexcept {
+	cullPartials((float)(0.5 * sampleRate) * parameters->getNyquistFraction(), parameters->getAmplitudeFloor());
+
+	//Only the engine in use is kept up to date. The inverse FFT only has sines, it ignores partial waveforms
+	if (synthesisMode == SynthesisMode::Inverse_FFT) {
+		spectralSynth.update(numberOfPartials + 1, frequencies, culledGains);
+	}
+	else if (baked) {
+		//The partials ramp out as the baked table ramps in. Its phase has run at the base
+		//frequency since the note started, so it lines up with the partials it replaces
+		const double baseFrequency = frequencies[0] / parameters->getHarmonicDenominator();
+		const double nyquistRate = sampleRate * parameters->getNyquistFraction();
+
+		std::fill(culledGains.get(), culledGains.get() + bakedSlot, 0.0f);
+		culledGains[bakedSlot] = velocity;
+		partialDeltas[bakedSlot] = PartialBank::getPhaseDelta(baseFrequency, sampleRate);
+		partialTables[bakedSlot] = SynthSound::getHarmonicTableId(baseFrequency, nyquistRate);
+
+		partialBank.update(bakedSlot + 1, partialDeltas, culledGains, partialTables, rampSamples);
+	}
+	else {
+		//Muted and culled partials ramp out of the bank, then are left out entirely
+		partialBank.update(numberOfPartials + 1, partialDeltas, culledGains, partialTables, rampSamples);
 	}
+}
+
+template <typename SampleType>
+bool SynthVoice<SampleType>::canUseHarmonicTable() const noexcept {
+	if (parameters->getSynthesisMode() != SynthesisMode::Harmonic_Table || parameters->getHarmonicDenominator() == 0) return false;
+	if (synthSound == nullptr || !synthSound->hasHarmonicTable()) return false;
 
-	juce::ADSR::Parameters adsrParams{attackParam->get() + 0.005f,
-									  decayParam->get() + 0.005f,
-									  sustainParam->get(),
-									  releaseParam->get() + 0.005f};
+	//Level n of the table holds harmonics up to 2^n, the partials are only all there if the highest fits
+	const double baseFrequency = frequencies[0] / parameters->getHarmonicDenominator();
+	const int level = MipmappedWavetable::getLevelFor(baseFrequency, sampleRate * parameters->getNyquistFraction());
+	return parameters->getHighestHarmonic() <= (1 << level);
+}
 
-	adsr.setParameters(adsrParams);
+template <typename SampleType>
+void SynthVoice<SampleType>::cullPartials(float nyquistLimit, float amplitudeFloor) {
+	CullingStats stats;
 
 	for (int i = 0; i <= numberOfPartials; i++) {
-		deltas[i] = (TABLE_SIZE * frequencies[i]) / sampleRate;
+		float gain = partialGains[i];
+
+		if (gain != 0.0f) {
+			if (frequencies[i] > nyquistLimit) {
+				//Would alias
+				gain = 0.0f;
+				stats.culledAboveNyquist++;
+			}
+			else if (gain < amplitudeFloor) {
+				//Inaudible
+				gain = 0.0f;
+				stats.culledBelowFloor++;
+			}
+			else {
+				stats.rendered++;
+			}
+		}
+
+		culledGains[i] = gain;
 	}
+
+	cullingStats = stats;
+}
+
+template <typename SampleType>
+CullingStats SynthVoice<SampleType>::getCullingStats() const {
+	return adsr.isActive() ? cullingStats : CullingStats{};
 }
+
+
+template class SynthVoice<float>;
+template class SynthVoice<double>;
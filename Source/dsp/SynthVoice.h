@@ -3,9 +3,18 @@
 
     SynthVoice.h
     
-	Implementation of juce::SynthesiserVoice
+	One voice of AdditiveSynthesiser
 
-	Contains all information related to specific voices of the synthesiser
+	Contains all information related to specific voices of the synthesiser.
+	Which note and channel it's playing, and whether the key is still held,
+	is kept by the synth. Nothing in here is virtual, the synth calls it
+	directly.
+
+	Float or double, as the host processes. The oscillators read float tables
+	either way. A float voice applies its envelope as the oscillators sum,
+	straight into its scratch. A double voice sums them at unity gain into a
+	float buffer, then applies a double envelope on the way into a double
+	scratch, which is filtered and mixed in double from there.
 
   ==============================================================================
 */
@@ -13,50 +22,184 @@
 #pragma once
 #include "../GlobalDefines.h"
 #include "SynthSound.h"
-#include <array>
+#include "PartialBank.h"
+#include "SpectralSynth.h"
+#include "ParameterSnapshot.h"
+#include "Envelope.h"
+#include "ModMatrix.h"
 
 #define HARMONICS 3 
 
-class SynthVoice : public juce::SynthesiserVoice {
+//How many partials a voice renders, and how many it dropped and why
+struct CullingStats {
+	int rendered = 0;
+	int culledAboveNyquist = 0;
+	int culledBelowFloor = 0;
+};
+
+template <typename SampleType>
+class SynthVoice {
 public:
 	~SynthVoice();
-	bool canPlaySound(juce::SynthesiserSound*) override;
-	void startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound* sound, int currentPitchWheelPosition) override;
-	void stopNote(float velocity, bool allowTailOff) override;
-	void pitchWheelMoved(int newPitchWheelValue) override;
-	void controllerMoved(int controllerNumber, int newControllerValue) override;
-	void renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) override;
+
+	//Binds the sound and its tables, once before any note. It has to outlive the voice
+	void setSound(SynthSound* sound) noexcept;
+
+	//Controller values are the matrix's, Mod_Wheel onwards, as they were on the note's channel
+	void startNote(int midiNoteNumber, float velocity, int pitchWheelPosition, const float* controllerValues = nullptr);
+
+	//Without tail off the voice is silent, and finished, straight away
+	void stopNote(float velocity, bool allowTailOff);
+	void pitchWheelMoved(int newPitchWheelValue);
+	void controllerMoved(int controllerNumber, int newControllerValue);
+
+	//Renders and adds to every channel of outputBuffer, in scratch sized chunks
+	void renderNextBlock(juce::AudioBuffer<SampleType>& outputBuffer, int startSample, int numSamples);
 
 	void prepareToPlay(juce::dsp::ProcessSpec& spec);
-	void initialise(APVTS& apvts);
+	//The snapshot has to outlive the voice
+	void initialise(const ParameterSnapshot& snapshot);
+
+	//Renders numSamples, at most getScratchSize(), into the voice's own scratch buffer.
+	//Touches nothing shared, so different voices can render on different threads
+	void renderScratch(int numSamples);
+
+	//renderScratch in halves, so the partials of several voices can render together in between (see
+	//PartialBank::processInterleaved). beginScratch does everything else, and returns true if the
+	//partial bank's chunk is still to render, with getOscillatorGains into getOscillatorOutput. Then
+	//either renderBankPartials or the caller renders it, and endScratch follows whatever beginScratch returned
+	bool beginScratch(int numSamples);
+	void renderBankPartials(int numSamples) noexcept;
+	void endScratch(int numSamples);
+
+	PartialBank& getPartialBank() noexcept { return partialBank; }
+	const float* const* getTables() const noexcept { return tables; }
+
+	//Where the oscillators render, and the gain per sample they apply as they sum. The envelope and
+	//the scratch for a float voice, unity and a float buffer for a double one, see endScratch
+	float* getOscillatorOutput() noexcept;
+	const float* getOscillatorGains() const noexcept;
+
+	//Time spent rendering this voice somewhere else, eg its share of an interleaved group
+	void addRenderTicks(juce::int64 ticks) noexcept { renderTicks += ticks; }
+
+	//Adds what the last renderScratch left behind to every output channel
+	void addScratchTo(juce::AudioBuffer<SampleType>& outputBuffer, int startSample, int numSamples) const;
+
+	int getScratchSize() const noexcept { return scratchBuffer.getNumSamples(); }
+
+	//The last renderScratch's output, and its cutoff modulation in octaves (filter envelope and
+	//matrix), one value per CONTROL_SAMPLES from the start of the chunk. For VoiceFilter, which
+	//filters it in place
+	SampleType* getScratch() noexcept { return scratchBuffer.getWritePointer(0); }
+	const float* getFilterModulation() const noexcept { return filterModulation.get(); }
+
+	//Integrator states of this voice's filter, kept between blocks
+	SampleType* getFilterState() noexcept { return filterState; }
+
+	//Nothing left ringing in the filter, so the voice can go once its release is over
+	bool isFilterSettled() const noexcept {
+		return std::abs(filterState[0]) < FILTER_TAIL_THRESHOLD && std::abs(filterState[1]) < FILTER_TAIL_THRESHOLD;
+	}
+
+	//Release over and the filter rung out, the synth can give the voice a new note. The filter states
+	//are from the last chunk's filtering, so it's a chunk late at most
+	bool isFinished() const noexcept { return !adsr.isActive() && isFilterSettled(); }
+
+	//Peak of the last chunk rendered, for picking the quietest voice to steal
+	float getLastPeak() const noexcept { return lastPeak; }
+
+	//High resolution ticks spent rendering since the last call
+	juce::int64 takeRenderTicks() noexcept {
+		auto ticks = renderTicks;
+		renderTicks = 0;
+		return ticks;
+	}
+
+	//Zero while the voice is silent
+	CullingStats getCullingStats() const;
 private:
-	float velocity;
-	std::array<float, MAX_PARTIALS+1> frequencies{};
-	std::array<float, MAX_PARTIALS+1> volumes{ 1 };
-	std::array<float, MAX_PARTIALS+1> volumeWeights{1};
-	std::array<bool, MAX_PARTIALS+1> isBypassed{ false };
+	float velocity = 0.0f;
+	float noteFrequency = 0.0f;
+
+	//Per partial state, fundamental at 0, then bakedSlot. Sized in prepareToPlay
+	juce::HeapBlock<float> frequencies;
+	juce::HeapBlock<juce::uint32> partialDeltas;
+	juce::HeapBlock<float> partialGains;
+	juce::HeapBlock<float> culledGains;
+	juce::HeapBlock<int> partialTables;
+
+	//Phases, deltas and gains of the audible partials
+	PartialBank partialBank;
+
+	//Bank slot past every partial for the baked harmonic table, at fundamental / denominator
+	int bakedSlot = 0;
+	bool baked = false;
+
+	//Inverse FFT engine, for dense spectra
+	SpectralSynth spectralSynth;
+	int synthesisMode = SYNTHESIS_MODE_DEF;
+
+	//Read once per block by the processor. Versions are the last ones this voice worked from
+	const ParameterSnapshot* parameters{ nullptr };
+	juce::uint32 partialsVersion = 0;
+	juce::uint32 envelopeVersion = 0;
+	juce::uint32 renderingVersion = 0;
 
-	std::array<float, MAX_PARTIALS+1> deltas{};
-	std::array<float, MAX_PARTIALS+1> currentPos{};
+	//Set on a new note or sample rate, redoes everything whatever the versions say
+	bool partialsDirty = true;
+	CullingStats cullingStats;
 
 	double sampleRate;
-	int numberOfPartials;
+	int numberOfPartials = 0;
+	int maxPartials = 0;
 
-	juce::AudioParameterInt* numberOfPartialsParam;
+	//Amplitude envelope, rendered a chunk ahead into envelopeGains for the oscillators to apply
+	Envelope<SampleType> adsr;
+	juce::HeapBlock<SampleType> envelopeGains;
 
-	//Partials are offset by one, ie the 0th position is 1
-	std::array<juce::AudioParameterFloat*, MAX_PARTIALS> partial_spaces{nullptr};
-	std::array<juce::AudioParameterFloat*, MAX_PARTIALS> partial_volumes{nullptr};
-	std::array<juce::AudioParameterBool*, MAX_PARTIALS> partial_bypass{nullptr};
+	//Filter envelope, sampled at control rate into filterModulation
+	Envelope<float> filterEnvelope;
+	juce::HeapBlock<float> filterModulation;
+	SampleType filterState[2] = {};
 
-	juce::ADSR adsr;
-	juce::AudioParameterFloat* attackParam{ nullptr };
-	juce::AudioParameterFloat* decayParam{ nullptr };
-	juce::AudioParameterFloat* sustainParam{ nullptr };
-	juce::AudioParameterFloat* releaseParam{ nullptr };
+	//LFOs, wheels and controllers. Evaluated every control step, whether or not anything is routed
+	ModMatrix modMatrix;
+
+	//The matrix moves the partials. Only a source that moves by itself has them updated every control
+	//step, the others are applied when they change
+	bool modulated = false;
+	bool stepping = false;
+	juce::uint32 matrixVersion = 0;
+
+	//Scratch space for one voice, sized in prepareToPlay so rendering never allocates
+	juce::AudioBuffer<SampleType> scratchBuffer;
+	float lastPeak = 0.0f;
+
+	//Double only, the oscillators' sum before the envelope and the unit gains they sum with
+	static constexpr bool envelopeAfterOscillators = !std::is_same_v<SampleType, float>;
+	juce::HeapBlock<float> oscillatorBuffer;
+	juce::HeapBlock<float> unityGains;
+
+	//The envelope was rendered for the chunk in beginScratch, so endScratch applies it
+	bool sounding = false;
+	juce::int64 renderTicks = 0;
 
 	void updateParams();
 
-	//To implement Wavetable lookup..
+	//Frequencies, deltas, gains and tables of every partial, from the snapshot and the matrix
+	void updatePartials() noexcept;
+
+	//Culls and hands the partials to the engine in use. Gains ramp over rampSamples, 0 for the usual ramp
+	void updateEngines(int rampSamples) noexcept;
+
+	void renderPartials(float* output, const float* gains, int numSamples) noexcept;
+
+	//Harmonic Table mode, and a table that holds every audible partial at this note is ready
+	bool canUseHarmonicTable() const noexcept;
+	void cullPartials(float nyquistLimit, float amplitudeFloor);
+
+	//To implement Wavetable lookup.. Bound by setSound, the tables array never moves
 	SynthSound* synthSound = nullptr;
+	const float* const* tables = nullptr;
 };
\ No newline at end of file
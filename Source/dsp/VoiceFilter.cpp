@@ -0,0 +1,150 @@
+/*
+  ==============================================================================
+
+    VoiceFilter.cpp
+
+  ==============================================================================
+*/
+
+#include "VoiceFilter.h"
+#include "SynthVoice.h"
+
+template <typename SampleType>
+void VoiceFilter<SampleType>::prepare(double newSampleRate, int maximumBlockSize, float initialCutoff) {
+	sampleRate = newSampleRate;
+
+	//Just below Nyquist, where tan blows up
+	maxCutoff = juce::jmin(FILTER_CUTOFF_MAX, (float)(0.49 * sampleRate));
+
+	cutoff.reset(sampleRate, FILTER_CUTOFF_RAMP_SECONDS);
+	cutoff.setCurrentAndTargetValue(initialCutoff);
+	stepCutoffs.calloc((size_t)(maximumBlockSize / CONTROL_SAMPLES + 1));
+}
+
+template <typename SampleType>
+void VoiceFilter<SampleType>::setParameters(const ParameterSnapshot& parameters) noexcept {
+	cutoff.setTargetValue(parameters.getFilterCutoff());
+
+	//The SVF has no output at all with no resonance
+	resonance = juce::jmax(parameters.getFilterResonance(), 0.001f);
+	bypassed = parameters.isFilterBypassed();
+}
+
+template <typename SampleType>
+SampleType VoiceFilter<SampleType>::getWarpedCutoff(float baseCutoff, float modulation) const noexcept {
+	float frequency = baseCutoff * std::exp2(modulation);
+	frequency = juce::jlimit(FILTER_CUTOFF_MIN, maxCutoff, frequency);
+	return (SampleType)std::tan(juce::MathConstants<double>::pi * frequency / sampleRate);
+}
+
+template <typename SampleType>
+void VoiceFilter<SampleType>::process(const juce::Array<SynthVoice<SampleType>*>& voices, int numSamples) noexcept {
+	const int numSteps = (numSamples + CONTROL_SAMPLES - 1) / CONTROL_SAMPLES;
+
+	//The base cutoff glides the same for every voice, so it's worked out once
+	for (int step = 0; step < numSteps; step++) {
+		stepCutoffs[step] = cutoff.getCurrentValue();
+		cutoff.skip(juce::jmin(CONTROL_SAMPLES, numSamples - step * CONTROL_SAMPLES));
+	}
+
+	if (bypassed) {
+		//Starts from silence when it comes back
+		for (auto* voice : voices) {
+			auto* state = voice->getFilterState();
+			state[0] = state[1] = 0;
+		}
+		return;
+	}
+
+	for (int first = 0; first < voices.size(); first += lanes)
+		processGroup(voices.begin() + first, juce::jmin(lanes, voices.size() - first), numSamples, numSteps);
+}
+
+template <typename SampleType>
+void VoiceFilter<SampleType>::processGroup(SynthVoice<SampleType>* const* first, int numVoices, int numSamples, int numSteps) noexcept {
+	SampleType* channels[lanes];
+	const float* modulations[lanes];
+
+	//Unused lanes run on silence
+	alignas(64) SampleType state1[lanes] = {};
+	alignas(64) SampleType state2[lanes] = {};
+	alignas(64) SampleType g[lanes];
+	alignas(64) SampleType r2PlusG[lanes];
+	alignas(64) SampleType h[lanes];
+
+	const SampleType r2 = 1 / (SampleType)resonance;
+
+	for (int lane = 0; lane < numVoices; lane++) {
+		channels[lane] = first[lane]->getScratch();
+		modulations[lane] = first[lane]->getFilterModulation();
+		state1[lane] = first[lane]->getFilterState()[0];
+		state2[lane] = first[lane]->getFilterState()[1];
+	}
+
+#if JUCE_USE_SIMD
+	alignas(64) SampleType input[lanes] = {};
+	alignas(64) SampleType output[lanes];
+
+	auto s1 = SampleVec::fromRawArray(state1);
+	auto s2 = SampleVec::fromRawArray(state2);
+#endif
+
+	for (int step = 0; step < numSteps; step++) {
+		const int start = step * CONTROL_SAMPLES;
+		const int end = juce::jmin(numSamples, start + CONTROL_SAMPLES);
+
+		//Control rate, one tan per voice per step
+		for (int lane = 0; lane < lanes; lane++) {
+			float modulation = lane < numVoices ? modulations[lane][step] : 0.0f;
+			g[lane] = getWarpedCutoff(stepCutoffs[step], modulation);
+			r2PlusG[lane] = r2 + g[lane];
+			h[lane] = 1 / (1 + r2 * g[lane] + g[lane] * g[lane]);
+		}
+
+#if JUCE_USE_SIMD
+		const auto gv = SampleVec::fromRawArray(g);
+		const auto r2g = SampleVec::fromRawArray(r2PlusG);
+		const auto hv = SampleVec::fromRawArray(h);
+
+		for (int sample = start; sample < end; sample++) {
+			//No gather in SIMDRegister, voices go in and out a lane at a time
+			for (int lane = 0; lane < numVoices; lane++)
+				input[lane] = channels[lane][sample];
+
+			auto highpass = hv * (SampleVec::fromRawArray(input) - r2g * s1 - s2);
+			auto bandpass = gv * highpass + s1;
+			s1 = gv * highpass + bandpass;
+			auto lowpass = gv * bandpass + s2;
+			s2 = gv * bandpass + lowpass;
+
+			lowpass.copyToRawArray(output);
+			for (int lane = 0; lane < numVoices; lane++)
+				channels[lane][sample] = output[lane];
+		}
+#else
+		for (int sample = start; sample < end; sample++) {
+			SampleType highpass = h[0] * (channels[0][sample] - r2PlusG[0] * state1[0] - state2[0]);
+			SampleType bandpass = g[0] * highpass + state1[0];
+			state1[0] = g[0] * highpass + bandpass;
+			SampleType lowpass = g[0] * bandpass + state2[0];
+			state2[0] = g[0] * bandpass + lowpass;
+			channels[0][sample] = lowpass;
+		}
+#endif
+	}
+
+#if JUCE_USE_SIMD
+	s1.copyToRawArray(state1);
+	s2.copyToRawArray(state2);
+#endif
+
+	//Denormals would creep in as a voice goes quiet
+	for (int lane = 0; lane < numVoices; lane++) {
+		auto* state = first[lane]->getFilterState();
+		state[0] = std::abs(state1[lane]) < (SampleType)1.0e-8 ? 0 : state1[lane];
+		state[1] = std::abs(state2[lane]) < (SampleType)1.0e-8 ? 0 : state2[lane];
+	}
+}
+
+template class VoiceFilter<float>;
+template class VoiceFilter<double>;
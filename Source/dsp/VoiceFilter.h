@@ -0,0 +1,73 @@
+/*
+  ==============================================================================
+
+    VoiceFilter.h
+
+	Lowpass state variable filter (TPT, like juce::dsp::StateVariableTPTFilter)
+	on every voice, with the cutoff moved by the voice's filter envelope and
+	modulation matrix.
+
+	Voices are filtered a SIMD register at a time, one voice per lane, so a
+	handful of voices costs about what one filter on the mix used to. Each
+	voice keeps its own integrator states, they are loaded into the lanes at
+	the start of a chunk and stored back at the end, so it doesn't matter
+	which voices end up sharing a register.
+
+	Coefficients are worked out at control rate, once every CONTROL_SAMPLES
+	per voice, from the smoothed base cutoff and the voice's modulation in
+	octaves. The filter runs on the voice output after the amplitude envelope.
+
+	Float or double, as the voices it filters. The integrator states are in
+	SampleType too, which is where double pays off, at low cutoffs.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+#include "ParameterSnapshot.h"
+
+template <typename SampleType>
+class SynthVoice;
+
+template <typename SampleType>
+class VoiceFilter {
+public:
+#if JUCE_USE_SIMD
+	using SampleVec = juce::dsp::SIMDRegister<SampleType>;
+	static constexpr int lanes = (int)SampleVec::SIMDNumElements;
+#else
+	static constexpr int lanes = 1;
+#endif
+
+	//Call from prepareToPlay. The cutoff starts where it is, rather than gliding in
+	void prepare(double sampleRate, int maximumBlockSize, float initialCutoff);
+
+	//Audio thread, once per block. The cutoff glides, the rest applies straight away
+	void setParameters(const ParameterSnapshot& parameters) noexcept;
+
+	//Filters the first numSamples of each voice's scratch buffer in place. Voices have to
+	//have rendered the same chunk, from its start, so their filter envelopes line up
+	void process(const juce::Array<SynthVoice<SampleType>*>& voices, int numSamples) noexcept;
+
+	//Moves the cutoff glide on numSamples, for blocks with no voices to filter
+	void skip(int numSamples) noexcept { cutoff.skip(numSamples); }
+
+private:
+	double sampleRate = 44100.0;
+	float maxCutoff = 20000.0f;
+
+	//Glides in equal ratios, so sweeps sound even across the range
+	juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> cutoff;
+	float resonance = FILTER_RESONANCE_DEF;
+	bool bypassed = false;
+
+	//Base cutoff at each control step of the chunk being filtered
+	juce::HeapBlock<float> stepCutoffs;
+
+	//Up to lanes voices from first, numSteps control steps
+	void processGroup(SynthVoice<SampleType>* const* first, int numVoices, int numSamples, int numSteps) noexcept;
+
+	//g of the TPT filter for one voice at one step
+	SampleType getWarpedCutoff(float baseCutoff, float modulation) const noexcept;
+};
@@ -0,0 +1,182 @@
+/*
+  ==============================================================================
+
+    VoiceRenderPool.cpp
+
+  ==============================================================================
+*/
+
+#include "VoiceRenderPool.h"
+#include "../debug/RealtimeChecker.h"
+
+#if JUCE_INTEL
+ #include <immintrin.h>
+#endif
+#include <thread>
+
+namespace {
+	inline void spinPause() noexcept {
+	#if JUCE_INTEL
+		_mm_pause();
+	#else
+		std::this_thread::yield();
+	#endif
+	}
+}
+
+class VoiceRenderPool::Worker : public juce::Thread {
+public:
+	Worker(VoiceRenderPool& owner, int participantIndex)
+		: juce::Thread("Voice Render " + juce::String(participantIndex)), pool(owner), participant(participantIndex)
+	{
+	}
+
+	void run() override {
+		auto seen = pool.generation.load(std::memory_order_acquire);
+
+		while (!threadShouldExit()) {
+			const double spinMs = pool.workerSpinMs.load(std::memory_order_relaxed);
+			auto spinStart = juce::Time::getMillisecondCounterHiRes();
+			auto current = pool.generation.load(std::memory_order_acquire);
+
+			while (current == seen) {
+				if (threadShouldExit()) return;
+
+				if (juce::Time::getMillisecondCounterHiRes() - spinStart > spinMs) {
+					//Sleep, but check again after saying so, run() looks at sleeping after bumping the generation
+					sleeping.store(true);
+					if (pool.generation.load() == seen)
+						wakeEvent.wait(100);
+					sleeping.store(false);
+
+					spinStart = juce::Time::getMillisecondCounterHiRes();
+				}
+				else {
+					spinPause();
+				}
+
+				current = pool.generation.load(std::memory_order_acquire);
+			}
+
+			seen = current;
+			pool.work(participant);
+		}
+	}
+
+	void wake() noexcept {
+		if (sleeping.load())
+			wakeEvent.signal();
+	}
+
+	juce::WaitableEvent wakeEvent;
+
+private:
+	VoiceRenderPool& pool;
+	const int participant;
+	std::atomic<bool> sleeping{ false };
+};
+
+VoiceRenderPool::VoiceRenderPool(int numWorkers, double spinMs) : workerSpinMs(spinMs) {
+	//Participant 0 is whichever thread calls run()
+	numParticipants = numWorkers + 1;
+	ranges.reset(new TaskRange[(size_t)numParticipants]);
+
+	for (int i = 0; i < numWorkers; i++) {
+		auto* worker = workers.add(new Worker(*this, i + 1));
+		worker->startRealtimeThread(juce::Thread::RealtimeOptions{});
+	}
+
+	DBG("Voice render pool started with " << numWorkers << " workers");
+}
+
+VoiceRenderPool::~VoiceRenderPool() {
+	for (auto* worker : workers) {
+		worker->signalThreadShouldExit();
+		worker->wakeEvent.signal();
+	}
+
+	for (auto* worker : workers)
+		worker->stopThread(1000);
+}
+
+void VoiceRenderPool::run(TaskFunction function, void* context, int numTasks) noexcept {
+	if (numTasks <= 0) return;
+
+	//Every range is empty here, so nothing reads these until the ranges below are published
+	taskFunction = function;
+	taskContext = context;
+	tasksRemaining.store(numTasks, std::memory_order_relaxed);
+
+	//Contiguous share per participant, the first ones take the remainder
+	const int share = numTasks / numParticipants;
+	const int extra = numTasks % numParticipants;
+	int begin = 0;
+	for (int p = 0; p < numParticipants; p++) {
+		int end = begin + share + (p < extra ? 1 : 0);
+		ranges[p].range.store(pack((juce::uint32)begin, (juce::uint32)end), std::memory_order_release);
+		begin = end;
+	}
+
+	generation.fetch_add(1);
+
+	{
+		//Only reached for a worker that fell asleep, the event takes a lock
+		REALTIME_ALLOWANCE
+		for (auto* worker : workers)
+			worker->wake();
+	}
+
+	work(0);
+
+	//Wait for tasks other participants took but haven't finished
+	while (tasksRemaining.load(std::memory_order_acquire) > 0)
+		spinPause();
+}
+
+bool VoiceRenderPool::takeFront(int participant, int& task) noexcept {
+	auto& range = ranges[participant].range;
+	auto current = range.load(std::memory_order_acquire);
+
+	for (;;) {
+		auto begin = (juce::uint32)(current & 0xffffffffu);
+		auto end = (juce::uint32)(current >> 32);
+		if (begin >= end) return false;
+
+		if (range.compare_exchange_weak(current, pack(begin + 1, end), std::memory_order_acq_rel, std::memory_order_acquire)) {
+			task = (int)begin;
+			return true;
+		}
+	}
+}
+
+bool VoiceRenderPool::stealBack(int participant, int& task) noexcept {
+	auto& range = ranges[participant].range;
+	auto current = range.load(std::memory_order_acquire);
+
+	for (;;) {
+		auto begin = (juce::uint32)(current & 0xffffffffu);
+		auto end = (juce::uint32)(current >> 32);
+		if (begin >= end) return false;
+
+		if (range.compare_exchange_weak(current, pack(begin, end - 1), std::memory_order_acq_rel, std::memory_order_acquire)) {
+			task = (int)end - 1;
+			return true;
+		}
+	}
+}
+
+void VoiceRenderPool::work(int participant) noexcept {
+	int task = 0;
+
+	for (;;) {
+		bool found = takeFront(participant, task);
+
+		for (int i = 1; !found && i < numParticipants; i++)
+			found = stealBack((participant + i) % numParticipants, task);
+
+		if (!found) return;
+
+		taskFunction(taskContext, task);
+		tasksRemaining.fetch_sub(1, std::memory_order_acq_rel);
+	}
+}
@@ -0,0 +1,67 @@
+/*
+  ==============================================================================
+
+    VoiceRenderPool.h
+
+	Pool of real-time priority workers that render voices in parallel.
+
+	The audio thread hands out a batch of tasks and works on it too. Tasks are
+	split into one contiguous range per participant. Each participant takes
+	tasks from the front of its own range and, once that is empty, steals from
+	the back of the others'. A range is one packed atomic word, so taking and
+	stealing are both a single compare-exchange, with no locks.
+
+	Workers spin for a short while after each batch, a fraction of the block
+	period, so the batches within one block never have to wake them. Then
+	they sleep until the next block, so idle instances don't hold cores. Only
+	a worker that went to sleep needs its event signalled.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+
+class VoiceRenderPool {
+public:
+	//Runs one task. Plain function pointer, so handing out a batch never allocates
+	using TaskFunction = void (*)(void* context, int taskIndex);
+
+	VoiceRenderPool(int numWorkers, double spinMs);
+	~VoiceRenderPool();
+
+	int getNumWorkers() const noexcept { return workers.size(); }
+
+	//How long a worker keeps spinning for the next batch before it goes to sleep. Any thread
+	void setSpinTime(double spinMs) noexcept { workerSpinMs.store(spinMs); }
+
+	//Runs numTasks tasks across the workers and the calling thread, returns when all are done
+	void run(TaskFunction function, void* context, int numTasks) noexcept;
+
+private:
+	class Worker;
+
+	//Front and back of a participant's remaining tasks, packed in one word
+	struct alignas(64) TaskRange {
+		std::atomic<juce::uint64> range{ 0 };
+	};
+
+	static juce::uint64 pack(juce::uint32 begin, juce::uint32 end) noexcept { return ((juce::uint64)end << 32) | begin; }
+
+	bool takeFront(int participant, int& task) noexcept;
+	bool stealBack(int participant, int& task) noexcept;
+	void work(int participant) noexcept;
+
+	juce::OwnedArray<Worker> workers;
+	std::unique_ptr<TaskRange[]> ranges;
+	int numParticipants = 0;
+
+	TaskFunction taskFunction = nullptr;
+	void* taskContext = nullptr;
+
+	std::atomic<double> workerSpinMs;
+	std::atomic<juce::uint32> generation{ 0 };
+	std::atomic<int> tasksRemaining{ 0 };
+
+	JUCE_DECLARE_NON_COPYABLE(VoiceRenderPool)
+};
@@ -0,0 +1,197 @@
+/*
+  ==============================================================================
+
+    Wavetables.cpp
+
+  ==============================================================================
+*/
+
+#include "Wavetables.h"
+
+namespace {
+	int getTableOrder() {
+		int order = 0;
+		while ((1 << order) < TABLE_SIZE) order++;
+		return order;
+	}
+
+	//Level n keeps harmonics 1 to 2^n, and the table can't hold more than TABLE_SIZE/2 - 1
+	int getNumHarmonics(int level) {
+		return juce::jmin(1 << level, TABLE_SIZE / 2 - 1);
+	}
+}
+
+MipmappedWavetable::MipmappedWavetable() {
+	static_assert((TABLE_SIZE & (TABLE_SIZE - 1)) == 0, "The FFT needs a power of two");
+	storage.calloc(levelStride * WAVETABLE_LEVELS);
+}
+
+void MipmappedWavetable::build(const std::vector<std::complex<float>>& harmonics, bool normalise) {
+	juce::dsp::FFT fft(getTableOrder());
+	std::vector<float> buffer((size_t)TABLE_SIZE * 2);
+	float peak = 0.0f;
+
+	//The inverse transform divides by the length, and each bin only gives half of a harmonic
+	const float binScale = 0.5f * (float)TABLE_SIZE;
+	spectrum = harmonics;
+
+	for (int level = 0; level < WAVETABLE_LEVELS; level++) {
+		std::fill(buffer.begin(), buffer.end(), 0.0f);
+
+		//Real bins are the cosine parts, imaginary bins the negated sine parts
+		const int numHarmonics = juce::jmin(getNumHarmonics(level), (int)harmonics.size() - 1);
+		for (int n = 1; n <= numHarmonics; n++) {
+			buffer[(size_t)(2 * n)] = harmonics[(size_t)n].imag() * binScale;
+			buffer[(size_t)(2 * n + 1)] = -harmonics[(size_t)n].real() * binScale;
+		}
+
+		fft.performRealOnlyInverseTransform(buffer.data());
+
+		//Guard points wrap round, see SineTable
+		float* table = storage.get() + (size_t)level * levelStride;
+		table[0] = buffer[(size_t)TABLE_SIZE - 1];
+		std::copy(buffer.begin(), buffer.begin() + TABLE_SIZE, table + 1);
+		table[TABLE_SIZE + 1] = buffer[0];
+		table[TABLE_SIZE + 2] = buffer[1];
+
+		for (int i = 0; i < TABLE_SIZE; i++)
+			peak = juce::jmax(peak, std::abs(buffer[(size_t)i]));
+	}
+
+	//One scale for every level, so moving between them keeps the loudness
+	scale = normalise && peak > 0.0f ? 1.0f / peak : 1.0f;
+	if (scale != 1.0f)
+		juce::FloatVectorOperations::multiply(storage.get(), scale, (int)(levelStride * WAVETABLE_LEVELS));
+}
+
+int MipmappedWavetable::getLevelFor(double frequency, double sampleRate) noexcept {
+	if (frequency <= 0.0) return WAVETABLE_LEVELS - 1;
+
+	double maxHarmonics = 0.5 * sampleRate / frequency;
+	if (maxHarmonics < 2.0) return 0;
+
+	return juce::jmin((int)std::floor(std::log2(maxHarmonics)), WAVETABLE_LEVELS - 1);
+}
+
+std::vector<std::complex<float>> MipmappedWavetable::getSawHarmonics() {
+	std::vector<std::complex<float>> harmonics((size_t)TABLE_SIZE / 2);
+	for (int n = 1; n < TABLE_SIZE / 2; n++)
+		harmonics[(size_t)n] = { (n % 2 == 1 ? 2.0f : -2.0f) / (juce::MathConstants<float>::pi * (float)n), 0.0f };
+	return harmonics;
+}
+
+std::vector<std::complex<float>> MipmappedWavetable::getSquareHarmonics() {
+	std::vector<std::complex<float>> harmonics((size_t)TABLE_SIZE / 2);
+	for (int n = 1; n < TABLE_SIZE / 2; n += 2)
+		harmonics[(size_t)n] = { 4.0f / (juce::MathConstants<float>::pi * (float)n), 0.0f };
+	return harmonics;
+}
+
+std::vector<std::complex<float>> MipmappedWavetable::getHarmonics(const float* cycle, int length) {
+	std::vector<std::complex<float>> harmonics((size_t)TABLE_SIZE / 2);
+	if (cycle == nullptr || length <= 0) return harmonics;
+
+	//Stretch the cycle to the table length, linearly and wrapping round
+	std::vector<float> buffer((size_t)TABLE_SIZE * 2);
+	for (int i = 0; i < TABLE_SIZE; i++) {
+		double pos = (double)i * length / TABLE_SIZE;
+		int index = (int)pos;
+		float fraction = (float)(pos - index);
+		float left = cycle[index % length];
+		buffer[(size_t)i] = left + fraction * (cycle[(index + 1) % length] - left);
+	}
+
+	juce::dsp::FFT fft(getTableOrder());
+	fft.performRealOnlyForwardTransform(buffer.data());
+
+	//Back from bins to sine and cosine amplitudes
+	const float scale = 2.0f / (float)TABLE_SIZE;
+	for (int n = 1; n < TABLE_SIZE / 2; n++)
+		harmonics[(size_t)n] = { -buffer[(size_t)(2 * n + 1)] * scale, buffer[(size_t)(2 * n)] * scale };
+
+	return harmonics;
+}
+
+//==============================================================================
+WavetableLibrary::WavetableLibrary() : juce::Thread("Wavetable Builder") {
+	startThread(juce::Thread::Priority::background);
+}
+
+WavetableLibrary::~WavetableLibrary() {
+	//Building doesn't check threadShouldExit, it's short enough to let it finish
+	stopThread(-1);
+}
+
+const MipmappedWavetable* WavetableLibrary::getTable(int waveform) const noexcept {
+	switch (waveform) {
+	case Waveform::Saw: return sawReady.load(std::memory_order_acquire) ? &saw : nullptr;
+	case Waveform::Square: return squareReady.load(std::memory_order_acquire) ? &square : nullptr;
+	default: return nullptr;
+	}
+}
+
+void WavetableLibrary::run() {
+	saw.build(MipmappedWavetable::getSawHarmonics());
+	sawReady.store(true, std::memory_order_release);
+	DBG("Saw wavetable built");
+
+	if (threadShouldExit()) return;
+
+	square.build(MipmappedWavetable::getSquareHarmonics());
+	squareReady.store(true, std::memory_order_release);
+	DBG("Square wavetable built");
+}
+
+//==============================================================================
+bool WavetableCache::publishCached(juce::uint64 key) {
+	const juce::ScopedLock sl(lock);
+
+	for (auto& entry : cached) {
+		if (entry.table->key == key) {
+			if (entry.table.get() != published.load(std::memory_order_relaxed))
+				publishEntry(entry);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void WavetableCache::publish(std::unique_ptr<MipmappedWavetable> table) {
+	const juce::ScopedLock sl(lock);
+
+	cached.push_back({ std::move(table), 0 });
+	publishEntry(cached.back());
+
+	//The one just published is the most recent, so it never goes here
+	while ((int)cached.size() > capacity) {
+		auto oldest = std::min_element(cached.begin(), cached.end(), [](const Entry& a, const Entry& b) {
+			return a.lastPublished < b.lastPublished;
+		});
+		retired.push_back(std::move(*oldest));
+		cached.erase(oldest);
+	}
+}
+
+void WavetableCache::publishEntry(Entry& entry) {
+	entry.lastPublished = ++generation;
+	published.store(entry.table.get(), std::memory_order_release);
+	publishedGeneration.store(entry.lastPublished, std::memory_order_release);
+}
+
+void WavetableCache::releaseRetired() {
+	const juce::ScopedLock sl(lock);
+	const int acknowledged = acknowledgedGeneration.load(std::memory_order_acquire);
+
+	//Anything published before the generation the audio thread last picked up has been replaced there
+	retired.erase(std::remove_if(retired.begin(), retired.end(), [acknowledged](const Entry& entry) {
+		return entry.lastPublished < acknowledged;
+	}), retired.end());
+}
+
+const MipmappedWavetable* WavetableCache::acquire() noexcept {
+	const int acquired = publishedGeneration.load(std::memory_order_acquire);
+	auto* table = published.load(std::memory_order_acquire);
+	acknowledgedGeneration.store(acquired, std::memory_order_release);
+	return table;
+}
@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    Wavetables.h
+
+	Band-limited, mipmapped wavetables for partials that aren't sines.
+
+	A MipmappedWavetable holds WAVETABLE_LEVELS copies of one waveform, level
+	n keeping only the first 2^n harmonics. A partial reads the richest level
+	whose top harmonic still sits below Nyquist at its frequency, so a whole
+	harmonic series costs one lookup and never aliases.
+
+	Levels are laid out like SineTable, TABLE_SIZE long with guard points, so
+	PartialBank reads them the same way. They are built with an inverse FFT
+	from the harmonic spectrum, and every level of a waveform is scaled by
+	the same factor so switching level doesn't change the loudness.
+
+	WavetableLibrary holds the saw and square, built once per process on a
+	background thread. Until a table is ready it reads as nullptr and callers
+	fall back to the sine.
+
+	WavetableCache hands tables built on a background thread to the audio
+	thread, one at a time, and keeps the last few so they can be handed over
+	again without a rebuild. A table is freed only once the audio thread has
+	picked up something published after it.
+
+  ==============================================================================
+*/
+
+#pragma once
+#include "../GlobalDefines.h"
+
+class MipmappedWavetable {
+public:
+	//Allocates every level, builds nothing
+	MipmappedWavetable();
+
+	//Harmonic n is harmonics[n], as a sine amplitude (real) and a cosine amplitude (imag).
+	//Index 0 is ignored, harmonics past what a level holds are dropped.
+	//Normalised tables peak at 1, otherwise the amplitudes are kept as they are
+	void build(const std::vector<std::complex<float>>& harmonics, bool normalise = true);
+
+	//Level 0 is a pure sine, TABLE_SIZE long with getLevel(l)[-1] and getLevel(l)[TABLE_SIZE+1] valid
+	const float* getLevel(int level) const noexcept { return storage.get() + (size_t)level * levelStride + 1; }
+
+	//Richest level that doesn't alias at this frequency
+	static int getLevelFor(double frequency, double sampleRate) noexcept;
+
+	//Harmonics of a waveform, ready for build
+	static std::vector<std::complex<float>> getSawHarmonics();
+	static std::vector<std::complex<float>> getSquareHarmonics();
+
+	//Harmonics of one cycle of any length, eg one the user loaded
+	static std::vector<std::complex<float>> getHarmonics(const float* cycle, int length);
+
+	//What build was given, and the factor from those amplitudes to what the levels hold
+	const std::vector<std::complex<float>>& getSpectrum() const noexcept { return spectrum; }
+	float getScale() const noexcept { return scale; }
+
+	//Identifies the contents, see WavetableCache
+	juce::uint64 key = 0;
+
+private:
+	static constexpr size_t levelStride = (size_t)TABLE_SIZE + 3;
+	juce::HeapBlock<float> storage;
+	std::vector<std::complex<float>> spectrum;
+	float scale = 1.0f;
+
+	JUCE_DECLARE_NON_COPYABLE(MipmappedWavetable)
+};
+
+class WavetableLibrary : private juce::Thread {
+public:
+	//Starts building straight away, hold it through a juce::SharedResourcePointer
+	WavetableLibrary();
+	~WavetableLibrary() override;
+
+	//nullptr until that waveform has been built, Sine and User are never here
+	const MipmappedWavetable* getTable(int waveform) const noexcept;
+
+private:
+	MipmappedWavetable saw;
+	MipmappedWavetable square;
+	std::atomic<bool> sawReady{ false };
+	std::atomic<bool> squareReady{ false };
+
+	void run() override;
+};
+
+class WavetableCache {
+public:
+	//How many tables to keep, the one published included
+	explicit WavetableCache(int capacity) : capacity(juce::jmax(1, capacity)) {}
+
+	//Builder thread. Publishes the cached table with this key again, false if there isn't one
+	bool publishCached(juce::uint64 key);
+
+	//Builder thread. Takes the table over and publishes it, dropping the least recently published if full
+	void publish(std::unique_ptr<MipmappedWavetable> table);
+
+	//Builder thread, the last table published. nullptr before the first
+	const MipmappedWavetable* getPublished() const noexcept { return published.load(std::memory_order_acquire); }
+
+	//Not the audio thread. Frees dropped tables the audio thread can no longer be reading
+	void releaseRetired();
+
+	//Audio thread, once per block. The table to read until the next call
+	const MipmappedWavetable* acquire() noexcept;
+
+private:
+	struct Entry {
+		std::unique_ptr<MipmappedWavetable> table;
+		int lastPublished = 0;
+	};
+
+	const int capacity;
+	juce::CriticalSection lock;
+	std::vector<Entry> cached;
+	std::vector<Entry> retired;
+	int generation = 0;
+
+	//Generation goes after the table, so a reader that sees it also sees the table
+	std::atomic<MipmappedWavetable*> published{ nullptr };
+	std::atomic<int> publishedGeneration{ 0 };
+	std::atomic<int> acknowledgedGeneration{ 0 };
+
+	void publishEntry(Entry& entry);
+
+	JUCE_DECLARE_NON_COPYABLE(WavetableCache)
+};
@@ -0,0 +1,1539 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+
+	Microbenchmarks for the DSP hot paths.
+
+	lookup         SynthSound::lookup, per call
+	table          The compact Hermite table against the old 65536 point
+	               linear one: time, cache misses and SNR per lookup, with
+	               the access pattern of a voice full of partials
+	partial_bank   PartialBank::process on its own
+	interleaved    A register's worth of sparse banks, each on its own against
+	               PartialBank::processInterleaved, per partial count: time,
+	               and the largest difference between the two. Exits with 1
+	               if any is past interleaveTolerance
+	kernels        PartialBank::process with every OscillatorKernels variant
+	               the CPU runs, per partial count, with sine, saw, square
+	               and user partials mixed: time, and the largest difference
+	               from the generic loop. Exits with 1 if any is past
+	               kernelTolerance, or a variant left the block to the
+	               generic loop. Then the envelope and voice mix loops with
+	               each variant: time, the envelope's largest difference from
+	               a double one through a whole note, and whether the mix is
+	               exact. Exits with 1 if the envelope is past
+	               envelopeTolerance or the mix isn't exact
+	spectral       SpectralSynth::process on its own, per partial count: time,
+	               and the largest difference from the same partials summed
+	               as sines. Exits with 1 if any is past spectralTolerance
+	voice          SynthVoice::renderNextBlock, per synthesis mode
+	modulation     The same with LFOs on every partial's volume and distance,
+	               and with velocity on every partial's volume, against none,
+	               per partial count
+	snapshot       ParameterSnapshot::update, the parameter reads for one block
+	voice_update   SynthVoice::renderNextBlock on one sample, ie the per block
+	               parameter update and envelope, per call
+	process_block  AdditiveSynth1AudioProcessor::processBlock with held notes,
+	               with automation moving every block, with notes released
+	               and played again through every block, with no notes at
+	               all, and in double precision, per block size
+	synth_engine   AdditiveSynthesiser::renderNextBlock against juce::Synthesiser,
+	               which it replaced, driving the same voices with held notes
+	               and with note events, per block at 32, 64 and 128 samples
+	gain_filter    The gain stage at the end of processBlock, and the single
+	               filter on the mix that used to follow it, for comparison
+	voice_filter   VoiceFilter::process, the per voice filters, per voice count
+	envelope       Envelope::render through a whole note, against
+	               juce::ADSR::applyEnvelopeToBuffer, which it replaced
+	instances      Construction time and resident memory per plugin instance,
+	               for sessions that load many of them, against the same with a
+	               sine table built per instance, as before it was shared
+
+	Partial counts, voice counts, block sizes and sample rates are swept one
+	at a time around a default (--full sweeps voices x partials x block sizes
+	for process_block). Every result is the median of --runs runs, each long
+	enough to take --min-time ms.
+
+	Results go to stdout, or --out, as JSON so runs on different commits can
+	be diffed. --label is copied into the output to tell them apart.
+	--kernel forces an OscillatorKernels variant (generic, avx2, avx512) for
+	every other benchmark.
+
+	Benchmarks [--out results.json] [--label name] [--only voice,lookup]
+	           [--min-time 50] [--runs 5] [--multicore] [--full]
+	           [--kernel avx2]
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../../Source/PluginProcessor.h"
+#include "../../../Source/dsp/SynthSound.h"
+#include "../../../Source/dsp/PartialBank.h"
+#include "../../../Source/dsp/OscillatorKernels.h"
+#include "../../../Source/dsp/SpectralSynth.h"
+#include "../../../Source/dsp/ParameterSnapshot.h"
+#include "../../../Source/dsp/VoiceFilter.h"
+#include "../../../Source/dsp/Envelope.h"
+
+#include <iostream>
+
+#if JUCE_LINUX
+ #include <linux/perf_event.h>
+ #include <sys/ioctl.h>
+ #include <sys/syscall.h>
+ #include <unistd.h>
+#endif
+
+namespace {
+	struct Settings {
+		double minSeconds = 0.05;
+		int runs = 5;
+		bool multicore = false;
+		bool full = false;
+		juce::StringArray only;
+	};
+
+	//Swept one at a time, the others stay at their default
+	const std::vector<int> partialCounts{ 0, 1, 2, 4, 8, 16, 32, 64, 128, MAX_PARTIALS };
+	const std::vector<int> voiceCounts{ 1, 2, 4, 8, 16, 32, 64, MAX_VOICES };
+	const std::vector<int> blockSizes{ 16, 32, 64, 128, 256, 512, 1024, 2048 };
+	const std::vector<double> sampleRates{ 44100.0, 48000.0, 96000.0, 192000.0 };
+
+	constexpr int defaultPartials = 64;
+	constexpr int defaultVoices = NUM_VOICES;
+	constexpr int defaultBlockSize = 512;
+	constexpr double defaultSampleRate = 48000.0;
+
+	//Largest difference from the generic oscillator loop a kernel variant may make, with the partials
+	//summing to 1. Only the order of the additions differs
+	constexpr float kernelTolerance = 1.0e-5f;
+
+	//Largest difference of a float envelope from a double one through a whole note, on any variant. The
+	//generic loop's rounding builds up over a long segment to about 2e-5, the wider ones step further per
+	//rounding and stay under that
+	constexpr float envelopeTolerance = 1.0e-4f;
+
+	//Largest difference between a bank rendered on its own and interleaved with others, with the partials
+	//summing to 1. Again only the order of the additions differs
+	constexpr float interleaveTolerance = 1.0e-5f;
+
+	//Largest difference from an exact sine sum SpectralSynth may make, with the partials summing to 1. Cutting
+	//the Blackman-Harris window's transform down to its main lobe leaves 1e-5 to 5e-5 behind, the rest is
+	//room for the float FFT
+	constexpr float spectralTolerance = 1.0e-4f;
+
+	//Low enough that MAX_PARTIALS partials at the default spacing stay under Nyquist at 44.1kHz
+	constexpr int lowestNote = 24;
+
+	volatile float sink = 0.0f;
+
+	double secondsSince(juce::int64 startTicks) {
+		return juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - startTicks);
+	}
+
+	//Median over the runs of the time one call takes, in seconds
+	template <typename Function>
+	double timePerCall(Function&& function, const Settings& settings) {
+		//Warms up, and finds how many calls fill minSeconds
+		int calls = 1;
+		for (;;) {
+			auto start = juce::Time::getHighResolutionTicks();
+			for (int i = 0; i < calls; i++) function();
+			double elapsed = secondsSince(start);
+
+			if (elapsed >= settings.minSeconds * 0.25 || calls >= (1 << 24)) {
+				calls = juce::jmax(1, (int)((double)calls * settings.minSeconds / juce::jmax(elapsed, 1.0e-9)));
+				break;
+			}
+			calls *= 2;
+		}
+
+		std::vector<double> results;
+		for (int run = 0; run < settings.runs; run++) {
+			auto start = juce::Time::getHighResolutionTicks();
+			for (int i = 0; i < calls; i++) function();
+			results.push_back(secondsSince(start) / calls);
+		}
+
+		std::sort(results.begin(), results.end());
+		return results[results.size() / 2];
+	}
+
+	void setParameter(APVTS& apvts, const juce::String& name, float value) {
+		auto* parameter = apvts.getParameter(name);
+		jassert(parameter != nullptr);
+		parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+	}
+
+	void setParameter(APVTS& apvts, Params::Names name, float value) {
+		setParameter(apvts, Params::getParams().at(name), value);
+	}
+
+	//Renders every partial asked for, however quiet or high
+	void disableCulling(APVTS& apvts) {
+		setParameter(apvts, Params::Cull_Nyquist, CULL_NYQUIST_MAX);
+		setParameter(apvts, Params::Cull_Floor, CULL_FLOOR_MIN);
+	}
+
+	class Results {
+	public:
+		juce::DynamicObject* add(const juce::String& benchmark) {
+			auto* result = new juce::DynamicObject();
+			result->setProperty("benchmark", benchmark);
+			results.add(juce::var(result));
+			return result;
+		}
+
+		juce::var toVar(const juce::String& label, const Settings& settings) const {
+			auto* root = new juce::DynamicObject();
+			root->setProperty("label", label);
+			root->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+			root->setProperty("cpu", juce::SystemStats::getCpuModel());
+			root->setProperty("physical_cpus", juce::SystemStats::getNumPhysicalCpus());
+			root->setProperty("debug", (bool)JUCE_DEBUG);
+			root->setProperty("simd", (bool)JUCE_USE_SIMD);
+			root->setProperty("multicore", settings.multicore);
+			root->setProperty("kernel", KernelVariant::getNames()[OscillatorKernels::getVariant()]);
+			root->setProperty("passed", !failed);
+			root->setProperty("results", results);
+			return juce::var(root);
+		}
+
+		//A check in a benchmark didn't pass
+		void fail() noexcept { failed = true; }
+		bool hasFailed() const noexcept { return failed; }
+
+	private:
+		juce::Array<juce::var> results;
+		bool failed = false;
+	};
+
+	void logResult(const juce::String& line) {
+		std::cerr << line << std::endl;
+	}
+
+	//==============================================================================
+	void benchLookup(Results& results, const Settings& settings) {
+		SynthSound::Ptr sound = new SynthSound();
+		auto* synthSound = sound.get();
+
+		constexpr int numLookups = 256;
+		const float delta = (float)(TABLE_SIZE * 440.0 / defaultSampleRate);
+		float phase = 0.0f;
+
+		double seconds = timePerCall([&] {
+			float sum = 0.0f;
+			for (int i = 0; i < numLookups; i++) {
+				sum += synthSound->lookup(phase);
+				phase += delta;
+				if (phase >= TABLE_SIZE) phase -= TABLE_SIZE;
+			}
+			sink = sum;
+		}, settings);
+
+		auto* result = results.add("lookup");
+		result->setProperty("ns_per_lookup", 1.0e9 * seconds / numLookups);
+		logResult("lookup: " + juce::String(1.0e9 * seconds / numLookups, 3) + " ns");
+	}
+
+	//==============================================================================
+	//Hardware cache misses on the calling thread. Linux only, and reads -1 where
+	//perf events aren't available or allowed (see /proc/sys/kernel/perf_event_paranoid)
+	class CacheMissCounter {
+	public:
+		CacheMissCounter() {
+		#if JUCE_LINUX
+			l1Misses = openCounter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D
+													  | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+													  | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+			lastLevelMisses = openCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+		#endif
+		}
+
+		~CacheMissCounter() {
+		#if JUCE_LINUX
+			if (l1Misses >= 0) ::close(l1Misses);
+			if (lastLevelMisses >= 0) ::close(lastLevelMisses);
+		#endif
+		}
+
+		void start() {
+		#if JUCE_LINUX
+			for (int fd : { l1Misses, lastLevelMisses }) {
+				if (fd < 0) continue;
+				ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+				ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+			}
+		#endif
+		}
+
+		void stop() {
+		#if JUCE_LINUX
+			for (int fd : { l1Misses, lastLevelMisses })
+				if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+		#endif
+		}
+
+		juce::int64 getL1Misses() const { return read(l1Misses); }
+		juce::int64 getLastLevelMisses() const { return read(lastLevelMisses); }
+
+	private:
+		int l1Misses = -1;
+		int lastLevelMisses = -1;
+
+	#if JUCE_LINUX
+		static int openCounter(juce::uint32 type, juce::uint64 config) {
+			perf_event_attr attr{};
+			attr.size = sizeof(attr);
+			attr.type = type;
+			attr.config = config;
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			return (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		}
+	#endif
+
+		static juce::int64 read(int fd) {
+		#if JUCE_LINUX
+			juce::uint64 count = 0;
+			if (fd >= 0 && ::read(fd, &count, sizeof(count)) == (ssize_t)sizeof(count))
+				return (juce::int64)count;
+		#endif
+			juce::ignoreUnused(fd);
+			return -1;
+		}
+	};
+
+	//One lookup per partial per sample, MAX_PARTIALS harmonics of a low note like a full voice
+	template <typename Lookup>
+	void timeTable(Results& results, const Settings& settings, const juce::String& interpolation, int tableSize, Lookup&& lookup) {
+		constexpr int numPartials = MAX_PARTIALS;
+		constexpr int numSamples = 64;
+		constexpr int numLookups = numPartials * numSamples;
+
+		std::vector<float> phases((size_t)numPartials, 0.0f), deltas((size_t)numPartials);
+		for (int i = 0; i < numPartials; i++)
+			deltas[(size_t)i] = (float)std::fmod(tableSize * 32.7 * (1.0 + i) / defaultSampleRate, (double)tableSize);
+
+		auto render = [&] {
+			float sum = 0.0f;
+			for (int sample = 0; sample < numSamples; sample++) {
+				for (int i = 0; i < numPartials; i++) {
+					sum += lookup(phases[(size_t)i]);
+					float pos = phases[(size_t)i] + deltas[(size_t)i];
+					phases[(size_t)i] = pos >= (float)tableSize ? pos - (float)tableSize : pos;
+				}
+			}
+			sink = sum;
+		};
+
+		double seconds = timePerCall(render, settings);
+
+		constexpr int countedCalls = 200;
+		CacheMissCounter counter;
+		counter.start();
+		for (int i = 0; i < countedCalls; i++) render();
+		counter.stop();
+
+		auto perLookup = [](juce::int64 count) {
+			return count < 0 ? -1.0 : (double)count / ((double)countedCalls * numLookups);
+		};
+
+		//Against a double precision sine, over phases spread evenly through the table
+		double signal = 0.0, noise = 0.0;
+		for (int i = 0; i < (1 << 20); i++) {
+			float phase = (float)std::fmod(i * 0.6180339887498949 * tableSize, (double)tableSize);
+			double exact = std::sin(TWOPI * (double)phase / tableSize);
+			double error = (double)lookup(phase) - exact;
+			signal += exact * exact;
+			noise += error * error;
+		}
+
+		double nsPerLookup = 1.0e9 * seconds / numLookups;
+		double snr = noise > 0.0 ? 10.0 * std::log10(signal / noise) : 0.0;
+
+		auto* result = results.add("table");
+		result->setProperty("interpolation", interpolation);
+		result->setProperty("table_size", tableSize);
+		result->setProperty("table_kb", (double)tableSize * sizeof(float) / 1024.0);
+		result->setProperty("ns_per_lookup", nsPerLookup);
+		result->setProperty("l1d_misses_per_lookup", perLookup(counter.getL1Misses()));
+		result->setProperty("cache_misses_per_lookup", perLookup(counter.getLastLevelMisses()));
+		result->setProperty("snr_db", snr);
+		logResult("table " + interpolation + " size=" + juce::String(tableSize) + ": " + juce::String(nsPerLookup, 3) + " ns, "
+				  + juce::String(perLookup(counter.getL1Misses()), 4) + " L1d misses/lookup, SNR " + juce::String(snr, 1) + " dB");
+	}
+
+	void benchTable(Results& results, const Settings& settings) {
+		//The table and lookup SynthSound had before it went compact
+		constexpr int legacySize = 65536;
+		std::vector<float> legacy((size_t)legacySize + 1);
+		for (int i = 0; i < legacySize; i++)
+			legacy[(size_t)i] = (float)std::sin(TWOPI * i / legacySize);
+		legacy[(size_t)legacySize] = legacy[0];
+
+		timeTable(results, settings, "linear", legacySize, [&](float index) {
+			int lindex = (int)index;
+			float lval = legacy[(size_t)lindex];
+			return lval + (index - (float)lindex) * (legacy[(size_t)lindex + 1] - lval);
+		});
+
+		SynthSound::Ptr sound = new SynthSound();
+		const float* table = sound->getTable();
+
+		timeTable(results, settings, "hermite", TABLE_SIZE, [table](float index) {
+			return SynthSound::interpolate(table, index);
+		});
+	}
+
+	//==============================================================================
+	void benchPartialBank(Results& results, const Settings& settings) {
+		SynthSound::Ptr sound = new SynthSound();
+		const float* const* tables = sound->getTables();
+
+		//Every partial reads the sine, table id 0
+		std::vector<int> tableIds((size_t)MAX_PARTIALS + 1, 0);
+		std::vector<juce::uint32> deltas((size_t)MAX_PARTIALS + 1);
+		std::vector<float> gains((size_t)MAX_PARTIALS + 1);
+		std::vector<float> output((size_t)defaultBlockSize);
+
+		//Sustaining, the envelope costs the same at any level
+		std::vector<float> envelope((size_t)defaultBlockSize, 1.0f);
+
+		for (int partials : partialCounts) {
+			const int numPartials = partials + 1;
+			for (int i = 0; i < numPartials; i++) {
+				deltas[(size_t)i] = PartialBank::getPhaseDelta(32.7 * (1.5 + i), defaultSampleRate);
+				gains[(size_t)i] = 1.0f / (float)numPartials;
+			}
+
+			PartialBank bank;
+			bank.prepare(MAX_PARTIALS + 1, TABLE_SIZE, (int)(PARTIAL_GAIN_RAMP_SECONDS * defaultSampleRate));
+			bank.update(numPartials, deltas.data(), gains.data(), tableIds.data());
+
+			double seconds = timePerCall([&] {
+				bank.process(tables, envelope.data(), output.data(), defaultBlockSize);
+				sink = output[0];
+			}, settings);
+
+			double nsPerSample = 1.0e9 * seconds / defaultBlockSize;
+			auto* result = results.add("partial_bank");
+			result->setProperty("partials", partials);
+			result->setProperty("block_size", defaultBlockSize);
+			result->setProperty("ns_per_sample", nsPerSample);
+			result->setProperty("ns_per_sample_partial", nsPerSample / numPartials);
+			logResult("partial_bank partials=" + juce::String(partials) + ": " + juce::String(nsPerSample / numPartials, 3) + " ns/sample/partial");
+		}
+	}
+
+	void benchInterleaved(Results& results, const Settings& settings) {
+		SynthSound::Ptr sound = new SynthSound();
+		const float* const* tables = sound->getTables();
+		constexpr int numBanks = PartialBank::lanes;
+
+		std::vector<int> tableIds((size_t)INTERLEAVE_MAX_PARTIALS, 0);
+		std::vector<juce::uint32> deltas((size_t)INTERLEAVE_MAX_PARTIALS);
+		std::vector<float> gains((size_t)INTERLEAVE_MAX_PARTIALS);
+		std::vector<float> envelope((size_t)defaultBlockSize, 1.0f);
+		std::vector<std::vector<float>> outputs((size_t)numBanks, std::vector<float>((size_t)defaultBlockSize));
+		std::vector<std::vector<float>> expected((size_t)numBanks, std::vector<float>((size_t)defaultBlockSize));
+		constexpr int numBlocks = 8;
+
+		//A fade in over the block, so each voice's envelope is applied to its own sums
+		std::vector<float> fade((size_t)defaultBlockSize);
+		for (int i = 0; i < defaultBlockSize; i++)
+			fade[(size_t)i] = (float)i / (float)defaultBlockSize;
+
+		for (int partials : partialCounts) {
+			const int numPartials = partials + 1;
+			if (numPartials > INTERLEAVE_MAX_PARTIALS) break;
+
+			//A chord, each voice on its own note. Thinned mutes every other partial
+			auto setBank = [&](PartialBank& bank, int b, bool thinned, int rampSamples) {
+				for (int i = 0; i < numPartials; i++) {
+					deltas[(size_t)i] = PartialBank::getPhaseDelta(32.7 * (1.5 + i) * std::pow(2.0, b / 12.0), defaultSampleRate);
+					gains[(size_t)i] = thinned && (i & 1) != 0 ? 0.0f : 1.0f / (float)numPartials;
+				}
+
+				bank.update(numPartials, deltas.data(), gains.data(), tableIds.data(), rampSamples);
+			};
+
+			auto makeBanks = [&](std::vector<PartialBank>& banks, PartialBank** bankPointers) {
+				for (int b = 0; b < numBanks; b++) {
+					banks[(size_t)b].prepare(INTERLEAVE_MAX_PARTIALS, TABLE_SIZE, (int)(PARTIAL_GAIN_RAMP_SECONDS * defaultSampleRate));
+					setBank(banks[(size_t)b], b, false, 0);
+					bankPointers[b] = &banks[(size_t)b];
+				}
+			};
+
+			std::vector<PartialBank> banks((size_t)numBanks);
+			PartialBank* bankPointers[numBanks];
+			const float* envelopes[numBanks];
+			const float* fades[numBanks];
+			float* outputPointers[numBanks];
+			makeBanks(banks, bankPointers);
+
+			for (int b = 0; b < numBanks; b++) {
+				envelopes[b] = envelope.data();
+				fades[b] = fade.data();
+				outputPointers[b] = outputs[(size_t)b].data();
+			}
+
+			//The same banks both ways from the same start. Ramps in, holds, then thins out mid block, over a
+			//different length per voice, so the interleaved ramps go out of step
+			std::vector<PartialBank> separateBanks((size_t)numBanks), interleavedBanks((size_t)numBanks);
+			PartialBank* separatePointers[numBanks];
+			PartialBank* interleavedPointers[numBanks];
+			makeBanks(separateBanks, separatePointers);
+			makeBanks(interleavedBanks, interleavedPointers);
+
+			float maxError = 0.0f;
+			for (int block = 0; block < numBlocks; block++) {
+				if (block == numBlocks / 2) {
+					for (int b = 0; b < numBanks; b++) {
+						setBank(separateBanks[(size_t)b], b, true, 17 * (b + 1));
+						setBank(interleavedBanks[(size_t)b], b, true, 17 * (b + 1));
+					}
+				}
+
+				for (int b = 0; b < numBanks; b++)
+					separateBanks[(size_t)b].process(tables, fade.data(), expected[(size_t)b].data(), defaultBlockSize);
+				PartialBank::processInterleaved(interleavedPointers, numBanks, tables, fades, outputPointers, defaultBlockSize);
+
+				for (int b = 0; b < numBanks; b++)
+					for (int i = 0; i < defaultBlockSize; i++)
+						maxError = juce::jmax(maxError, std::abs(outputs[(size_t)b][(size_t)i] - expected[(size_t)b][(size_t)i]));
+			}
+
+			const bool matches = maxError <= interleaveTolerance;
+			if (!matches)
+				results.fail();
+
+			double separate = timePerCall([&] {
+				for (int b = 0; b < numBanks; b++)
+					banks[(size_t)b].process(tables, envelope.data(), outputPointers[b], defaultBlockSize);
+				sink = outputs[0][0];
+			}, settings);
+
+			double interleaved = timePerCall([&] {
+				PartialBank::processInterleaved(bankPointers, numBanks, tables, envelopes, outputPointers, defaultBlockSize);
+				sink = outputs[0][0];
+			}, settings);
+
+			const double perVoice = 1.0e9 / ((double)defaultBlockSize * numBanks);
+			auto* result = results.add("interleaved");
+			result->setProperty("partials", partials);
+			result->setProperty("voices", numBanks);
+			result->setProperty("ns_per_sample_voice_separate", separate * perVoice);
+			result->setProperty("ns_per_sample_voice_interleaved", interleaved * perVoice);
+			result->setProperty("chosen", PartialBank::shouldInterleave(bankPointers, numBanks) ? "interleaved" : "separate");
+			result->setProperty("max_error", maxError);
+			result->setProperty("matches", matches);
+			logResult("interleaved partials=" + juce::String(partials) + " voices=" + juce::String(numBanks) + ": "
+					  + juce::String(separate * perVoice, 3) + " separate, " + juce::String(interleaved * perVoice, 3) + " interleaved ns/sample/voice, max error "
+					  + juce::String(maxError, 9) + (matches ? "" : " FAILED"));
+		}
+	}
+
+	//PartialBank quietly renders with the generic loop when a kernel declines a block, so this asks the
+	//kernel directly, with the bank's layout, whether it renders these tables
+	bool kernelRenders(int variant, const float* const* tables, const std::vector<int>& tableIds, int numPartials) {
+		constexpr int numSamples = 16;
+		const int lanes = OscillatorKernels::maxLanes;
+		const auto capacity = (size_t)(((numPartials + lanes - 1) / lanes) * lanes);
+
+		AlignedArray<int> ids, offsets;
+		AlignedArray<const float*> pointers;
+		AlignedArray<juce::uint32> phases, deltas;
+		AlignedArray<float> gains, steps;
+		ids.allocate(capacity);
+		offsets.allocate(capacity);
+		pointers.allocate(capacity);
+		phases.allocate(capacity);
+		deltas.allocate(capacity);
+		gains.allocate(capacity);
+		steps.allocate(capacity);
+		std::copy(tableIds.begin(), tableIds.begin() + numPartials, ids.get());
+
+		int tableBits = 0;
+		while ((1 << (tableBits + 1)) <= TABLE_SIZE) tableBits++;
+		const int indexShift = 32 - tableBits;
+
+		std::vector<float> envelope((size_t)numSamples, 1.0f), output((size_t)numSamples);
+		const OscillatorKernels::RenderArgs args{ tables, ids.get(), phases.get(), deltas.get(), gains.get(), steps.get(), offsets.get(), pointers.get(),
+												  numPartials, indexShift, (juce::uint32)((juce::uint64(1) << indexShift) - 1),
+												  1.0f / (float)(juce::uint64(1) << indexShift), envelope.data(), output.data(), numSamples, false };
+		return OscillatorKernels::render(variant, args);
+	}
+
+	//The envelope through Envelope, and the voice mix as SynthVoice::addScratchTo calls it
+	void benchKernelLoops(Results& results, const Settings& settings) {
+		const juce::ADSR::Parameters envelopeParameters{ 0.01f, 0.2f, 0.5f, 0.3f };
+		constexpr int blocksPerNote = 200;
+		constexpr int numChannels = 2;
+		const int forcedVariant = OscillatorKernels::getVariant();
+
+		std::vector<float> gains((size_t)defaultBlockSize);
+		std::vector<double> exactGains((size_t)defaultBlockSize);
+		std::vector<float> source((size_t)defaultBlockSize);
+		for (int i = 0; i < defaultBlockSize; i++)
+			source[(size_t)i] = std::sin(0.1f * (float)i);
+
+		juce::AudioBuffer<float> buffer(numChannels, defaultBlockSize);
+		juce::AudioBuffer<float> expected(numChannels, defaultBlockSize);
+
+		for (int variant = 0; variant < KernelVariant::Num_Variants; variant++) {
+			if (!OscillatorKernels::setVariant(variant)) continue;
+
+			//The note once against a double envelope, which is exact to well below the tolerance
+			Envelope<float> envelope;
+			envelope.setSampleRate(defaultSampleRate);
+			envelope.setParameters(envelopeParameters);
+			envelope.noteOn();
+
+			Envelope<double> exact;
+			exact.setSampleRate(defaultSampleRate);
+			exact.setParameters(envelopeParameters);
+			exact.noteOn();
+
+			double envelopeError = 0.0;
+			for (int block = 0; block < blocksPerNote; block++) {
+				if (block == blocksPerNote / 2) {
+					envelope.noteOff();
+					exact.noteOff();
+				}
+
+				envelope.render(gains.data(), defaultBlockSize);
+				exact.render(exactGains.data(), defaultBlockSize);
+				for (int i = 0; i < defaultBlockSize; i++)
+					envelopeError = juce::jmax(envelopeError, std::abs((double)gains[(size_t)i] - exactGains[(size_t)i]));
+			}
+
+			double envelopeSeconds = timePerCall([&] {
+				envelope.noteOn();
+				for (int block = 0; block < blocksPerNote; block++) {
+					if (block == blocksPerNote / 2) envelope.noteOff();
+					envelope.render(gains.data(), defaultBlockSize);
+				}
+				sink = gains[0];
+			}, settings);
+
+			//Odd start and length, so the scalar ends are covered
+			const int start = 3, length = defaultBlockSize - 8;
+			float* outputs[numChannels] = { buffer.getWritePointer(0), buffer.getWritePointer(1) };
+			for (int channel = 0; channel < numChannels; channel++) {
+				for (int i = 0; i < defaultBlockSize; i++) {
+					buffer.setSample(channel, i, 0.25f);
+					expected.setSample(channel, i, 0.25f + (i >= start && i < start + length ? source[(size_t)(i - start)] : 0.0f));
+				}
+			}
+
+			if (!OscillatorKernels::mix(variant, source.data(), outputs, numChannels, start, length))
+				for (int channel = 0; channel < numChannels; channel++)
+					juce::FloatVectorOperations::add(outputs[channel] + start, source.data(), length);
+
+			bool mixExact = true;
+			for (int channel = 0; channel < numChannels; channel++)
+				for (int i = 0; i < defaultBlockSize; i++)
+					mixExact = mixExact && buffer.getSample(channel, i) == expected.getSample(channel, i);
+
+			double mixSeconds = timePerCall([&] {
+				if (!OscillatorKernels::mix(variant, source.data(), outputs, numChannels, 0, defaultBlockSize))
+					for (int channel = 0; channel < numChannels; channel++)
+						juce::FloatVectorOperations::add(outputs[channel], source.data(), defaultBlockSize);
+				sink = outputs[0][0];
+			}, settings);
+
+			const bool matches = envelopeError <= envelopeTolerance && mixExact;
+			if (!matches)
+				results.fail();
+
+			const double envelopeNs = 1.0e9 * envelopeSeconds / (defaultBlockSize * blocksPerNote);
+			const double mixNs = 1.0e9 * mixSeconds / defaultBlockSize;
+			const auto name = KernelVariant::getNames()[variant];
+			auto* result = results.add("kernel_loops");
+			result->setProperty("variant", name);
+			result->setProperty("envelope_ns_per_sample", envelopeNs);
+			result->setProperty("envelope_max_error", envelopeError);
+			result->setProperty("mix_ns_per_sample", mixNs);
+			result->setProperty("mix_exact", mixExact);
+			result->setProperty("matches", matches);
+			logResult("kernels " + name + " envelope: " + juce::String(envelopeNs, 3) + " ns/sample, max error " + juce::String(envelopeError, 9)
+					  + ", mix: " + juce::String(mixNs, 3) + " ns/sample" + (mixExact ? "" : ", not exact") + (matches ? "" : " FAILED"));
+		}
+
+		OscillatorKernels::setVariant(forcedVariant);
+	}
+
+	void benchKernels(Results& results, const Settings& settings) {
+		//Only here for its parameters
+		AdditiveSynth1AudioProcessor processor;
+		ParameterSnapshot parameters;
+		parameters.initialise(processor.apvts);
+
+		//The real tables, so a register mixes the static sine with heap allocated wavetables. Until the
+		//saw, square and user tables are built every id reads as the sine
+		SynthSound::Ptr sound = new SynthSound();
+		const float* const* tables = sound->getTables();
+		std::vector<float> userCycle(600);
+		for (size_t i = 0; i < userCycle.size(); i++)
+			userCycle[i] = i < userCycle.size() / 3 ? 1.0f : -0.5f;
+		sound->setUserWaveform(userCycle.data(), (int)userCycle.size());
+
+		auto isBuilt = [&](int waveform) {
+			return tables[waveform * WAVETABLE_LEVELS + WAVETABLE_LEVELS - 1] != sound->getTable();
+		};
+
+		sound->beginBlock(parameters);
+		for (int tries = 0; tries < 1000 && !(isBuilt(Waveform::Saw) && isBuilt(Waveform::Square) && isBuilt(Waveform::User)); tries++) {
+			juce::Thread::sleep(10);
+			sound->beginBlock(parameters);
+		}
+
+		if (!(isBuilt(Waveform::Saw) && isBuilt(Waveform::Square) && isBuilt(Waveform::User))) {
+			logResult("kernels: wavetables not built, FAILED");
+			results.fail();
+			return;
+		}
+		const int rampSamples = (int)(PARTIAL_GAIN_RAMP_SECONDS * defaultSampleRate);
+		const int forcedVariant = OscillatorKernels::getVariant();
+		constexpr int numBlocks = 8;
+
+		std::vector<int> tableIds((size_t)MAX_PARTIALS + 1);
+		std::vector<juce::uint32> deltas((size_t)MAX_PARTIALS + 1);
+		std::vector<float> gains((size_t)MAX_PARTIALS + 1);
+		std::vector<float> envelope((size_t)defaultBlockSize, 1.0f);
+		std::vector<float> output((size_t)defaultBlockSize);
+
+		for (int partials : partialCounts) {
+			const int numPartials = partials + 1;
+
+			//Sine, saw, square and user in turn, each on the level for its frequency, so the lanes of a
+			//register gather from different tables
+			auto setPartials = [&] {
+				for (int i = 0; i < numPartials; i++) {
+					const double frequency = 32.7 * (1.5 + i);
+					deltas[(size_t)i] = PartialBank::getPhaseDelta(frequency, defaultSampleRate);
+					gains[(size_t)i] = 1.0f / (float)numPartials;
+					tableIds[(size_t)i] = SynthSound::getTableId(i % Waveform::Num_Shapes, frequency, defaultSampleRate);
+				}
+			};
+
+			std::vector<float> reference;
+
+			for (int variant = 0; variant < KernelVariant::Num_Variants; variant++) {
+				if (!OscillatorKernels::setVariant(variant)) continue;
+
+				//Ramps in, holds, then drops every other partial mid block, so both loops and the repack are compared
+				setPartials();
+				PartialBank bank;
+				bank.prepare(MAX_PARTIALS + 1, TABLE_SIZE, rampSamples);
+				bank.update(numPartials, deltas.data(), gains.data(), tableIds.data());
+
+				std::vector<float> rendered;
+				for (int block = 0; block < numBlocks; block++) {
+					if (block == numBlocks / 2) {
+						for (int i = 0; i < numPartials; i += 2)
+							gains[(size_t)i] = 0.0f;
+						bank.update(numPartials, deltas.data(), gains.data(), tableIds.data(), defaultBlockSize / 3);
+					}
+
+					bank.process(tables, envelope.data(), output.data(), defaultBlockSize);
+					rendered.insert(rendered.end(), output.begin(), output.end());
+				}
+
+				if (variant == KernelVariant::Generic)
+					reference = rendered;
+
+				float maxError = 0.0f;
+				for (size_t i = 0; i < rendered.size(); i++)
+					maxError = juce::jmax(maxError, std::abs(rendered[i] - reference[i]));
+
+				//A kernel that declined the block would match trivially
+				const bool used = variant == KernelVariant::Generic || kernelRenders(variant, tables, tableIds, numPartials);
+				const bool matches = used && maxError <= kernelTolerance;
+				if (!matches)
+					results.fail();
+
+				double seconds = timePerCall([&] {
+					bank.process(tables, envelope.data(), output.data(), defaultBlockSize);
+					sink = output[0];
+				}, settings);
+
+				const double nsPerSample = 1.0e9 * seconds / defaultBlockSize;
+				const auto name = KernelVariant::getNames()[variant];
+				auto* result = results.add("kernels");
+				result->setProperty("variant", name);
+				result->setProperty("partials", partials);
+				result->setProperty("ns_per_sample_partial", nsPerSample / numPartials);
+				result->setProperty("max_error", maxError);
+				result->setProperty("kernel_used", used);
+				result->setProperty("matches", matches);
+				logResult("kernels " + name + " partials=" + juce::String(partials) + ": " + juce::String(nsPerSample / numPartials, 3)
+						  + " ns/sample/partial, max error " + juce::String(maxError, 9) + (used ? "" : ", fell back to generic")
+						  + (matches ? "" : " FAILED"));
+			}
+		}
+
+		OscillatorKernels::setVariant(forcedVariant);
+		benchKernelLoops(results, settings);
+	}
+
+	void benchSpectral(Results& results, const Settings& settings) {
+		constexpr int numCompared = 8 * SpectralSynth::fftSize;
+
+		std::vector<float> frequencies((size_t)MAX_PARTIALS + 1);
+		std::vector<float> gains((size_t)MAX_PARTIALS + 1);
+		std::vector<float> rendered((size_t)(SpectralSynth::fftSize + numCompared));
+		std::vector<float> output((size_t)defaultBlockSize);
+
+		for (int partials : partialCounts) {
+			const int numPartials = partials + 1;
+			for (int i = 0; i < numPartials; i++) {
+				frequencies[(size_t)i] = (float)(32.7 * (1.5 + i));
+				gains[(size_t)i] = 1.0f / (float)numPartials;
+			}
+
+			SpectralSynth synth;
+			synth.prepare(MAX_PARTIALS + 1, defaultSampleRate);
+			synth.update(numPartials, frequencies.data(), gains.data());
+			synth.process(rendered.data(), (int)rendered.size());
+
+			//Every phase starts at 0 at the centre of the first frame, which comes out a hop late. The first
+			//frame's worth is the overlap-add filling up
+			float maxError = 0.0f;
+			for (int sample = SpectralSynth::fftSize; sample < (int)rendered.size(); sample++) {
+				const double time = (double)(sample - SpectralSynth::hopSize) / defaultSampleRate;
+				double reference = 0.0;
+				for (int i = 0; i < numPartials; i++)
+					reference += gains[(size_t)i] * std::sin(juce::MathConstants<double>::twoPi * frequencies[(size_t)i] * time);
+
+				maxError = juce::jmax(maxError, (float)std::abs(reference - rendered[(size_t)sample]));
+			}
+
+			const bool matches = maxError <= spectralTolerance;
+			if (!matches)
+				results.fail();
+
+			double seconds = timePerCall([&] {
+				synth.process(output.data(), defaultBlockSize);
+				sink = output[0];
+			}, settings);
+
+			const double nsPerSample = 1.0e9 * seconds / defaultBlockSize;
+			auto* result = results.add("spectral");
+			result->setProperty("partials", partials);
+			result->setProperty("ns_per_sample", nsPerSample);
+			result->setProperty("max_error", maxError);
+			result->setProperty("matches", matches);
+			logResult("spectral partials=" + juce::String(partials) + ": " + juce::String(nsPerSample, 3) + " ns/sample, max error "
+					  + juce::String(maxError, 9) + (matches ? "" : " FAILED"));
+		}
+	}
+
+	//==============================================================================
+	struct VoiceConfig {
+		int mode = SynthesisMode::Oscillator_Bank;
+		int partials = defaultPartials;
+		int blockSize = defaultBlockSize;
+		double sampleRate = defaultSampleRate;
+
+		//LFOs on every partial's volume and distance, so the voice renders a control step at a time
+		bool modulated = false;
+
+		//Velocity on every partial's volume, which holds still, so the voice applies it once and renders whole chunks
+		bool velocityModulated = false;
+
+		juce::String getName() const { return modulated ? "modulation" : velocityModulated ? "modulation_velocity" : "voice"; }
+	};
+
+	//Seconds per renderNextBlock of numSamples, on one voice holding a note
+	double timeVoice(const VoiceConfig& config, int numSamples, const Settings& settings) {
+		//Only here for its parameters
+		AdditiveSynth1AudioProcessor processor;
+		auto& apvts = processor.apvts;
+
+		setParameter(apvts, Params::Num_Partials, (float)config.partials);
+		setParameter(apvts, Params::Synthesis_Mode, (float)config.mode);
+		disableCulling(apvts);
+
+		if (config.modulated) {
+			auto params = Params::getParams();
+			setParameter(apvts, params.at(Params::Mod_Source) + "2", (float)ModSource::Lfo_1);
+			setParameter(apvts, params.at(Params::Mod_Destination) + "2", (float)ModDestination::Partial_Volume);
+			setParameter(apvts, params.at(Params::Mod_Amount) + "2", 0.5f);
+			setParameter(apvts, params.at(Params::Mod_Source) + "3", (float)ModSource::Lfo_2);
+			setParameter(apvts, params.at(Params::Mod_Destination) + "3", (float)ModDestination::Partial_Distance);
+			setParameter(apvts, params.at(Params::Mod_Amount) + "3", 0.1f);
+			setParameter(apvts, params.at(Params::Lfo_Spread) + "1", 1.0f);
+		}
+		else if (config.velocityModulated) {
+			auto params = Params::getParams();
+			setParameter(apvts, params.at(Params::Mod_Source) + "2", (float)ModSource::Velocity);
+			setParameter(apvts, params.at(Params::Mod_Destination) + "2", (float)ModDestination::Partial_Volume);
+			setParameter(apvts, params.at(Params::Mod_Amount) + "2", 0.5f);
+		}
+
+		ParameterSnapshot parameters;
+		parameters.initialise(apvts);
+
+		SynthSound::Ptr sound = new SynthSound();
+		auto* synthSound = sound.get();
+		synthSound->beginBlock(parameters);
+
+		//The baked table is built in the background, time the voice once it's playing from it
+		if (config.mode == SynthesisMode::Harmonic_Table) {
+			for (int tries = 0; tries < 500 && !synthSound->hasHarmonicTable(); tries++) {
+				juce::Thread::sleep(10);
+				synthSound->beginBlock(parameters);
+			}
+
+			if (!synthSound->hasHarmonicTable())
+				logResult("voice " + SynthesisMode::getNames()[config.mode] + " partials=" + juce::String(config.partials) + ": no baked table, timing the partials");
+		}
+
+		SynthVoice<float> voice;
+		voice.initialise(parameters);
+		voice.setSound(synthSound);
+
+		juce::dsp::ProcessSpec spec{ config.sampleRate, (juce::uint32)config.blockSize, 2 };
+		voice.prepareToPlay(spec);
+		voice.startNote(lowestNote, 1.0f, 8192);
+
+		juce::AudioBuffer<float> buffer(2, config.blockSize);
+
+		return timePerCall([&] {
+			buffer.clear();
+			voice.renderNextBlock(buffer, 0, numSamples);
+		}, settings);
+	}
+
+	void addVoiceResult(Results& results, const VoiceConfig& config, double seconds) {
+		double nsPerSample = 1.0e9 * seconds / config.blockSize;
+		auto* result = results.add(config.getName());
+		result->setProperty("mode", SynthesisMode::getNames()[config.mode]);
+		result->setProperty("partials", config.partials);
+		result->setProperty("block_size", config.blockSize);
+		result->setProperty("sample_rate", config.sampleRate);
+		result->setProperty("ns_per_sample", nsPerSample);
+		result->setProperty("ns_per_sample_partial", nsPerSample / (config.partials + 1));
+		logResult(config.getName() + " " + SynthesisMode::getNames()[config.mode] + " partials=" + juce::String(config.partials)
+				  + " block=" + juce::String(config.blockSize) + " rate=" + juce::String(config.sampleRate)
+				  + ": " + juce::String(nsPerSample, 2) + " ns/sample");
+	}
+
+	void benchVoice(Results& results, const Settings& settings) {
+		for (int mode : { (int)SynthesisMode::Oscillator_Bank, (int)SynthesisMode::Inverse_FFT, (int)SynthesisMode::Harmonic_Table }) {
+			VoiceConfig config;
+			config.mode = mode;
+
+			for (int partials : partialCounts) {
+				config.partials = partials;
+				addVoiceResult(results, config, timeVoice(config, config.blockSize, settings));
+			}
+			config.partials = defaultPartials;
+
+			for (int blockSize : blockSizes) {
+				config.blockSize = blockSize;
+				addVoiceResult(results, config, timeVoice(config, config.blockSize, settings));
+			}
+			config.blockSize = defaultBlockSize;
+
+			for (double sampleRate : sampleRates) {
+				config.sampleRate = sampleRate;
+				addVoiceResult(results, config, timeVoice(config, config.blockSize, settings));
+			}
+		}
+	}
+
+	void benchModulation(Results& results, const Settings& settings) {
+		//Same voice without the matrix, with LFOs stepping the partials, and with velocity that only needs
+		//applying once. The differences are the control rate work
+		for (int routing = 0; routing < 3; routing++) {
+			VoiceConfig config;
+			config.modulated = routing == 1;
+			config.velocityModulated = routing == 2;
+
+			for (int partials : partialCounts) {
+				config.partials = partials;
+				addVoiceResult(results, config, timeVoice(config, config.blockSize, settings));
+			}
+		}
+	}
+
+	void benchSnapshot(Results& results, const Settings& settings) {
+		for (int partials : partialCounts) {
+			//Only here for its parameters
+			AdditiveSynth1AudioProcessor processor;
+			setParameter(processor.apvts, Params::Num_Partials, (float)partials);
+
+			ParameterSnapshot parameters;
+			parameters.initialise(processor.apvts);
+
+			double seconds = timePerCall([&] {
+				parameters.update();
+			}, settings);
+
+			auto* result = results.add("snapshot");
+			result->setProperty("partials", partials);
+			result->setProperty("ns_per_call", 1.0e9 * seconds);
+			logResult("snapshot partials=" + juce::String(partials) + ": " + juce::String(1.0e9 * seconds, 1) + " ns");
+		}
+	}
+
+	void benchVoiceUpdate(Results& results, const Settings& settings) {
+		for (int partials : partialCounts) {
+			VoiceConfig config;
+			config.partials = partials;
+
+			double seconds = timeVoice(config, 1, settings);
+			auto* result = results.add("voice_update");
+			result->setProperty("partials", partials);
+			result->setProperty("ns_per_call", 1.0e9 * seconds);
+			logResult("voice_update partials=" + juce::String(partials) + ": " + juce::String(1.0e9 * seconds, 1) + " ns");
+		}
+	}
+
+	//==============================================================================
+	struct ProcessConfig {
+		int voices = defaultVoices;
+		int partials = defaultPartials;
+		int blockSize = defaultBlockSize;
+		double sampleRate = defaultSampleRate;
+
+		//Moves a partial and the cutoff every block, so it renders in automation steps
+		bool automated = false;
+
+		//No notes at all, so every block takes the silent path
+		bool idle = false;
+
+		//Note offs and ons spread through every block, each one splits it
+		int events = 0;
+
+		//processBlock on a double buffer, as for a host that asks for double precision
+		bool doublePrecision = false;
+	};
+
+	void benchProcessBlockConfig(Results& results, const ProcessConfig& config, const Settings& settings) {
+		AdditiveSynth1AudioProcessor processor;
+		auto& apvts = processor.apvts;
+
+		setParameter(apvts, Params::Num_Partials, (float)config.partials);
+		setParameter(apvts, Params::Num_Voices, (float)config.voices);
+		setParameter(apvts, Params::Multicore_Rendering, settings.multicore ? 1.0f : 0.0f);
+		disableCulling(apvts);
+
+		processor.setPlayConfigDetails(0, 2, config.sampleRate, config.blockSize);
+		processor.setProcessingPrecision(config.doublePrecision ? juce::AudioProcessor::doublePrecision : juce::AudioProcessor::singlePrecision);
+		processor.prepareToPlay(config.sampleRate, config.blockSize);
+
+		juce::AudioBuffer<float> buffer(2, config.doublePrecision ? 0 : config.blockSize);
+		juce::AudioBuffer<double> doubleBuffer(2, config.doublePrecision ? config.blockSize : 0);
+		juce::MidiBuffer midi;
+
+		auto process = [&] {
+			if (config.doublePrecision) {
+				doubleBuffer.clear();
+				processor.processBlock(doubleBuffer, midi);
+			}
+			else {
+				buffer.clear();
+				processor.processBlock(buffer, midi);
+			}
+		};
+
+		//Same note on one channel would retrigger a voice, so spread them over channels
+		for (int voice = 0; voice < config.voices && !config.idle; voice++)
+			midi.addEvent(juce::MidiMessage::noteOn(1 + voice / 8, lowestNote + voice % 8, 1.0f), 0);
+
+		process();
+		midi.clear();
+
+		//Releases a held note then plays it again, evenly through the block
+		for (int event = 0; event < config.events; event++) {
+			const int note = lowestNote + (event / 2) % 8;
+			const int position = event * config.blockSize / juce::jmax(config.events, 1);
+			midi.addEvent((event & 1) ? juce::MidiMessage::noteOn(1, note, 1.0f) : juce::MidiMessage::noteOff(1, note), position);
+		}
+
+		const auto distanceName = Params::getParams().at(Params::Partial_Distance) + "1";
+		int block = 0;
+
+		double seconds = timePerCall([&] {
+			if (config.automated) {
+				block++;
+				setParameter(apvts, distanceName, (block & 1) ? 0.5f : 1.0f);
+				setParameter(apvts, Params::Filter_Cutoff, (block & 1) ? 1000.0f : 2000.0f);
+			}
+
+			process();
+		}, settings);
+
+		processor.releaseResources();
+
+		double nsPerSample = 1.0e9 * seconds / config.blockSize;
+		auto* result = results.add("process_block");
+		result->setProperty("voices", config.voices);
+		result->setProperty("partials", config.partials);
+		result->setProperty("block_size", config.blockSize);
+		result->setProperty("sample_rate", config.sampleRate);
+		result->setProperty("automated", config.automated);
+		result->setProperty("idle", config.idle);
+		result->setProperty("events", config.events);
+		result->setProperty("double_precision", config.doublePrecision);
+		result->setProperty("ns_per_sample", nsPerSample);
+		result->setProperty("ns_per_sample_partial", nsPerSample / (config.voices * (config.partials + 1)));
+		result->setProperty("realtime_load", seconds * config.sampleRate / config.blockSize);
+		logResult("process_block voices=" + juce::String(config.voices) + " partials=" + juce::String(config.partials)
+				  + " block=" + juce::String(config.blockSize) + " rate=" + juce::String(config.sampleRate)
+				  + (config.automated ? " automated" : "") + (config.idle ? " idle" : "")
+				  + (config.events > 0 ? " events=" + juce::String(config.events) : "") + (config.doublePrecision ? " double" : "") + ": " + juce::String(nsPerSample, 2) + " ns/sample");
+	}
+
+	void benchProcessBlock(Results& results, const Settings& settings) {
+		if (settings.full) {
+			ProcessConfig config;
+			for (int voices : voiceCounts)
+				for (int partials : partialCounts)
+					for (int blockSize : blockSizes) {
+						config.voices = voices;
+						config.partials = partials;
+						config.blockSize = blockSize;
+						benchProcessBlockConfig(results, config, settings);
+					}
+			return;
+		}
+
+		for (int voices : voiceCounts) {
+			ProcessConfig config;
+			config.voices = voices;
+			benchProcessBlockConfig(results, config, settings);
+		}
+		for (int partials : partialCounts) {
+			ProcessConfig config;
+			config.partials = partials;
+			benchProcessBlockConfig(results, config, settings);
+		}
+		for (int blockSize : blockSizes) {
+			ProcessConfig config;
+			config.blockSize = blockSize;
+			benchProcessBlockConfig(results, config, settings);
+		}
+		for (double sampleRate : sampleRates) {
+			ProcessConfig config;
+			config.sampleRate = sampleRate;
+			benchProcessBlockConfig(results, config, settings);
+		}
+		for (int blockSize : blockSizes) {
+			ProcessConfig config;
+			config.blockSize = blockSize;
+			config.automated = true;
+			benchProcessBlockConfig(results, config, settings);
+		}
+		for (int blockSize : blockSizes) {
+			ProcessConfig config;
+			config.blockSize = blockSize;
+			config.idle = true;
+			benchProcessBlockConfig(results, config, settings);
+		}
+		for (int blockSize : blockSizes) {
+			ProcessConfig config;
+			config.blockSize = blockSize;
+			config.events = 8;
+			benchProcessBlockConfig(results, config, settings);
+		}
+		for (int blockSize : blockSizes) {
+			ProcessConfig config;
+			config.blockSize = blockSize;
+			config.doublePrecision = true;
+			benchProcessBlockConfig(results, config, settings);
+		}
+	}
+
+	//==============================================================================
+	//The same voices under juce::Synthesiser, as they were driven before AdditiveSynthesiser replaced it
+	struct ReferenceSound : public juce::SynthesiserSound {
+		bool appliesToNote(int) override { return true; }
+		bool appliesToChannel(int) override { return true; }
+	};
+
+	class ReferenceVoice : public juce::SynthesiserVoice {
+	public:
+		ReferenceVoice(const ParameterSnapshot& parameters, SynthSound* sound, juce::dsp::ProcessSpec& spec) {
+			voice.initialise(parameters);
+			voice.setSound(sound);
+			voice.prepareToPlay(spec);
+		}
+
+		bool canPlaySound(juce::SynthesiserSound*) override { return true; }
+
+		void startNote(int midiNoteNumber, float velocity, juce::SynthesiserSound*, int pitchWheelPosition) override {
+			voice.startNote(midiNoteNumber, velocity, pitchWheelPosition);
+		}
+
+		void stopNote(float velocity, bool allowTailOff) override {
+			voice.stopNote(velocity, allowTailOff);
+			if (!allowTailOff)
+				clearCurrentNote();
+		}
+
+		void pitchWheelMoved(int newPitchWheelValue) override { voice.pitchWheelMoved(newPitchWheelValue); }
+		void controllerMoved(int controllerNumber, int newControllerValue) override { voice.controllerMoved(controllerNumber, newControllerValue); }
+
+		void renderNextBlock(juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples) override {
+			if (!isVoiceActive()) return;
+
+			voice.renderNextBlock(outputBuffer, startSample, numSamples);
+			if (voice.isFinished())
+				clearCurrentNote();
+		}
+
+	private:
+		SynthVoice<float> voice;
+	};
+
+	//Seconds per block of the synth alone, with held notes and events releasing and replaying them through the block
+	template <typename Synth>
+	double timeSynthBlock(Synth& synth, int numVoices, int blockSize, int events, const Settings& settings) {
+		juce::AudioBuffer<float> buffer(2, blockSize);
+		juce::MidiBuffer midi;
+
+		for (int voice = 0; voice < numVoices; voice++)
+			midi.addEvent(juce::MidiMessage::noteOn(1 + voice / 8, lowestNote + voice % 8, 1.0f), 0);
+
+		buffer.clear();
+		synth.renderNextBlock(buffer, midi, 0, blockSize);
+		midi.clear();
+
+		for (int event = 0; event < events; event++) {
+			const int note = lowestNote + (event / 2) % 8;
+			const int position = event * blockSize / juce::jmax(events, 1);
+			midi.addEvent((event & 1) ? juce::MidiMessage::noteOn(1, note, 1.0f) : juce::MidiMessage::noteOff(1, note), position);
+		}
+
+		return timePerCall([&] {
+			buffer.clear();
+			synth.renderNextBlock(buffer, midi, 0, blockSize);
+		}, settings);
+	}
+
+	void benchSynthEngine(Results& results, const Settings& settings) {
+		//Only here for its parameters. The reference has no per voice filter, so it's off on both
+		AdditiveSynth1AudioProcessor processor;
+		auto& apvts = processor.apvts;
+		setParameter(apvts, Params::Num_Voices, (float)defaultVoices);
+		setParameter(apvts, Params::Filter_Bypass, 1.0f);
+		setParameter(apvts, Params::Multicore_Rendering, 0.0f);
+		disableCulling(apvts);
+
+		ParameterSnapshot parameters;
+		parameters.initialise(apvts);
+		parameters.update();
+
+		for (int blockSize : { 32, 64, 128 }) {
+			for (int events : { 0, 8 }) {
+				juce::dsp::ProcessSpec spec{ defaultSampleRate, (juce::uint32)blockSize, 2 };
+
+				AdditiveSynthesiser<float> synth;
+				synth.setSound(new SynthSound());
+				for (int i = 0; i < defaultVoices; i++)
+					synth.addSynthVoice(new SynthVoice<float>());
+				synth.initialise(parameters);
+				synth.prepareToPlay(spec);
+
+				SynthSound::Ptr referenceTables = new SynthSound();
+				juce::Synthesiser reference;
+				reference.addSound(new ReferenceSound());
+				for (int i = 0; i < defaultVoices; i++)
+					reference.addVoice(new ReferenceVoice(parameters, referenceTables.get(), spec));
+				reference.setCurrentPlaybackSampleRate(defaultSampleRate);
+
+				const double seconds = timeSynthBlock(synth, defaultVoices, blockSize, events, settings);
+				const double referenceSeconds = timeSynthBlock(reference, defaultVoices, blockSize, events, settings);
+
+				auto* result = results.add("synth_engine");
+				result->setProperty("voices", defaultVoices);
+				result->setProperty("block_size", blockSize);
+				result->setProperty("events", events);
+				result->setProperty("us_per_block", 1.0e6 * seconds);
+				result->setProperty("juce_us_per_block", 1.0e6 * referenceSeconds);
+				logResult("synth_engine block=" + juce::String(blockSize) + " events=" + juce::String(events) + ": "
+						  + juce::String(1.0e6 * seconds, 2) + " us/block, juce::Synthesiser " + juce::String(1.0e6 * referenceSeconds, 2) + " us/block");
+			}
+		}
+	}
+
+	//==============================================================================
+	void benchGainFilter(Results& results, const Settings& settings) {
+		for (int blockSize : blockSizes) {
+			juce::dsp::ProcessSpec spec{ defaultSampleRate, (juce::uint32)blockSize, 2 };
+
+			//Set up as processBlock does
+			juce::dsp::Gain<float> gain;
+			gain.prepare(spec);
+			gain.setRampDurationSeconds(MASTER_GAIN_RAMP_SECONDS);
+			gain.setGainLinear(MASTER_GAIN_DEF);
+
+			juce::dsp::StateVariableTPTFilter<float> filter;
+			filter.setType(juce::dsp::StateVariableTPTFilterType::lowpass);
+			filter.prepare(spec);
+			filter.setCutoffFrequency(FILTER_CUTOFF_DEF);
+			filter.setResonance(FILTER_RESONANCE_DEF);
+
+			juce::AudioBuffer<float> buffer(2, blockSize);
+			juce::Random random(1);
+			for (int channel = 0; channel < 2; channel++)
+				for (int i = 0; i < blockSize; i++)
+					buffer.setSample(channel, i, random.nextFloat() * 2.0f - 1.0f);
+
+			double seconds = timePerCall([&] {
+				juce::dsp::AudioBlock<float> block{ buffer };
+				auto ctx = juce::dsp::ProcessContextReplacing{ block };
+				gain.process(ctx);
+				filter.process(ctx);
+			}, settings);
+
+			double nsPerSample = 1.0e9 * seconds / blockSize;
+			auto* result = results.add("gain_filter");
+			result->setProperty("block_size", blockSize);
+			result->setProperty("ns_per_sample", nsPerSample);
+			logResult("gain_filter block=" + juce::String(blockSize) + ": " + juce::String(nsPerSample, 2) + " ns/sample");
+		}
+	}
+	void benchVoiceFilter(Results& results, const Settings& settings) {
+		//Only here for its parameters
+		AdditiveSynth1AudioProcessor processor;
+		setParameter(processor.apvts, Params::Filter_Env_Amount, 4.0f);
+
+		ParameterSnapshot parameters;
+		parameters.initialise(processor.apvts);
+
+		SynthSound::Ptr sound = new SynthSound();
+		juce::dsp::ProcessSpec spec{ defaultSampleRate, (juce::uint32)defaultBlockSize, 2 };
+
+		for (int numVoices : voiceCounts) {
+			juce::OwnedArray<SynthVoice<float>> voices;
+			juce::Array<SynthVoice<float>*> active;
+
+			//One rendered chunk each, filtered over and over
+			for (int i = 0; i < numVoices; i++) {
+				auto* voice = voices.add(new SynthVoice<float>());
+				voice->initialise(parameters);
+				voice->setSound(sound.get());
+				voice->prepareToPlay(spec);
+				voice->startNote(lowestNote + i % 24, 1.0f, 8192);
+				voice->renderScratch(defaultBlockSize);
+				active.add(voice);
+			}
+
+			VoiceFilter<float> filter;
+			filter.prepare(defaultSampleRate, defaultBlockSize, FILTER_CUTOFF_DEF);
+			filter.setParameters(parameters);
+
+			double seconds = timePerCall([&] {
+				filter.process(active, defaultBlockSize);
+			}, settings);
+
+			double nsPerSample = 1.0e9 * seconds / defaultBlockSize;
+			auto* result = results.add("voice_filter");
+			result->setProperty("voices", numVoices);
+			result->setProperty("lanes", VoiceFilter<float>::lanes);
+			result->setProperty("ns_per_sample", nsPerSample);
+			result->setProperty("ns_per_sample_voice", nsPerSample / numVoices);
+			logResult("voice_filter voices=" + juce::String(numVoices) + ": " + juce::String(nsPerSample, 2) + " ns/sample");
+		}
+	}
+
+	void benchEnvelope(Results& results, const Settings& settings) {
+		//Short enough that every stage turns up in a few blocks
+		juce::ADSR::Parameters envelopeParameters{ 0.01f, 0.05f, 0.5f, 0.05f };
+		constexpr int blocksPerNote = 32;
+
+		for (int blockSize : blockSizes) {
+			juce::AudioBuffer<float> buffer(1, blockSize);
+			std::vector<float> gains((size_t)blockSize);
+
+			Envelope<float> envelope;
+			envelope.setSampleRate(defaultSampleRate);
+			envelope.setParameters(envelopeParameters);
+
+			//Attack, decay, sustain, release, then silence
+			double seconds = timePerCall([&] {
+				envelope.noteOn();
+				for (int block = 0; block < blocksPerNote; block++) {
+					if (block == blocksPerNote / 2) envelope.noteOff();
+					envelope.render(gains.data(), blockSize);
+				}
+				sink = gains[0];
+			}, settings);
+
+			juce::ADSR adsr;
+			adsr.setSampleRate(defaultSampleRate);
+			adsr.setParameters(envelopeParameters);
+
+			//Applied to a buffer, as the voice used to
+			double adsrSeconds = timePerCall([&] {
+				adsr.noteOn();
+				for (int block = 0; block < blocksPerNote; block++) {
+					if (block == blocksPerNote / 2) adsr.noteOff();
+					buffer.clear();
+					adsr.applyEnvelopeToBuffer(buffer, 0, blockSize);
+				}
+				sink = buffer.getSample(0, 0);
+			}, settings);
+
+			double nsPerSample = 1.0e9 * seconds / (blockSize * blocksPerNote);
+			double adsrNsPerSample = 1.0e9 * adsrSeconds / (blockSize * blocksPerNote);
+			auto* result = results.add("envelope");
+			result->setProperty("block_size", blockSize);
+			result->setProperty("ns_per_sample", nsPerSample);
+			result->setProperty("juce_adsr_ns_per_sample", adsrNsPerSample);
+			logResult("envelope block=" + juce::String(blockSize) + ": " + juce::String(nsPerSample, 2) + " ns/sample, juce::ADSR "
+					  + juce::String(adsrNsPerSample, 2) + " ns/sample");
+		}
+	}
+
+	//==============================================================================
+	//Resident set size in bytes, Linux only, -1 elsewhere
+	juce::int64 getResidentBytes() {
+	#if JUCE_LINUX
+		long pages = 0, resident = 0;
+		if (auto* statm = std::fopen("/proc/self/statm", "r")) {
+			int read = std::fscanf(statm, "%ld %ld", &pages, &resident);
+			std::fclose(statm);
+			if (read == 2) return (juce::int64)resident * (juce::int64)sysconf(_SC_PAGESIZE);
+		}
+	#endif
+		return -1;
+	}
+
+	struct InstanceTimes {
+		double firstMs;
+		double medianMs;
+		double kbPerInstance;
+	};
+
+	//Constructs and prepares numInstances processors. With privateTables each also builds its own sine
+	//table, the way every SynthSound did before the table was shared, as the baseline
+	InstanceTimes timeInstances(int numInstances, bool privateTables) {
+		std::vector<std::unique_ptr<AdditiveSynth1AudioProcessor>> instances;
+		std::vector<std::unique_ptr<SineTable>> tables;
+		std::vector<double> constructSeconds;
+		const auto residentBefore = getResidentBytes();
+
+		//The first one pays for anything built once per process
+		for (int i = 0; i < numInstances; i++) {
+			auto start = juce::Time::getHighResolutionTicks();
+			instances.push_back(std::make_unique<AdditiveSynth1AudioProcessor>());
+			if (privateTables)
+				tables.push_back(std::make_unique<SineTable>());
+			instances.back()->prepareToPlay(defaultSampleRate, defaultBlockSize);
+			constructSeconds.push_back(secondsSince(start));
+		}
+
+		const auto residentAfter = getResidentBytes();
+
+		std::vector<double> rest(constructSeconds.begin() + 1, constructSeconds.end());
+		std::sort(rest.begin(), rest.end());
+
+		InstanceTimes times;
+		times.firstMs = 1000.0 * constructSeconds.front();
+		times.medianMs = 1000.0 * rest[rest.size() / 2];
+		times.kbPerInstance = residentBefore < 0 || residentAfter < 0
+							? -1.0 : (double)(residentAfter - residentBefore) / numInstances / 1024.0;
+		return times;
+	}
+
+	void benchInstances(Results& results, const Settings& settings) {
+		constexpr int numInstances = 16;
+		juce::ignoreUnused(settings);
+
+		//The shared set first, so the process wide tables are already built when the baseline runs
+		const auto shared = timeInstances(numInstances, false);
+		const auto legacy = timeInstances(numInstances, true);
+
+		auto* result = results.add("instances");
+		result->setProperty("instances", numInstances);
+		result->setProperty("first_ms", shared.firstMs);
+		result->setProperty("median_ms", shared.medianMs);
+		result->setProperty("resident_kb_per_instance", shared.kbPerInstance);
+		result->setProperty("legacy_median_ms", legacy.medianMs);
+		result->setProperty("legacy_resident_kb_per_instance", legacy.kbPerInstance);
+		result->setProperty("sizeof_processor", (int)sizeof(AdditiveSynth1AudioProcessor));
+		result->setProperty("sizeof_sound", (int)sizeof(SynthSound));
+		result->setProperty("sizeof_voice", (int)sizeof(SynthVoice<float>));
+		result->setProperty("sizeof_sine_table", (int)sizeof(SineTable));
+		logResult("instances: first " + juce::String(shared.firstMs, 2) + " ms, then " + juce::String(shared.medianMs, 2) + " ms, "
+				  + juce::String(shared.kbPerInstance, 1) + " KB resident each");
+		logResult("instances legacy: " + juce::String(legacy.medianMs, 2) + " ms, "
+				  + juce::String(legacy.kbPerInstance, 1) + " KB resident each");
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	juce::ArgumentList args(argc, argv);
+
+	//APVTS runs a timer, so there has to be a message manager
+	juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+	Settings settings;
+	if (args.containsOption("--min-time"))
+		settings.minSeconds = juce::jmax(1.0, args.getValueForOption("--min-time").getDoubleValue()) / 1000.0;
+	if (args.containsOption("--runs"))
+		settings.runs = juce::jmax(1, args.getValueForOption("--runs").getIntValue());
+	if (args.containsOption("--only"))
+		settings.only = juce::StringArray::fromTokens(args.getValueForOption("--only"), ",", {});
+	settings.multicore = args.containsOption("--multicore");
+	settings.full = args.containsOption("--full");
+
+	if (args.containsOption("--kernel")) {
+		const auto name = args.getValueForOption("--kernel");
+		if (!OscillatorKernels::setVariant(OscillatorKernels::findVariant(name))) {
+			std::cerr << "Kernel " << name << " isn't one of " << KernelVariant::getNames().joinIntoString(", ") << " this CPU runs" << std::endl;
+			return 1;
+		}
+	}
+
+	const std::vector<std::pair<const char*, void (*)(Results&, const Settings&)>> benchmarks{
+		{ "lookup", benchLookup },
+		{ "table", benchTable },
+		{ "partial_bank", benchPartialBank },
+		{ "interleaved", benchInterleaved },
+		{ "kernels", benchKernels },
+		{ "spectral", benchSpectral },
+		{ "voice", benchVoice },
+		{ "modulation", benchModulation },
+		{ "snapshot", benchSnapshot },
+		{ "voice_update", benchVoiceUpdate },
+		{ "process_block", benchProcessBlock },
+		{ "synth_engine", benchSynthEngine },
+		{ "gain_filter", benchGainFilter },
+		{ "voice_filter", benchVoiceFilter },
+		{ "envelope", benchEnvelope },
+		{ "instances", benchInstances }
+	};
+
+	Results results;
+	for (auto& benchmark : benchmarks)
+		if (settings.only.isEmpty() || settings.only.contains(benchmark.first))
+			benchmark.second(results, settings);
+
+	auto json = juce::JSON::toString(results.toVar(args.getValueForOption("--label"), settings));
+
+	if (args.containsOption("--out")) {
+		auto file = juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption("--out"));
+		if (!file.replaceWithText(json)) {
+			std::cerr << "Couldn't write " << file.getFullPathName() << std::endl;
+			return 1;
+		}
+	}
+	else {
+		std::cout << json << std::endl;
+	}
+
+	return results.hasFailed() ? 1 : 0;
+}
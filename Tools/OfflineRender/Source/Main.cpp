@@ -0,0 +1,221 @@
+/*
+  ==============================================================================
+
+    Main.cpp
+
+	Offline render of AdditiveSynth1AudioProcessor, no host needed.
+
+	Plays a Standard MIDI File through processBlock at a fixed block size and
+	sample rate and streams the output to a WAV file. Reports the realtime
+	factor, per block processing time (p50/p99/max) and peak memory, so runs
+	can be compared between builds.
+
+	OfflineRender --midi song.mid [--out song.wav] [--state preset.bin]
+	              [--rate 48000] [--block 512] [--channels 2] [--tail 2]
+	              [--kernel avx2]
+	OfflineRender --write-state preset.bin
+
+	--state loads a blob written by getStateInformation, --write-state writes
+	the default one to start from. --kernel forces an OscillatorKernels
+	variant (generic, avx2, avx512), to compare their output.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../../../Source/PluginProcessor.h"
+#include "../../../Source/dsp/OscillatorKernels.h"
+
+#include <iostream>
+#include <iomanip>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <sys/resource.h>
+#endif
+
+namespace {
+	int fail(const juce::String& message) {
+		std::cerr << message << std::endl;
+		return 1;
+	}
+
+	//Relative paths are taken from the working directory
+	juce::File getFileForOption(const juce::ArgumentList& args, const juce::String& option) {
+		return juce::File::getCurrentWorkingDirectory().getChildFile(args.getValueForOption(option));
+	}
+
+	//Peak resident set size in MB, or -1 where it isn't available
+	double getPeakMemoryMB() {
+	#if JUCE_LINUX || JUCE_MAC
+		rusage usage{};
+		getrusage(RUSAGE_SELF, &usage);
+	 #if JUCE_MAC
+		return (double)usage.ru_maxrss / (1024.0 * 1024.0);
+	 #else
+		return (double)usage.ru_maxrss / 1024.0;
+	 #endif
+	#else
+		return -1.0;
+	#endif
+	}
+
+	//Every track merged into one sequence, timestamps in seconds
+	bool readMidiFile(const juce::File& file, juce::MidiMessageSequence& sequence) {
+		juce::FileInputStream stream(file);
+		if (!stream.openedOk()) return false;
+
+		juce::MidiFile midiFile;
+		if (!midiFile.readFrom(stream)) return false;
+
+		midiFile.convertTimestampTicksToSeconds();
+
+		for (int track = 0; track < midiFile.getNumTracks(); track++)
+			sequence.addSequence(*midiFile.getTrack(track), 0.0);
+
+		sequence.sort();
+		return true;
+	}
+
+	double percentile(const std::vector<double>& sorted, double fraction) {
+		if (sorted.empty()) return 0.0;
+		auto index = (size_t)juce::jlimit(0.0, (double)(sorted.size() - 1), std::ceil(fraction * (double)sorted.size()) - 1.0);
+		return sorted[index];
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	juce::ArgumentList args(argc, argv);
+
+	//APVTS runs a timer, so there has to be a message manager
+	juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+	AdditiveSynth1AudioProcessor processor;
+
+	if (args.containsOption("--write-state")) {
+		juce::MemoryBlock state;
+		processor.getStateInformation(state);
+
+		auto file = getFileForOption(args, "--write-state");
+		if (!file.replaceWithData(state.getData(), state.getSize()))
+			return fail("Couldn't write " + file.getFullPathName());
+
+		std::cout << "Wrote default state to " << file.getFullPathName() << std::endl;
+		return 0;
+	}
+
+	if (!args.containsOption("--midi"))
+		return fail("Usage: OfflineRender --midi file.mid [--out file.wav] [--state state.bin] [--rate 48000] [--block 512] [--channels 2] [--tail 2] [--kernel avx2]\n"
+					"       OfflineRender --write-state state.bin");
+
+	const double sampleRate = args.containsOption("--rate") ? args.getValueForOption("--rate").getDoubleValue() : 48000.0;
+	const int blockSize = args.containsOption("--block") ? args.getValueForOption("--block").getIntValue() : 512;
+	const int numChannels = args.containsOption("--channels") ? args.getValueForOption("--channels").getIntValue() : 2;
+	const double tailSeconds = args.containsOption("--tail") ? args.getValueForOption("--tail").getDoubleValue() : 2.0;
+
+	if (sampleRate <= 0.0 || blockSize <= 0 || numChannels < 1 || numChannels > 2 || tailSeconds < 0.0)
+		return fail("Rate and block size must be positive, channels 1 or 2");
+
+	if (args.containsOption("--kernel") && !OscillatorKernels::setVariant(OscillatorKernels::findVariant(args.getValueForOption("--kernel"))))
+		return fail("Kernel must be one of " + KernelVariant::getNames().joinIntoString(", ") + ", and run on this CPU");
+
+	//State
+	if (args.containsOption("--state")) {
+		auto stateFile = getFileForOption(args, "--state");
+
+		juce::MemoryBlock state;
+		if (!stateFile.loadFileAsData(state))
+			return fail("Couldn't read " + stateFile.getFullPathName());
+
+		processor.setStateInformation(state.getData(), (int)state.getSize());
+	}
+
+	//MIDI
+	juce::MidiMessageSequence sequence;
+	auto midiPath = getFileForOption(args, "--midi");
+	if (!readMidiFile(midiPath, sequence))
+		return fail("Couldn't read MIDI file " + midiPath.getFullPathName());
+
+	const double lengthSeconds = sequence.getEndTime() + tailSeconds;
+	const auto totalSamples = (juce::int64)std::ceil(lengthSeconds * sampleRate);
+
+	//Output, optional so a run can measure the processor alone
+	std::unique_ptr<juce::AudioFormatWriter> writer;
+	if (args.containsOption("--out")) {
+		auto outFile = getFileForOption(args, "--out");
+		outFile.deleteFile();
+
+		auto stream = std::make_unique<juce::FileOutputStream>(outFile);
+		if (!stream->openedOk())
+			return fail("Couldn't open " + outFile.getFullPathName());
+
+		juce::WavAudioFormat wav;
+		writer.reset(wav.createWriterFor(stream.get(), sampleRate, (unsigned int)numChannels, 24, {}, 0));
+		if (writer == nullptr)
+			return fail("Couldn't create a WAV writer");
+
+		//The writer owns the stream now
+		stream.release();
+	}
+
+	processor.setPlayConfigDetails(0, numChannels, sampleRate, blockSize);
+	processor.setNonRealtime(true);
+	processor.prepareToPlay(sampleRate, blockSize);
+
+	juce::AudioBuffer<float> buffer(numChannels, blockSize);
+	juce::MidiBuffer midi;
+	midi.ensureSize(2048);
+
+	std::vector<double> blockTimes;
+	blockTimes.reserve((size_t)(totalSamples / blockSize + 1));
+
+	int nextEvent = 0;
+	double processSeconds = 0.0;
+
+	for (juce::int64 position = 0; position < totalSamples; position += blockSize) {
+		const int numSamples = (int)juce::jmin((juce::int64)blockSize, totalSamples - position);
+		const double blockEnd = (double)(position + numSamples) / sampleRate;
+
+		//Events falling in this block, at their sample offset
+		midi.clear();
+		while (nextEvent < sequence.getNumEvents()) {
+			auto& message = sequence.getEventPointer(nextEvent)->message;
+			if (message.getTimeStamp() >= blockEnd) break;
+
+			auto offset = (int)(message.getTimeStamp() * sampleRate - (double)position);
+			midi.addEvent(message, juce::jlimit(0, numSamples - 1, offset));
+			nextEvent++;
+		}
+
+		//Hosts can hand over short blocks, the last one here is one of those
+		buffer.setSize(numChannels, numSamples, false, false, true);
+		buffer.clear();
+
+		auto start = juce::Time::getHighResolutionTicks();
+		processor.processBlock(buffer, midi);
+		auto seconds = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+		blockTimes.push_back(seconds);
+		processSeconds += seconds;
+
+		if (writer != nullptr)
+			writer->writeFromAudioSampleBuffer(buffer, 0, numSamples);
+	}
+
+	processor.releaseResources();
+	writer.reset();
+
+	std::sort(blockTimes.begin(), blockTimes.end());
+	const double audioSeconds = (double)totalSamples / sampleRate;
+	const double blockBudgetMs = 1000.0 * blockSize / sampleRate;
+
+	std::cout << std::fixed << std::setprecision(3)
+			  << "Rendered " << audioSeconds << " s at " << sampleRate << " Hz, " << blockTimes.size() << " blocks of " << blockSize << "\n"
+			  << "Realtime factor: " << (processSeconds > 0.0 ? audioSeconds / processSeconds : 0.0) << "x\n"
+			  << "Block time ms (budget " << blockBudgetMs << "): p50 " << 1000.0 * percentile(blockTimes, 0.5)
+			  << ", p99 " << 1000.0 * percentile(blockTimes, 0.99)
+			  << ", max " << 1000.0 * (blockTimes.empty() ? 0.0 : blockTimes.back()) << "\n"
+			  << "Peak memory: " << getPeakMemoryMB() << " MB" << std::endl;
+
+	return 0;
+}